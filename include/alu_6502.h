@@ -0,0 +1,16 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef ALU_6502_H_
+#define ALU_6502_H_
+
+#include <stdint.h>
+
+/* The result of A + b or A - b. Binary or decimal by D in flags; N, V, Z
+ * and C are updated. */
+uint8_t alu_adc(const uint8_t a, const uint8_t b, uint8_t *flags);
+uint8_t alu_sbc(const uint8_t a, const uint8_t b, uint8_t *flags);
+
+#endif
@@ -0,0 +1,14 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef BASIC_H_
+#define BASIC_H_
+
+#include "vm.h"
+
+int basic_load(vm_t *vm, const char *filename);
+int basic_save(vm_t *vm, const char *filename);
+
+#endif
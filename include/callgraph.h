@@ -0,0 +1,20 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef CALLGRAPH_H_
+#define CALLGRAPH_H_
+
+#include <stdint.h>
+
+#include "symbols.h"
+
+/* Fed by the CPU core when it is built with CPU_PROFILE. */
+
+int callgraph_start(const char *filename, const symbols_t *syms);
+void callgraph_instr(const uint8_t op, const uint16_t pc, const uint16_t next_pc, const uint8_t sp, const int cycles);
+void callgraph_interrupt(const uint16_t pc, const uint8_t sp, const int cycles);
+int callgraph_stop(void);
+
+#endif
@@ -0,0 +1,30 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <stdint.h>
+#include "vm.h"
+
+#define CP_KEYFRAME		'K'
+#define CP_DELTA		'D'
+
+typedef struct checkpoint_t checkpoint_t;
+typedef struct checkpoint_reader_t checkpoint_reader_t;
+
+checkpoint_t *checkpoint_create(vm_t *vm, const char *filename, int *status);
+int checkpoint_write(checkpoint_t *cp, vm_t *vm, const int wait);
+int checkpoint_close(checkpoint_t *cp);
+
+checkpoint_reader_t *checkpoint_open(const char *filename, int *status);
+int checkpoint_next(checkpoint_reader_t *cr);
+int checkpoint_restore(checkpoint_reader_t *cr, vm_t *vm);
+uint64_t checkpoint_cycle(checkpoint_reader_t *cr);
+int checkpoint_type(checkpoint_reader_t *cr);
+size_t checkpoint_packed_size(checkpoint_reader_t *cr);
+void checkpoint_close_reader(checkpoint_reader_t *cr);
+
+#endif
@@ -0,0 +1,19 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef CONSOLE_H_
+#define CONSOLE_H_
+
+#include "vm.h"
+
+#define CONSOLE_OUT_SIZE	4096
+
+typedef struct console_t console_t;
+
+console_t *console_create(vm_t *vm, const char *path, int *status);
+void console_poll(console_t *con);
+void console_close(console_t *con);
+
+#endif
@@ -0,0 +1,14 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef COVERAGE_H_
+#define COVERAGE_H_
+
+#include "vm.h"
+
+int coverage_start(vm_t *vm, const char *filename, const int rw);
+int coverage_stop(vm_t *vm);
+
+#endif
@@ -0,0 +1,35 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef COVFILE_H_
+#define COVFILE_H_
+
+#include <stdint.h>
+
+#define COV_MAP_SIZE	(65536 / 8)
+
+#define COV_EXEC		0x01
+#define COV_READ		0x02
+#define COV_WRITE		0x04
+
+#define COV_MARK(map, addr)	((map)[(addr) >> 3] |= (uint8_t)(1 << ((addr) & 7)))
+#define COV_TEST(map, addr)	(((map)[(addr) >> 3] >> ((addr) & 7)) & 1)
+
+/* One bit per address. Maps not in 'maps' are all zero. */
+typedef struct coverage_t {
+	int maps;
+	uint8_t exec[COV_MAP_SIZE];
+	uint8_t read[COV_MAP_SIZE];
+	uint8_t write[COV_MAP_SIZE];
+} coverage_t;
+
+void coverage_clear(coverage_t *cov);
+void coverage_merge(coverage_t *dst, const coverage_t *src);
+int coverage_flags(const coverage_t *cov, const uint16_t addr);
+
+int coverage_load(coverage_t *cov, const char *filename);
+int coverage_save(const coverage_t *cov, const char *filename);
+
+#endif
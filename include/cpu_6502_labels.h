@@ -0,0 +1,270 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Generated by scripts/oplabels.py from the comments in cpu_6502.c. */
+
+#ifndef CPU_6502_LABELS_H_
+#define CPU_6502_LABELS_H_
+
+static const char *op_labels[256] = {
+/* 00 */	"BRK",
+/* 01 */	"ORA ($xx, X)",
+/* 02 */	NULL,
+/* 03 */	NULL,
+/* 04 */	NULL,
+/* 05 */	"ORA $xx",
+/* 06 */	"ASL $xx",
+/* 07 */	NULL,
+/* 08 */	"PHP",
+/* 09 */	"ORA #$xx",
+/* 0a */	"ASL A",
+/* 0b */	NULL,
+/* 0c */	NULL,
+/* 0d */	"ORA $xxxx",
+/* 0e */	"ASL $xxxx",
+/* 0f */	NULL,
+/* 10 */	"BPL",
+/* 11 */	"ORA ($xx), Y",
+/* 12 */	NULL,
+/* 13 */	NULL,
+/* 14 */	NULL,
+/* 15 */	"ORA $xx, X",
+/* 16 */	"ASL $xx, X",
+/* 17 */	NULL,
+/* 18 */	"CLC",
+/* 19 */	"ORA $xxxx, Y",
+/* 1a */	NULL,
+/* 1b */	NULL,
+/* 1c */	NULL,
+/* 1d */	"ORA $xxxx, X",
+/* 1e */	"ASL $xxxx, X",
+/* 1f */	NULL,
+/* 20 */	"JSR $xxxx",
+/* 21 */	"AND ($xx, X)",
+/* 22 */	NULL,
+/* 23 */	NULL,
+/* 24 */	"BIT $xx",
+/* 25 */	"AND $xx",
+/* 26 */	"ROL $xx",
+/* 27 */	NULL,
+/* 28 */	"PLP",
+/* 29 */	"AND #$xx",
+/* 2a */	"ROL A",
+/* 2b */	NULL,
+/* 2c */	"BIT $xxxx",
+/* 2d */	"AND $xxxx",
+/* 2e */	"ROL $xxxx",
+/* 2f */	NULL,
+/* 30 */	"BMI",
+/* 31 */	"AND ($xx), Y",
+/* 32 */	NULL,
+/* 33 */	NULL,
+/* 34 */	NULL,
+/* 35 */	"AND $xx, X",
+/* 36 */	"ROL $xx, X",
+/* 37 */	NULL,
+/* 38 */	"SEC",
+/* 39 */	"AND $xxxx, Y",
+/* 3a */	NULL,
+/* 3b */	NULL,
+/* 3c */	NULL,
+/* 3d */	"AND $xxxx, X",
+/* 3e */	"ROL $xxxx, X",
+/* 3f */	NULL,
+/* 40 */	"RTI",
+/* 41 */	"EOR ($xx, X)",
+/* 42 */	NULL,
+/* 43 */	NULL,
+/* 44 */	NULL,
+/* 45 */	"EOR $xx",
+/* 46 */	"LSR $xx",
+/* 47 */	NULL,
+/* 48 */	"PHA",
+/* 49 */	"EOR #$xx",
+/* 4a */	"LSR A",
+/* 4b */	NULL,
+/* 4c */	"JMP $xxxx",
+/* 4d */	"EOR $xxxx",
+/* 4e */	"LSR $xxxx",
+/* 4f */	NULL,
+/* 50 */	"BVC",
+/* 51 */	"EOR ($xx), Y",
+/* 52 */	NULL,
+/* 53 */	NULL,
+/* 54 */	NULL,
+/* 55 */	"EOR $xx, X",
+/* 56 */	"LSR $xx, X",
+/* 57 */	NULL,
+/* 58 */	"CLI",
+/* 59 */	"EOR $xxxx, Y",
+/* 5a */	NULL,
+/* 5b */	NULL,
+/* 5c */	NULL,
+/* 5d */	"EOR $xxxx, X",
+/* 5e */	"LSR $xxxx, X",
+/* 5f */	NULL,
+/* 60 */	"RTS",
+/* 61 */	"ADC ($xx, X)",
+/* 62 */	NULL,
+/* 63 */	NULL,
+/* 64 */	NULL,
+/* 65 */	"ADC $xx",
+/* 66 */	"ROR $xx",
+/* 67 */	NULL,
+/* 68 */	"PLA",
+/* 69 */	"ADC #$xx",
+/* 6a */	"ROR A",
+/* 6b */	NULL,
+/* 6c */	"JMP ($xxxx)",
+/* 6d */	"ADC $xxxx",
+/* 6e */	"ROR $xxxx",
+/* 6f */	NULL,
+/* 70 */	"BVS",
+/* 71 */	"ADC ($xx), Y",
+/* 72 */	NULL,
+/* 73 */	NULL,
+/* 74 */	NULL,
+/* 75 */	"ADC $xx, X",
+/* 76 */	"ROR $xx, X",
+/* 77 */	NULL,
+/* 78 */	"SEI",
+/* 79 */	"ADC $xxxx, Y",
+/* 7a */	NULL,
+/* 7b */	NULL,
+/* 7c */	NULL,
+/* 7d */	"ADC $xxxx, X",
+/* 7e */	"ROR $xxxx, X",
+/* 7f */	NULL,
+/* 80 */	NULL,
+/* 81 */	"STA ($xx, X)",
+/* 82 */	NULL,
+/* 83 */	NULL,
+/* 84 */	"STY $xx",
+/* 85 */	"STA $xx",
+/* 86 */	"STX $xx",
+/* 87 */	NULL,
+/* 88 */	"DEY",
+/* 89 */	NULL,
+/* 8a */	"TXA",
+/* 8b */	NULL,
+/* 8c */	"STY $xxxx",
+/* 8d */	"STA $xxxx",
+/* 8e */	"STX $xxxx",
+/* 8f */	NULL,
+/* 90 */	"BCC",
+/* 91 */	"STA ($xx), Y",
+/* 92 */	NULL,
+/* 93 */	NULL,
+/* 94 */	"STY $xx, X",
+/* 95 */	"STA $xx, X",
+/* 96 */	"STX $xx, Y",
+/* 97 */	NULL,
+/* 98 */	"TYA",
+/* 99 */	"STA $xxxx, Y",
+/* 9a */	"TXS",
+/* 9b */	NULL,
+/* 9c */	NULL,
+/* 9d */	"STA $xxxx, X",
+/* 9e */	NULL,
+/* 9f */	NULL,
+/* a0 */	"LDY #$xx",
+/* a1 */	"LDA ($xx, X)",
+/* a2 */	"LDX #$xx",
+/* a3 */	NULL,
+/* a4 */	"LDY $xx",
+/* a5 */	"LDA $xx",
+/* a6 */	"LDX $xx",
+/* a7 */	NULL,
+/* a8 */	"TAY",
+/* a9 */	"LDA #$xx",
+/* aa */	"TAX",
+/* ab */	NULL,
+/* ac */	"LDY $xxxx",
+/* ad */	"LDA $xxxx",
+/* ae */	"LDX $xxxx",
+/* af */	NULL,
+/* b0 */	"BCS",
+/* b1 */	"LDA ($xx), Y",
+/* b2 */	NULL,
+/* b3 */	NULL,
+/* b4 */	"LDY $xx, X",
+/* b5 */	"LDA $xx, X",
+/* b6 */	"LDX $xx, Y",
+/* b7 */	NULL,
+/* b8 */	"CLV",
+/* b9 */	"LDA $xxxx, Y",
+/* ba */	"TSX",
+/* bb */	NULL,
+/* bc */	"LDY $xxxx, X",
+/* bd */	"LDA $xxxx, X",
+/* be */	"LDX $xxxx, Y",
+/* bf */	NULL,
+/* c0 */	"CPY #$xx",
+/* c1 */	"CMP ($xx, X)",
+/* c2 */	NULL,
+/* c3 */	NULL,
+/* c4 */	"CPY $xx",
+/* c5 */	"CMP $xx",
+/* c6 */	"DEC $xx",
+/* c7 */	NULL,
+/* c8 */	"INY",
+/* c9 */	"CMP #$xx",
+/* ca */	"DEX",
+/* cb */	NULL,
+/* cc */	"CPY $xxxx",
+/* cd */	"CMP $xxxx",
+/* ce */	"DEC $xxxx",
+/* cf */	NULL,
+/* d0 */	"BNE",
+/* d1 */	"CMP ($xx), Y",
+/* d2 */	NULL,
+/* d3 */	NULL,
+/* d4 */	NULL,
+/* d5 */	"CMP $xx, X",
+/* d6 */	"DEC $xx, X",
+/* d7 */	NULL,
+/* d8 */	"CLD",
+/* d9 */	"CMP $xxxx, Y",
+/* da */	NULL,
+/* db */	NULL,
+/* dc */	NULL,
+/* dd */	"CMP $xxxx, X",
+/* de */	"DEC $xxxx, X",
+/* df */	NULL,
+/* e0 */	"CPX #$xx",
+/* e1 */	"SBC ($xx, X)",
+/* e2 */	NULL,
+/* e3 */	NULL,
+/* e4 */	"CPX $xx",
+/* e5 */	"SBC $xx",
+/* e6 */	"INC $xx",
+/* e7 */	NULL,
+/* e8 */	"INX",
+/* e9 */	"SBC #$xx",
+/* ea */	"NOP",
+/* eb */	NULL,
+/* ec */	"CPX $xxxx",
+/* ed */	"SBC $xxxx",
+/* ee */	"INC $xxxx",
+/* ef */	NULL,
+/* f0 */	"BEQ",
+/* f1 */	"SBC ($xx), Y",
+/* f2 */	NULL,
+/* f3 */	NULL,
+/* f4 */	NULL,
+/* f5 */	"SBC $xx, X",
+/* f6 */	"INC $xx, X",
+/* f7 */	NULL,
+/* f8 */	"SED",
+/* f9 */	"SBC $xxxx, Y",
+/* fa */	NULL,
+/* fb */	NULL,
+/* fc */	NULL,
+/* fd */	"SBC $xxxx, X",
+/* fe */	"INC $xxxx, X",
+/* ff */	NULL,
+};
+
+#endif
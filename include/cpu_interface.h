@@ -6,8 +6,15 @@
 #ifndef CPU_INTERFACE_H_
 #define CPU_INTERFACE_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
+/* Register snapshot for tracing. */
+typedef struct cpu_regs_t {
+	uint16_t pc;
+	uint8_t a, x, y, sp, flags;
+} cpu_regs_t;
+
 typedef void* (*cpu_init_proc)(void*);
 typedef void (*cpu_quit_proc)(void*);
 typedef void (*cpu_reset_proc)(void*);
@@ -16,7 +23,10 @@ typedef int (*cpu_exec_proc)(void*, int*);
 typedef int (*cpu_int_proc)(void*, int*);
 typedef uint16_t (*cpu_getreg_proc)(void*);
 typedef void (*cpu_setreg_proc)(void*, const uint16_t);
-typedef void (*cpu_state_proc)(void*, const uint32_t);
+typedef void (*cpu_state_proc)(void*, const uint64_t);
+typedef void (*cpu_regs_proc)(void*, struct cpu_regs_t*);
+typedef size_t (*cpu_save_proc)(void*, uint8_t*);
+typedef void (*cpu_load_proc)(void*, const uint8_t*);
 
 typedef struct cpudef_t {
 	cpu_init_proc init;
@@ -29,14 +39,17 @@ typedef struct cpudef_t {
 	cpu_getreg_proc get_pc;
 	cpu_setreg_proc set_pc;
 	cpu_state_proc print_state;
+	cpu_regs_proc regs;
+	cpu_save_proc save_state;	/* Returns the size written. NULL buffer: size only */
+	cpu_load_proc load_state;
 } cpudef_t;
 
 #define DEC_CPU_INTERFACE(id) \
 	cpudef_t id
 
-#define DEF_CPU_INTERFACE(id, init, quit, reset, fetch, exec, nmi, irq, getpc, setpc, print) \
+#define DEF_CPU_INTERFACE(id, init, quit, reset, fetch, exec, nmi, irq, getpc, setpc, print, regs, save, load) \
 	cpudef_t id = { \
-		init, quit, reset, fetch, exec, nmi, irq, getpc, setpc, print \
+		init, quit, reset, fetch, exec, nmi, irq, getpc, setpc, print, regs, save, load \
 	}
 
 #endif
\ No newline at end of file
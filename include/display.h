@@ -0,0 +1,15 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef DISPLAY_H_
+#define DISPLAY_H_
+
+#include "display_interface.h"
+
+dispdef_t display_null;
+dispdef_t display_ansi;
+dispdef_t display_sdl;
+
+#endif
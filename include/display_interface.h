@@ -0,0 +1,53 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef DISPLAY_INTERFACE_H_
+#define DISPLAY_INTERFACE_H_
+
+#include <stdint.h>
+
+#define SCR_COLS	60
+#define SCR_ROWS	36
+
+/* The screen is a ring of rows: cell rows are stored by slot, and the
+ * visible row y lives in slot (top + y) % SCR_ROWS, so scrolling only
+ * moves top. Every change to a slot bumps its generation, which lets a
+ * renderer find the rows it has to redraw. */
+#define scrslot(scr, y) (((scr)->top + (y)) % SCR_ROWS)
+#define scrpos(scr, x, y) (scrslot(scr, y) * SCR_COLS + (x))
+
+typedef struct screen_t {
+	uint8_t cell[SCR_COLS * SCR_ROWS];
+	uint32_t gen[SCR_ROWS];
+	uint32_t top;
+	uint32_t col, row;		/* Cursor, in visible rows */
+} screen_t;
+
+typedef int (*disp_init_proc)(void);
+typedef void (*disp_quit_proc)(void);
+typedef void (*disp_reset_proc)(void);
+typedef void (*disp_putc_proc)(const uint8_t);
+typedef void (*disp_frame_proc)(const screen_t*, const int);
+
+/* Any proc but init and quit may be NULL. A backend without a frame
+ * proc is never scheduled for rendering. */
+typedef struct dispdef_t {
+	const char *name;
+	disp_init_proc init;
+	disp_quit_proc quit;
+	disp_reset_proc reset;		/* Screen was cleared */
+	disp_putc_proc putc;		/* Character written to the display */
+	disp_frame_proc frame;		/* Once per frame, flag set if cells changed */
+} dispdef_t;
+
+#define DEC_DISPLAY_INTERFACE(id) \
+	dispdef_t id
+
+#define DEF_DISPLAY_INTERFACE(id, name, init, quit, reset, putc, frame) \
+	dispdef_t id = { \
+		name, init, quit, reset, putc, frame \
+	}
+
+#endif
@@ -0,0 +1,18 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef HEATMAP_H_
+#define HEATMAP_H_
+
+#include <stdint.h>
+
+#include "vm.h"
+
+#define HEAT_COUNT(map, addr)	((map)[addr] += ((map)[addr] != 0xffff))
+
+int heatmap_start(vm_t *vm, const char *filename, const int interval);
+int heatmap_stop(vm_t *vm);
+
+#endif
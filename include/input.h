@@ -32,16 +32,20 @@ typedef struct key_input_t {
 	SDL_Keysym Keysym;
 } key_input_t;
 
+/* Fixed-size record, as passed through the input ring. */
 typedef struct input_t {
 	input_type_t type;
 	union {
-		mouse_input_t *mouse;
-		key_input_t *key;
+		mouse_input_t mouse;
+		key_input_t key;
 	};
 } input_t;
 
 typedef int (*input_proc_t)(void*);
 
+void input_pump(void);
+void input_set_producer(const int external);
+
 void input_get(void);
 void input_dispatch(void);
 
@@ -6,8 +6,25 @@
 #ifndef IO_6829_H_
 #define IO_6829_H_
 
-int pia_init(vm_t *vm);
-void pia_step(vm_t *vm);
+#include <stdint.h>
+#include "display_interface.h"
+#include "vm.h"
+
+typedef void (*pia_output_proc_t)(void*, const uint8_t);
+
+int pia_init(vm_t *vm, dispdef_t dispdef);
 void pia_clean(void);
+void pia_event(vm_t *vm, const uint8_t type, const uint8_t data);
+
+int pia_ascii_key(const uint8_t c, const uint8_t prev);
+size_t pia_kbd_space(void);
+int pia_output_reg(pia_output_proc_t proc, void *data);
+
+int pia_paste_text(const char *text, const size_t len);
+int pia_paste_file(const char *filename);
+void pia_paste_branch(const size_t n_undone);
+
+size_t pia_save_state(uint8_t *buf);
+void pia_load_state(const uint8_t *buf);
 
 #endif
\ No newline at end of file
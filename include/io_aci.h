@@ -0,0 +1,21 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef IO_ACI_H_
+#define IO_ACI_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vm.h"
+
+#define ACI_ROM_FILE	"rom/aci.bin"
+
+int aci_init(vm_t *vm, const char *rom, const char *tape_in, const char *tape_out, const int fast);
+int aci_clean(void);
+
+size_t aci_save_state(uint8_t *buf);
+void aci_load_state(const uint8_t *buf);
+
+#endif
@@ -0,0 +1,21 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef IO_FEEDBACK_H_
+#define IO_FEEDBACK_H_
+
+#include <stdint.h>
+#include "vm.h"
+
+#define FEEDBACK_IRQ	0x01
+#define FEEDBACK_NMI	0x02
+#define FEEDBACK_STOP	0x80
+
+#define IRQ_FEEDBACK	0x01		/* Bit in vm->irq */
+
+int feedback_init(vm_t *vm, const uint16_t addr);
+void feedback_clean(void);
+
+#endif
@@ -0,0 +1,17 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef LOADER_H_
+#define LOADER_H_
+
+#include <stdint.h>
+#include "vm.h"
+
+#define LOAD_NO_START	0xffffffff
+
+int load_program(vm_t *vm, const char *spec, uint32_t *start);
+int parse_address(const char *str, uint16_t *addr);
+
+#endif
@@ -18,8 +18,6 @@ typedef enum mmio_type_t { MMIO_READ, MMIO_WRITE } mmio_type_t;
 typedef int (*read_proc_t)(const uint16_t, uint8_t*);
 typedef int (*write_proc_t)(const uint16_t, const uint8_t);
 
-void *get_pointer(vm_t *vm, const size_t offset);
-
 void write_mem(vm_t *vm, const uint16_t addr, const uint8_t val);
 uint8_t read_mem(vm_t *vm, const uint16_t addr);
 uint16_t read_ptr(vm_t *vm, const uint16_t addr);
@@ -0,0 +1,17 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef PACE_H_
+#define PACE_H_
+
+#include <stdint.h>
+#include "vm.h"
+
+#define PACE_MAX_LAG	10		/* Give up catching up after 1/10 s */
+
+int pace_init(vm_t *vm, const double speed, const int turbo);
+void pace_sync(vm_t *vm);
+
+#endif
@@ -0,0 +1,18 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* The CPU core only counts when built with CPU_PROFILE defined. */
+
+void profile_instr(const uint8_t op, const uint16_t pc, const int cycles);
+void profile_print(FILE *fp);
+int profile_write_csv(const char *filename);
+
+#endif
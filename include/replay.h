@@ -0,0 +1,34 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vm.h"
+
+#define REPLAY_KEY		1
+#define REPLAY_RESET	2
+#define REPLAY_QUIT		3
+#define REPLAY_PASTE	4		/* A key typed by a paste */
+
+typedef struct input_event_t {
+	uint64_t cycle;
+	uint8_t type;
+	uint8_t data;
+} input_event_t;
+
+int replay_record(const char *filename);
+int replay_load(vm_t *vm, const char *filename);
+int replay_playing(void);
+int replay_rewinding(void);
+void replay_log(vm_t *vm, const uint8_t type, const uint8_t data);
+size_t replay_tell(void);
+void replay_seek(vm_t *vm, const size_t pos);
+void replay_branch(vm_t *vm);
+void replay_clean(void);
+
+#endif
@@ -0,0 +1,20 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef REWIND_H_
+#define REWIND_H_
+
+#include <stdint.h>
+#include "vm.h"
+
+#define REWIND_BUDGET	(32 * 1024 * 1024)
+#define REWIND_INTERVAL	1000000
+
+int rewind_init(vm_t *vm, const size_t budget, const uint32_t interval);
+int rewind_steps(vm_t *vm, const uint64_t n);
+int rewind_to_cycle(vm_t *vm, const uint64_t cycle);
+void rewind_clean(void);
+
+#endif
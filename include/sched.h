@@ -0,0 +1,38 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCHED_NEVER	UINT64_MAX
+
+struct vm_t;
+
+typedef void (*sched_proc_t)(struct vm_t*, void*);
+
+typedef struct sched_event_t {
+	uint64_t when, seq;
+	sched_proc_t proc;
+	void *data;
+} sched_event_t;
+
+typedef struct sched_t {
+	size_t n_events, n_alloced;
+	uint64_t seq;
+	sched_event_t *event;
+} sched_t;
+
+int sched_init(sched_t *sched);
+void sched_clean(sched_t *sched);
+
+int sched_add(struct vm_t *vm, const uint64_t when, sched_proc_t proc, void *data);
+void sched_cancel(struct vm_t *vm, sched_proc_t proc, void *data);
+void sched_rebase(struct vm_t *vm, const uint64_t old_cycle);
+void sched_dispatch(struct vm_t *vm);
+
+#endif
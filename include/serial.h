@@ -0,0 +1,26 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef SERIAL_H_
+#define SERIAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Little endian (de)serialisation. Each call advances the cursor. */
+
+void put_u8(uint8_t **p, const uint8_t val);
+void put_u16(uint8_t **p, const uint16_t val);
+void put_u32(uint8_t **p, const uint32_t val);
+void put_u64(uint8_t **p, const uint64_t val);
+void put_bytes(uint8_t **p, const uint8_t *data, const size_t size);
+
+uint8_t get_u8(const uint8_t **p);
+uint16_t get_u16(const uint8_t **p);
+uint32_t get_u32(const uint8_t **p);
+uint64_t get_u64(const uint8_t **p);
+void get_bytes(const uint8_t **p, uint8_t *data, const size_t size);
+
+#endif
@@ -10,6 +10,9 @@
 
 #define RET_LOOP		2
 #define RET_JUMP		3
+#define RET_BUSY		4
+#define RET_EOF			5
+#define RET_BREAK		6
 
 #define RET_ERR_INSTR	-10
 
@@ -17,6 +20,8 @@
 #define RET_ERR_OPEN	-101
 #define RET_ERR_SDL		-102
 #define RET_ERR_INVAL	-103
+#define RET_ERR_FORMAT	-104
+#define RET_ERR_IO		-105
 
 #define RET_QUIT		-9999
 
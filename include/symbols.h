@@ -0,0 +1,26 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef SYMBOLS_H_
+#define SYMBOLS_H_
+
+#include <stdint.h>
+
+typedef struct symbols_t symbols_t;
+
+symbols_t *symbols_init(void);
+void symbols_free(symbols_t *syms);
+
+int symbols_load(symbols_t *syms, const char *filename);
+int symbols_count(const symbols_t *syms);
+
+int symbols_lookup(const symbols_t *syms, const char *name, uint16_t *addr);
+const char *symbols_exact(const symbols_t *syms, const uint16_t addr);
+const char *symbols_find(const symbols_t *syms, const uint16_t addr, uint16_t *base);
+void symbols_format(const symbols_t *syms, const uint16_t addr, char *out);
+
+#define SYMBOL_MAX_LEN	64		/* Longest name, including symbols_format's "+$xxxx" */
+
+#endif
@@ -0,0 +1,15 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "vm.h"
+
+int trace_start(vm_t *vm, const char *filename);
+void trace_put(vm_t *vm);
+int trace_stop(vm_t *vm);
+
+#endif
@@ -0,0 +1,43 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef TRACEFILE_H_
+#define TRACEFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_MAX_WRITES	6		/* Interrupt entry plus a JSR or BRK */
+#define TRACE_REC_MAX		56		/* Longest encoded record */
+
+#define TRACE_SHOW_CYCLES	1
+#define TRACE_SHOW_WRITES	2
+
+/* Machine state after an instruction, as print_state shows it, plus the
+ * memory writes since the record before, in order. The pushes of an
+ * interrupt entry come with the first instruction of the handler. */
+typedef struct trace_rec_t {
+	uint64_t step, cycle;
+	uint16_t pc;
+	uint8_t op;				/* Opcode at pc */
+	uint8_t a, x, y, sp, flags;
+	uint8_t n_writes;
+	uint32_t write[TRACE_MAX_WRITES];	/* addr << 8 | val */
+} trace_rec_t;
+
+typedef struct trace_reader_t trace_reader_t;
+
+size_t trace_file_header(uint8_t *out);
+size_t trace_encode(trace_rec_t *prev, const trace_rec_t *rec, uint8_t *out);
+
+trace_reader_t *trace_open(const char *filename, int *status);
+int trace_read(trace_reader_t *tr, trace_rec_t *rec);
+void trace_close_reader(trace_reader_t *tr);
+
+void trace_print(FILE *fp, const trace_rec_t *rec, const int show);
+int trace_parse_line(const char *line, trace_rec_t *rec);
+
+#endif
@@ -8,18 +8,47 @@
 
 #include <stdint.h>
 #include "cpu_interface.h"
+#include "display_interface.h"
+#include "sched.h"
+#include "tracefile.h"
 
 #define LOC_RAM		0
 #define LOC_ROM		1
 
+#define CPU_CLOCK	1023000		/* Apple 1 CPU clock in Hz */
+#define FRAME_RATE	60
+#define FRAME_CYCLES	(CPU_CLOCK / FRAME_RATE)
+
+typedef struct trace_t trace_t;
+typedef struct watch_list_t watch_list_t;
+
 typedef struct vm_t {
 	uint8_t mem[65536];
 	uint8_t rom[65536];
 	uint8_t ram[65536];
 	uint8_t mem_map[65536];
-	uint32_t cycle, step;
+	uint64_t cycle, step;
+	uint64_t deadline;	/* Next scheduler event */
+	sched_t sched;
 	int quit;
 
+	trace_t *trace;		/* NULL unless tracing */
+	uint32_t writes[TRACE_MAX_WRITES];	/* Memory writes since the last record */
+	int n_writes;
+
+	uint8_t *cov_exec;		/* Coverage bitmaps, NULL unless enabled */
+	uint8_t *cov_read, *cov_write;
+
+	uint16_t *heat_read;	/* Access counters, NULL unless enabled */
+	uint16_t *heat_write, *heat_fetch;
+
+	uint8_t trap[256];		/* TRAP_* flags per page, see watch.h */
+	watch_list_t *watch;	/* NULL unless a trap was set */
+	int watch_hit;			/* A watchpoint fired, the run stops */
+
+	uint8_t irq;			/* Devices holding IRQ low, one bit each */
+	uint8_t nmi;			/* NMI edge seen, not yet taken */
+
 	cpudef_t cpu_def;
 	void *cpu_state;
 } vm_t;
@@ -28,10 +57,15 @@ void mount_rom(vm_t *vm, const uint16_t addr, const size_t size);
 void umount_rom(vm_t *vm, const uint16_t addr, const size_t size);
 int load_rom(vm_t *vm, const size_t addr, const char *filename);
 
-vm_t *vm_init(cpudef_t cpu_def, int *status);
+vm_t *vm_init(cpudef_t cpu_def, dispdef_t disp_def, int *status);
 void vm_clean(vm_t *vm);
 
 void vm_step(vm_t *vm, int *status);
+void vm_run(vm_t *vm, const uint64_t until, int *status);
 void vm_reset(vm_t *vm);
 
+size_t vm_state_size(vm_t *vm, const int with_rom);
+void vm_save_state(vm_t *vm, uint8_t *buf, const int with_rom);
+void vm_load_state(vm_t *vm, const uint8_t *buf, const int with_rom);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,24 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#ifndef WATCH_H_
+#define WATCH_H_
+
+#include <stdint.h>
+
+#include "vm.h"
+
+/* Flags in vm->trap, one byte per page */
+#define TRAP_EXEC		0x01
+#define TRAP_READ		0x02
+#define TRAP_WRITE		0x04
+
+int watch_add(vm_t *vm, const int type, const char *spec);
+void watch_clear(vm_t *vm);
+
+int watch_exec(vm_t *vm, const uint16_t pc);
+void watch_access(vm_t *vm, const int type, const uint16_t addr, const uint8_t old, const uint8_t val);
+
+#endif
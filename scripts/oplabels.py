@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-only
+# Copyright (C) 2017-2022  Martin Wolters
+#
+# Builds include/cpu_6502_labels.h from the comments on the instructions in
+# src/cpu_6502.c, e.g. "case 0x0a:	/* ASL A */". Run it from the
+# repository root after adding or renaming instructions.
+
+import re
+import sys
+
+SOURCE = "src/cpu_6502.c"
+TARGET = "include/cpu_6502_labels.h"
+
+PATTERNS = [
+	re.compile(r"case (0x[0-9a-f]{2}):\s*/\*\s*(.*?)\s*\*/"),
+	re.compile(r"cpu->ir != (0x[0-9a-f]{2})\) return RET_ERR_INSTR;\s*/\*\s*(.*?)\s*\*/"),
+]
+
+HEADER = """/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Generated by scripts/oplabels.py from the comments in cpu_6502.c. */
+
+#ifndef CPU_6502_LABELS_H_
+#define CPU_6502_LABELS_H_
+
+static const char *op_labels[256] = {
+"""
+
+FOOTER = """};
+
+#endif
+"""
+
+def main():
+	labels = [None] * 256
+
+	with open(SOURCE) as f:
+		for line in f:
+			for pattern in PATTERNS:
+				m = pattern.search(line)
+				if m:
+					op = int(m.group(1), 16)
+					if labels[op] is not None:
+						sys.exit("Opcode %02x is labelled twice." % op)
+					labels[op] = m.group(2)
+
+	with open(TARGET, "w", newline="\n") as f:
+		f.write(HEADER)
+		for op, label in enumerate(labels):
+			f.write("/* %02x */\t%s,\n" % (op, '"%s"' % label if label else "NULL"))
+		f.write(FOOTER)
+
+	print("%d instructions labelled." % sum(1 for l in labels if l))
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,311 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Checks ADC and SBC of the core against a reference model for every
+ * accumulator, operand, carry and D flag: what 6502_decimal_test.a65
+ * does in about a minute of guest time, on the host and in parallel.
+ *
+ * The model is Bruce Clark's prediction from that test, translated step
+ * by step: the decimal result is built from binary adds and subtracts
+ * of the digits, so it shares no code or formula with alu_6502.c. Unlike
+ * the test's default configuration, N, V and Z are compared as well. The
+ * flags ADC and SBC don't touch have to come out unchanged.
+ *
+ * The core is an NMOS 6502, so that is the variant checked.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+#undef main
+
+#include "leakcheck.h"
+
+#include "alu_6502.h"
+#include "cpu_6502.h"
+#include "status.h"
+
+#define MAX_THREADS		64
+#define MAX_REPORT		8
+
+#define OP_ADC			0
+#define OP_SBC			1
+#define N_OPS			2
+
+#define FLAGS_NVZC		(FLAG_NEGATIVE | FLAG_OVERFLOW | FLAG_ZERO | FLAG_CARRY)
+
+/* One mismatch, for the report. */
+typedef struct miss_t {
+	uint8_t a, b, flags;
+	uint8_t got_a, got_p, want_a, want_p;
+} miss_t;
+
+/* Results for one operation in one mode. */
+typedef struct tally_t {
+	uint32_t cases, missed;
+	int n_miss;
+	miss_t miss[MAX_REPORT];
+} tally_t;
+
+typedef struct job_t {
+	int first, step;		/* Accumulator values first, first + step, ... */
+	tally_t tally[N_OPS][2];
+	SDL_Thread *thread;
+} job_t;
+
+/* Reference model */
+
+typedef struct ref_t {
+	int a, c;
+	uint8_t p;				/* N, V, Z and C of the last operation */
+} ref_t;
+
+static void ref_flags(ref_t *r, const int res, const int sgn) {
+	r->a = res & 0xff;
+	r->p = (r->a & 0x80) ? FLAG_NEGATIVE : 0;
+	if(r->a == 0) r->p |= FLAG_ZERO;
+	if(sgn < -128 || sgn > 127) r->p |= FLAG_OVERFLOW;
+	if(r->c) r->p |= FLAG_CARRY;
+}
+
+static void ref_adc(ref_t *r, const int b) {
+	int res = r->a + b + r->c;
+	int sgn = (int8_t)r->a + (int8_t)b + r->c;
+
+	r->c = res > 0xff;
+	ref_flags(r, res, sgn);
+}
+
+static void ref_sbc(ref_t *r, const int b) {
+	int res = r->a - b - !r->c;
+	int sgn = (int8_t)r->a - (int8_t)b - !r->c;
+
+	r->c = res >= 0;
+	ref_flags(r, res, sgn);
+}
+
+/* The ADD, A6502 and SUB, SUB1, S6502 routines of the decimal test. */
+static void ref_decimal(const int op, const int n1, const int n2, const int c, uint8_t *a, uint8_t *p) {
+	ref_t r, bin;
+	uint8_t nv;
+	int x = 0;
+
+	bin.a = n1;
+	bin.c = c;
+	r.a = n1 & 0x0f;
+	r.c = c;
+
+	if(op == OP_ADC) {
+		ref_adc(&bin, n2);
+
+		ref_adc(&r, n2 & 0x0f);
+		if((r.c = (r.a >= 0x0a)) != 0) {
+			x = 1;
+			ref_adc(&r, 5);
+			r.a &= 0x0f;
+			r.c = 1;
+		}
+		r.a |= n1 & 0xf0;
+		ref_adc(&r, x ? (n2 & 0xf0) + 0x0f : n2 & 0xf0);
+		nv = r.p & (FLAG_NEGATIVE | FLAG_OVERFLOW);
+
+		if(r.c || r.a >= 0xa0) {
+			r.c = 1;
+			ref_adc(&r, 0x5f);
+			r.c = 1;
+		}
+
+		*a = (uint8_t)r.a;
+		*p = nv | (bin.p & FLAG_ZERO) | (r.c ? FLAG_CARRY : 0);
+	} else {
+		ref_sbc(&bin, n2);
+
+		ref_sbc(&r, n2 & 0x0f);
+		if(!r.c) {
+			x = 1;
+			ref_sbc(&r, 5);
+			r.a &= 0x0f;
+			r.c = 0;
+		}
+		r.a |= n1 & 0xf0;
+		ref_sbc(&r, x ? (n2 & 0xf0) + 0x0f : n2 & 0xf0);
+		if(!r.c)
+			ref_sbc(&r, 0x5f);
+
+		*a = (uint8_t)r.a;
+		*p = bin.p;
+	}
+}
+
+static void ref_binary(const int op, const int n1, const int n2, const int c, uint8_t *a, uint8_t *p) {
+	ref_t r;
+
+	r.a = n1;
+	r.c = c;
+
+	if(op == OP_ADC)
+		ref_adc(&r, n2);
+	else
+		ref_sbc(&r, n2);
+
+	*a = (uint8_t)r.a;
+	*p = r.p;
+}
+
+/* Workers */
+
+static void check(tally_t *t, const int op, const int dec, const uint8_t n1, const uint8_t n2, const int c) {
+	uint8_t flags, in, got_a, want_a, want_p;
+	miss_t *m;
+
+	/* Stale N, V and Z and a mix of the other flags going in */
+	in = FLAG_RESERVED | (n2 & (FLAG_NEGATIVE | FLAG_OVERFLOW | FLAG_ZERO)) | (n1 & (FLAG_BREAK | FLAG_INTERRUPT));
+	in |= (dec ? FLAG_DECIMAL : 0) | (c ? FLAG_CARRY : 0);
+
+	flags = in;
+	got_a = (op == OP_ADC) ? alu_adc(n1, n2, &flags) : alu_sbc(n1, n2, &flags);
+
+	if(dec)
+		ref_decimal(op, n1, n2, c, &want_a, &want_p);
+	else
+		ref_binary(op, n1, n2, c, &want_a, &want_p);
+	want_p |= in & ~FLAGS_NVZC;
+
+	t->cases++;
+	if(got_a == want_a && flags == want_p)
+		return;
+
+	t->missed++;
+	if(t->n_miss < MAX_REPORT) {
+		m = &t->miss[t->n_miss++];
+		m->a = n1;
+		m->b = n2;
+		m->flags = in;
+		m->got_a = got_a;
+		m->got_p = flags;
+		m->want_a = want_a;
+		m->want_p = want_p;
+	}
+}
+
+static int worker_thread(void *data) {
+	job_t *job = data;
+	int n1, n2, op, dec, c;
+
+	for(n1 = job->first; n1 < 256; n1 += job->step) {
+		for(n2 = 0; n2 < 256; n2++) {
+			for(op = 0; op < N_OPS; op++) {
+				for(dec = 0; dec < 2; dec++) {
+					for(c = 0; c < 2; c++)
+						check(&job->tally[op][dec], op, dec, (uint8_t)n1, (uint8_t)n2, c);
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* Report */
+
+static void flag_str(const uint8_t p, char *out) {
+	out[0] = (p & FLAG_NEGATIVE) ? 'N' : '-';
+	out[1] = (p & FLAG_OVERFLOW) ? 'V' : '-';
+	out[2] = (p & FLAG_ZERO) ? 'Z' : '-';
+	out[3] = (p & FLAG_CARRY) ? 'C' : '-';
+	out[4] = '\0';
+}
+
+/* Merges the threads' tallies for one operation and mode and prints it. */
+static uint32_t report(job_t *jobs, const int n_jobs, const int op, const int dec) {
+	static const char *name[N_OPS] = { "ADC", "SBC" };
+	uint32_t cases = 0, missed = 0;
+	int shown = 0, i, j;
+	char got[5], want[5];
+	miss_t *m;
+
+	for(i = 0; i < n_jobs; i++) {
+		cases += jobs[i].tally[op][dec].cases;
+		missed += jobs[i].tally[op][dec].missed;
+	}
+
+	printf("%s %-8s %6u cases, %u wrong\n", name[op], dec ? "decimal" : "binary", cases, missed);
+
+	for(i = 0; i < n_jobs && shown < MAX_REPORT; i++) {
+		for(j = 0; j < jobs[i].tally[op][dec].n_miss && shown < MAX_REPORT; j++, shown++) {
+			m = &jobs[i].tally[op][dec].miss[j];
+			flag_str(m->got_p, got);
+			flag_str(m->want_p, want);
+			printf("    A=%02x %s #%02x C=%d: A=%02x %s, expected A=%02x %s\n", m->a, name[op], m->b, m->flags & FLAG_CARRY, m->got_a, got, m->want_a, want);
+		}
+	}
+
+	return missed;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [--threads <n>]\n", name);
+	fprintf(stderr, "Checks ADC and SBC for all inputs in binary and decimal mode.\n");
+	fprintf(stderr, "  --threads <n>   Worker threads (default: one per CPU).\n");
+}
+
+int main(int argc, char **argv) {
+	job_t *jobs;
+	uint64_t t0;
+	uint32_t missed = 0;
+	int n_jobs = SDL_GetCPUCount(), op, dec, i;
+
+	for(i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--threads") && i + 1 < argc) {
+			n_jobs = (int)strtoul(argv[++i], NULL, 0);
+		} else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(n_jobs < 1)
+		n_jobs = 1;
+	if(n_jobs > MAX_THREADS)
+		n_jobs = MAX_THREADS;
+
+	if((jobs = malloc(n_jobs * sizeof(job_t))) == NULL) {
+		fprintf(stderr, "ERROR: Out of memory.\n");
+		return EXIT_FAILURE;
+	}
+	memset(jobs, 0, n_jobs * sizeof(job_t));
+
+	t0 = SDL_GetPerformanceCounter();
+
+	for(i = 0; i < n_jobs; i++) {
+		jobs[i].first = i;
+		jobs[i].step = n_jobs;
+		if((jobs[i].thread = SDL_CreateThread(worker_thread, "alu", &jobs[i])) == NULL)
+			worker_thread(&jobs[i]);
+	}
+
+	for(i = 0; i < n_jobs; i++) {
+		if(jobs[i].thread)
+			SDL_WaitThread(jobs[i].thread, NULL);
+	}
+
+	for(op = 0; op < N_OPS; op++) {
+		for(dec = 0; dec < 2; dec++)
+			missed += report(jobs, n_jobs, op, dec);
+	}
+
+	printf("%d threads, %.3f s\n", n_jobs, (double)(SDL_GetPerformanceCounter() - t0) / SDL_GetPerformanceFrequency());
+
+	free(jobs);
+
+#ifdef _DEBUG
+	mem_stats(stdout);
+#endif
+
+	return missed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
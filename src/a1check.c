@@ -0,0 +1,319 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Regression checks of the emulator that need no test image: each one
+ * sets up a machine with a few bytes of guest code at $0400, runs it and
+ * looks at what the VM and its tools saw. Without arguments all checks
+ * run, otherwise the named ones.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+#undef main
+
+#include "leakcheck.h"
+
+#include "covfile.h"
+#include "cpu_6502.h"
+#include "display.h"
+#include "input.h"
+#include "io_6820.h"
+#include "mem.h"
+#include "replay.h"
+#include "rewind.h"
+#include "status.h"
+#include "trace.h"
+#include "tracefile.h"
+#include "vm.h"
+#include "watch.h"
+
+#define CODE			0x0400
+#define MAX_CYCLES		100000
+#define TRACE_FILE		"a1check.tr"
+
+typedef struct check_t {
+	const char *name;
+	int (*proc)(vm_t*, const char**);	/* RET_OK or a failure reason */
+} check_t;
+
+static void put_code(vm_t *vm, const uint8_t *code, const size_t len) {
+	memcpy(vm->mem + CODE, code, len);
+	memcpy(vm->ram + CODE, code, len);
+	vm->cpu_def.set_pc(vm->cpu_state, CODE);
+}
+
+/* INC $10; JMP * with a write watchpoint on $10. */
+static int check_rmw_watch(vm_t *vm, const char **why) {
+	static const uint8_t code[] = { 0xe6, 0x10, 0x4c, 0x02, 0x04 };
+	int status;
+
+	put_code(vm, code, sizeof(code));
+	if(watch_add(vm, TRAP_WRITE, "0010") != RET_OK) {
+		*why = "couldn't set the watchpoint";
+		return RET_ERR_INVAL;
+	}
+
+	vm_run(vm, MAX_CYCLES, &status);
+
+	if(status != RET_BREAK) {
+		*why = "INC $10 didn't trip the write watchpoint";
+		return RET_ERR_INVAL;
+	}
+	if(vm->mem[0x10] != 1 || vm->ram[0x10] != 1) {
+		*why = "INC $10 didn't write 1";
+		return RET_ERR_INVAL;
+	}
+
+	return RET_OK;
+}
+
+/* INC $20 once: one fetch at $0400, one read and one write of $20. */
+static int check_rmw_heat(vm_t *vm, const char **why) {
+	static const uint8_t code[] = { 0xe6, 0x20, 0x4c, 0x02, 0x04 };
+	static uint16_t heat[3][65536];
+	int status;
+
+	memset(heat, 0, sizeof(heat));
+	vm->heat_read = heat[0];
+	vm->heat_write = heat[1];
+	vm->heat_fetch = heat[2];
+
+	put_code(vm, code, sizeof(code));
+	vm_step(vm, &status);
+
+	vm->heat_read = vm->heat_write = vm->heat_fetch = NULL;
+
+	if(heat[0][0x20] != 1 || heat[1][0x20] != 1) {
+		*why = "INC $20 wasn't counted as one read and one write";
+		return RET_ERR_INVAL;
+	}
+	if(heat[2][CODE] != 1) {
+		*why = "the fetch wasn't counted";
+		return RET_ERR_INVAL;
+	}
+
+	return RET_OK;
+}
+
+/* INC $30 marks $30 read and written. Printing the state afterwards
+ * must not mark the next opcode as read. */
+static int check_rmw_coverage(vm_t *vm, const char **why) {
+	static const uint8_t code[] = { 0xe6, 0x30, 0x4c, 0x02, 0x04 };
+	static uint8_t cov[3][COV_MAP_SIZE];
+	int status;
+
+	memset(cov, 0, sizeof(cov));
+	vm->cov_exec = cov[0];
+	vm->cov_read = cov[1];
+	vm->cov_write = cov[2];
+
+	put_code(vm, code, sizeof(code));
+	vm_step(vm, &status);
+	vm->cpu_def.print_state(vm->cpu_state, vm->step);
+
+	vm->cov_exec = vm->cov_read = vm->cov_write = NULL;
+
+	if(!COV_TEST(cov[1], 0x30) || !COV_TEST(cov[2], 0x30)) {
+		*why = "INC $30 wasn't marked read and written";
+		return RET_ERR_INVAL;
+	}
+	if(COV_TEST(cov[1], CODE + 2)) {
+		*why = "printing the state marked the opcode as read";
+		return RET_ERR_INVAL;
+	}
+
+	return RET_OK;
+}
+
+/* JSR $0405; INC $10 under the tracer: the first record has both pushes
+ * of the JSR, the second the write of the INC. */
+static int check_trace_writes(vm_t *vm, const char **why) {
+	static const uint8_t code[] = { 0x20, 0x05, 0x04, 0x00, 0x00, 0xe6, 0x10, 0x4c, 0x07, 0x04 };
+	trace_reader_t *tr;
+	trace_rec_t rec[2];
+	cpu_regs_t regs;
+	uint32_t stack;
+	int status, ret;
+
+	put_code(vm, code, sizeof(code));
+	vm->cpu_def.regs(vm->cpu_state, &regs);
+	stack = 0x100 | regs.sp;
+
+	if(trace_start(vm, TRACE_FILE) != RET_OK) {
+		*why = "couldn't start the trace";
+		return RET_ERR_IO;
+	}
+	vm_step(vm, &status);
+	vm_step(vm, &status);
+	ret = trace_stop(vm);
+
+	if(ret == RET_OK && (tr = trace_open(TRACE_FILE, &ret)) != NULL) {
+		if((ret = trace_read(tr, &rec[0])) == RET_OK)
+			ret = trace_read(tr, &rec[1]);
+		trace_close_reader(tr);
+	}
+	remove(TRACE_FILE);
+
+	if(ret != RET_OK) {
+		*why = "couldn't read the trace back";
+		return ret;
+	}
+	if(rec[0].n_writes != 2 || rec[0].write[0] != (stack << 8 | 0x04) || rec[0].write[1] != ((stack - 1) << 8 | 0x02)) {
+		*why = "the JSR record doesn't have both pushes";
+		return RET_ERR_INVAL;
+	}
+	if(rec[1].n_writes != 1 || rec[1].write[0] != (0x10 << 8 | 0x01)) {
+		*why = "the INC record doesn't have its write";
+		return RET_ERR_INVAL;
+	}
+
+	return RET_OK;
+}
+
+/* A guest that stores every key at $40,X is pasted a line, rewound to
+ * the middle of the paste and run on. It must end up with the line
+ * exactly once. */
+static int check_rewind_paste(vm_t *vm, const char **why) {
+	static const uint8_t code[] = {
+		0xa2, 0x00,				/* LDX #0 */
+		0xad, 0x11, 0xd0,		/* LDA KBD_CR */
+		0x10, 0xfb,				/* BPL *-3 */
+		0xad, 0x10, 0xd0,		/* LDA KBD_DATA */
+		0x95, 0x40,				/* STA $40,X */
+		0xe8,					/* INX */
+		0x4c, 0x02, 0x04		/* JMP $0402 */
+	};
+	static const char text[] = "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG";
+	const size_t len = sizeof(text) - 1;
+	cpu_regs_t regs;
+	size_t i;
+	int status, ret;
+
+	put_code(vm, code, sizeof(code));
+	if((ret = rewind_init(vm, REWIND_BUDGET, 100)) != RET_OK) {
+		*why = "couldn't set up the rewind buffer";
+		return ret;
+	}
+
+	ret = RET_ERR_INVAL;
+	if(pia_paste_text(text, len) != RET_OK) {
+		*why = "couldn't paste";
+		goto cleanrewind;
+	}
+
+	vm_run(vm, vm->cycle + len * 12, &status);
+	if(vm->mem[0x40 + len / 2] == 0 || vm->mem[0x40 + len - 1] != 0) {
+		*why = "the paste wasn't half way through";
+		goto cleanrewind;
+	}
+
+	if(rewind_to_cycle(vm, vm->cycle - len * 6) != RET_OK) {
+		*why = "couldn't rewind";
+		goto cleanrewind;
+	}
+	vm_run(vm, vm->cycle + len * 100, &status);
+
+	vm->cpu_def.regs(vm->cpu_state, &regs);
+	for(i = 0; i < len; i++) {
+		if(vm->mem[0x40 + i] != ((uint8_t)text[i] | 0x80))
+			break;
+	}
+
+	if(i < len || regs.x != len) {
+		*why = "the guest didn't get the pasted line exactly once";
+		goto cleanrewind;
+	}
+
+	ret = RET_OK;
+
+cleanrewind:
+	rewind_clean();
+	replay_clean();
+	return ret;
+}
+
+static const check_t checks[] = {
+	{ "rmw-watch", check_rmw_watch },
+	{ "rmw-heat", check_rmw_heat },
+	{ "rmw-coverage", check_rmw_coverage },
+	{ "trace-writes", check_trace_writes },
+	{ "rewind-paste", check_rewind_paste },
+	{ NULL, NULL }
+};
+
+static int selected(const char *name, const int argc, char **argv) {
+	int i;
+
+	if(argc < 2)
+		return 1;
+
+	for(i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], name))
+			return 1;
+	}
+
+	return 0;
+}
+
+/* RET_OK if the check passed. */
+static int run_check(const check_t *check) {
+	vm_t *vm;
+	const char *why = "";
+	int status, ret = RET_ERR_ALLOC;
+
+	if(input_init() != RET_OK)
+		goto fail;
+	if(mmio_init() != RET_OK)
+		goto cleaninput;
+	if((vm = vm_init(cpu_6502, display_null, &status)) == NULL)
+		goto cleanmmio;
+
+	vm->cpu_def.reset(vm->cpu_state);
+
+	if((ret = check->proc(vm, &why)) == RET_OK)
+		printf("PASS  %s\n", check->name);
+	else
+		printf("FAIL  %s: %s\n", check->name, why);
+
+	vm_clean(vm);
+cleanmmio:
+	mmio_clean();
+cleaninput:
+	input_clean();
+fail:
+	if(ret == RET_ERR_ALLOC)
+		fprintf(stderr, "ERROR: Initialization failed.\n");
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	int n_run = 0, failed = 0, i;
+
+	for(i = 0; checks[i].name; i++) {
+		if(!selected(checks[i].name, argc, argv))
+			continue;
+
+		n_run++;
+		if(run_check(&checks[i]) != RET_OK)
+			failed++;
+	}
+
+	if(n_run == 0) {
+		fprintf(stderr, "Usage: %s [check ...]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%d of %d checks passed.\n", n_run - failed, n_run);
+
+#ifdef _DEBUG
+	mem_stats(stdout);
+#endif
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
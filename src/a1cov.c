@@ -0,0 +1,421 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Works with coverage files written with --coverage:
+ *
+ *	merge	ORs several files into one, e.g. from the workers of a farm
+ *	lst		marks each line of an assembler listing with what its bytes saw
+ *	disasm	disassembles a memory image and marks the executed code
+ *
+ * Marks are "xrw", with '-' for each access that didn't happen. The
+ * exec bit of an address is only set for the opcode, so the disassembler
+ * uses them to find the instruction boundaries and decodes the rest
+ * linearly, as long as an instruction doesn't run into executed code.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leakcheck.h"
+
+#include "covfile.h"
+#include "cpu_6502_labels.h"
+#include "status.h"
+#include "symbols.h"
+
+#define LINE_MAX_LEN	1024
+#define MAX_OBJ_BYTES	256
+#define BYTES_PER_LINE	8
+
+typedef struct summary_t {
+	int instr, executed;
+} summary_t;
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s merge <out> <in> [<in> ...]\n", name);
+	fprintf(stderr, "       %s lst <coverage> <listing>\n", name);
+	fprintf(stderr, "       %s disasm <coverage> <image>@<addr> [--symbols <file> ...]\n", name);
+	fprintf(stderr, "Addresses are hexadecimal.\n");
+}
+
+static void mark(const coverage_t *cov, const uint16_t addr, const int len, char *out) {
+	int i, flags = 0;
+
+	for(i = 0; i < len; i++)
+		flags |= coverage_flags(cov, (uint16_t)(addr + i));
+
+	out[0] = (flags & COV_EXEC) ? 'x' : '-';
+	out[1] = (flags & COV_READ) ? 'r' : '-';
+	out[2] = (flags & COV_WRITE) ? 'w' : '-';
+	out[3] = '\0';
+}
+
+static void print_summary(const summary_t *sum) {
+	fprintf(stderr, "%d of %d instructions executed", sum->executed, sum->instr);
+	if(sum->instr)
+		fprintf(stderr, " (%.1f%%)", 100.0 * sum->executed / sum->instr);
+	fprintf(stderr, ".\n");
+}
+
+static int load_cov(coverage_t *cov, const char *filename) {
+	int ret;
+
+	coverage_clear(cov);
+	if((ret = coverage_load(cov, filename)) != RET_OK)
+		fprintf(stderr, "ERROR: Couldn't read the coverage %s.\n", filename);
+
+	return ret;
+}
+
+static int merge(int argc, char **argv) {
+	coverage_t *out, *in;
+	int i, ret = RET_ERR_ALLOC;
+
+	if((out = malloc(sizeof(coverage_t))) == NULL)
+		return RET_ERR_ALLOC;
+	if((in = malloc(sizeof(coverage_t))) == NULL)
+		goto freeout;
+
+	coverage_clear(out);
+	for(i = 1; i < argc; i++) {
+		if((ret = load_cov(in, argv[i])) != RET_OK)
+			goto freein;
+		coverage_merge(out, in);
+	}
+
+	if((ret = coverage_save(out, argv[0])) != RET_OK)
+		fprintf(stderr, "ERROR: Couldn't write the coverage %s.\n", argv[0]);
+
+freein:
+	free(in);
+freeout:
+	free(out);
+	return ret;
+}
+
+/* One of the mnemonics the labels start with */
+static int is_mnemonic(const char *word) {
+	int i;
+
+	if(strlen(word) != 3)
+		return 0;
+
+	for(i = 0; i < 256; i++) {
+		if(op_labels[i] && !strncmp(op_labels[i], word, 3))
+			return 1;
+	}
+
+	return 0;
+}
+
+static char *next_word(char **p) {
+	char *word;
+
+	while(**p == ' ' || **p == '\t')
+		(*p)++;
+	if(**p == '\0' || **p == '\r' || **p == '\n' || **p == ';')
+		return NULL;
+
+	word = *p;
+	while(**p && !isspace((unsigned char)**p))
+		(*p)++;
+	if(**p)
+		*(*p)++ = '\0';
+
+	return word;
+}
+
+static int is_hex(const char *s, const size_t len) {
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		if(!isxdigit((unsigned char)s[i]))
+			return 0;
+	}
+
+	return len > 0;
+}
+
+/* Address and number of object code bytes of a listing line, in the same
+ * formats symbols.c understands. Sets *instr if the line holds one. */
+static int parse_lst_line(char *line, uint16_t *addr, int *instr) {
+	char *p, *word, upper[4];
+	size_t len;
+	int bytes = 0, i, words = 0;
+
+	*instr = 0;
+	if(!is_hex(line, 4) || isalnum((unsigned char)line[4]) || line[4] == '_')
+		return 0;
+	*addr = (uint16_t)strtoul(line, NULL, 16);
+	p = line + 4;
+
+	while((word = next_word(&p)) != NULL) {
+		len = strlen(word);
+		if(!strcmp(word, ":"))
+			continue;
+		/* AS65 cuts long object code off with ".." */
+		if(len > 2 && !strcmp(word + len - 2, ".."))
+			len -= 2;
+		if(!is_hex(word, len) || len % 2)
+			break;
+		bytes += (int)len / 2;
+	}
+
+	/* Label, then instruction */
+	for(; word && words < 2; words++, word = next_word(&p)) {
+		if(strlen(word) != 3)
+			continue;
+		for(i = 0; i < 3; i++)
+			upper[i] = (char)toupper((unsigned char)word[i]);
+		upper[3] = '\0';
+		if(is_mnemonic(upper)) {
+			*instr = bytes > 0;
+			break;
+		}
+	}
+
+	return bytes > MAX_OBJ_BYTES ? MAX_OBJ_BYTES : bytes;
+}
+
+static int lst(const char *cov_file, const char *lst_file) {
+	coverage_t *cov;
+	FILE *fp;
+	char line[LINE_MAX_LEN], copy[LINE_MAX_LEN], marks[4];
+	summary_t sum = { 0, 0 };
+	uint16_t addr;
+	int bytes, instr, ret;
+
+	if((cov = malloc(sizeof(coverage_t))) == NULL)
+		return RET_ERR_ALLOC;
+	if((ret = load_cov(cov, cov_file)) != RET_OK)
+		goto freecov;
+
+	if((fp = fopen(lst_file, "r")) == NULL) {
+		fprintf(stderr, "ERROR: Couldn't open the listing %s.\n", lst_file);
+		ret = RET_ERR_OPEN;
+		goto freecov;
+	}
+
+	while(fgets(line, LINE_MAX_LEN, fp)) {
+		strcpy(copy, line);
+		if((bytes = parse_lst_line(copy, &addr, &instr)) == 0) {
+			printf("    %s", line);
+			continue;
+		}
+
+		mark(cov, addr, bytes, marks);
+		printf("%s %s", marks, line);
+
+		if(instr) {
+			sum.instr++;
+			if(COV_TEST(cov->exec, addr))
+				sum.executed++;
+		}
+	}
+
+	if(ferror(fp))
+		ret = RET_ERR_IO;
+	fclose(fp);
+
+	print_summary(&sum);
+
+freecov:
+	free(cov);
+	return ret;
+}
+
+static int instr_len(const uint8_t op) {
+	const char *label = op_labels[op];
+
+	if(strstr(label, "$xxxx"))
+		return 3;
+	if(strstr(label, "$xx") || (label[0] == 'B' && label[3] == '\0' && op != 0x00))
+		return 2;
+	return 1;
+}
+
+static void operand(const symbols_t *syms, const uint16_t val, const int digits, char *out) {
+	const char *name = symbols_exact(syms, val);
+
+	if(name)
+		strcpy(out, name);
+	else
+		sprintf(out, "$%0*x", digits, val);
+}
+
+/* Fills the label's operand template in. */
+static void format_instr(const symbols_t *syms, const uint8_t *mem, const uint16_t addr, char *out) {
+	const uint8_t op = mem[addr];
+	const char *label = op_labels[op], *field;
+	char arg[SYMBOL_MAX_LEN];
+	uint16_t val;
+
+	if(instr_len(op) == 2 && strstr(label, "$xx") == NULL) {
+		/* Branch */
+		val = (uint16_t)(addr + 2 + (int8_t)mem[(uint16_t)(addr + 1)]);
+		operand(syms, val, 4, arg);
+		sprintf(out, "%s %s", label, arg);
+		return;
+	}
+
+	if((field = strstr(label, "$xx")) == NULL) {
+		strcpy(out, label);
+		return;
+	}
+
+	if(instr_len(op) == 3) {
+		val = mem[(uint16_t)(addr + 1)] | (mem[(uint16_t)(addr + 2)] << 8);
+		operand(syms, val, 4, arg);
+	} else if(field > label && field[-1] == '#') {
+		sprintf(arg, "$%02x", mem[(uint16_t)(addr + 1)]);
+	} else {
+		operand(syms, mem[(uint16_t)(addr + 1)], 2, arg);
+	}
+
+	sprintf(out, "%.*s%s%s", (int)(field - label), label, arg, field + (instr_len(op) == 3 ? 5 : 3));
+}
+
+static void print_line(const symbols_t *syms, const coverage_t *cov, const uint8_t *mem, const uint16_t addr, const int len, const char *text) {
+	const char *name = symbols_exact(syms, addr);
+	char marks[4], hex[3 * BYTES_PER_LINE + 1];
+	int i;
+
+	mark(cov, addr, len, marks);
+	for(i = 0; i < len; i++)
+		sprintf(hex + 3 * i, "%02x ", mem[(uint16_t)(addr + i)]);
+
+	printf("%s %04x  %-9s %-12s%s\n", marks, addr, len <= 3 ? hex : "", name ? name : "", text);
+}
+
+/* An instruction at addr that doesn't overlap executed code. */
+static int decodable(const coverage_t *cov, const uint8_t *mem, const uint32_t addr, const uint32_t end) {
+	uint32_t i;
+	int len;
+
+	if(COV_TEST(cov->exec, addr))
+		return 1;
+	if(op_labels[mem[addr]] == NULL)
+		return 0;
+
+	len = instr_len(mem[addr]);
+	if(addr + len > end)
+		return 0;
+	for(i = addr + 1; i < addr + len; i++) {
+		if(COV_TEST(cov->exec, i))
+			return 0;
+	}
+
+	return 1;
+}
+
+static void disassemble(const symbols_t *syms, const coverage_t *cov, const uint8_t *mem, const uint32_t start, const uint32_t end) {
+	char text[LINE_MAX_LEN];
+	summary_t sum = { 0, 0 };
+	uint32_t addr = start;
+	int len, i;
+
+	while(addr < end) {
+		if(decodable(cov, mem, addr, end)) {
+			len = instr_len(mem[addr]);
+			format_instr(syms, mem, (uint16_t)addr, text);
+			sum.instr++;
+			if(COV_TEST(cov->exec, addr))
+				sum.executed++;
+		} else {
+			/* Data up to the next instruction or symbol */
+			for(len = 1; len < BYTES_PER_LINE && addr + len < end; len++) {
+				if(symbols_exact(syms, (uint16_t)(addr + len)) || decodable(cov, mem, addr + len, end))
+					break;
+			}
+			strcpy(text, ".byte ");
+			for(i = 0; i < len; i++)
+				sprintf(text + strlen(text), "%s$%02x", i ? "," : "", mem[addr + i]);
+			len = -len;
+		}
+
+		print_line(syms, cov, mem, (uint16_t)addr, len < 0 ? -len : len, text);
+		addr += len < 0 ? -len : len;
+	}
+
+	print_summary(&sum);
+}
+
+static int disasm(int argc, char **argv) {
+	coverage_t *cov;
+	symbols_t *syms;
+	uint8_t *mem;
+	FILE *fp;
+	char *at;
+	uint32_t start;
+	size_t size;
+	int i, ret = RET_ERR_ALLOC;
+
+	if((at = strrchr(argv[1], '@')) == NULL) {
+		fprintf(stderr, "ERROR: The image needs a load address.\n");
+		return RET_ERR_INVAL;
+	}
+	*at++ = '\0';
+	start = strtoul(at, NULL, 16) & 0xffff;
+
+	if((cov = malloc(sizeof(coverage_t))) == NULL)
+		return RET_ERR_ALLOC;
+	if((syms = symbols_init()) == NULL)
+		goto freecov;
+	if((mem = malloc(0x10000)) == NULL)
+		goto freesyms;
+	memset(mem, 0, 0x10000);
+
+	if((ret = load_cov(cov, argv[0])) != RET_OK)
+		goto freemem;
+
+	for(i = 2; i < argc; i++) {
+		if(strcmp(argv[i], "--symbols") || i + 1 == argc) {
+			ret = RET_ERR_INVAL;
+			goto freemem;
+		}
+		if((ret = symbols_load(syms, argv[++i])) != RET_OK) {
+			fprintf(stderr, "ERROR: Couldn't read the symbols %s.\n", argv[i]);
+			goto freemem;
+		}
+	}
+
+	if((fp = fopen(argv[1], "rb")) == NULL) {
+		fprintf(stderr, "ERROR: Couldn't open the image %s.\n", argv[1]);
+		ret = RET_ERR_OPEN;
+		goto freemem;
+	}
+	size = fread(mem + start, 1, 0x10000 - start, fp);
+	fclose(fp);
+
+	disassemble(syms, cov, mem, start, start + (uint32_t)size);
+	ret = RET_OK;
+
+freemem:
+	free(mem);
+freesyms:
+	symbols_free(syms);
+freecov:
+	free(cov);
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	int ret = RET_ERR_INVAL;
+
+	if(argc >= 4 && !strcmp(argv[1], "merge"))
+		ret = merge(argc - 2, argv + 2);
+	else if(argc == 4 && !strcmp(argv[1], "lst"))
+		ret = lst(argv[2], argv[3]);
+	else if(argc >= 4 && !strcmp(argv[1], "disasm"))
+		ret = disasm(argc - 2, argv + 2);
+
+	if(ret == RET_ERR_INVAL)
+		usage(argv[0]);
+
+	return ret == RET_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
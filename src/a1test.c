@@ -0,0 +1,345 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Runs Klaus Dormann's 6502 test suites without a window. Every test
+ * ends in a trap, a jump or branch to itself, so a suite stops when the
+ * PC stops moving; it passed if that happens at the success trap. The
+ * success trap and the test_case variable are taken from the AS65
+ * listing next to the image, and a failure is reported with the test
+ * number and the listing line of the trap. The speed report makes this
+ * a performance gate as well.
+ *
+ * The interrupt test's feedback register is mapped at the I_port of the
+ * listing. Other suites run without it, it would see every access.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+#undef main
+
+#include "leakcheck.h"
+
+#include "cpu_6502.h"
+#include "display.h"
+#include "input.h"
+#include "io_feedback.h"
+#include "loader.h"
+#include "mem.h"
+#include "status.h"
+#include "symbols.h"
+#include "vm.h"
+#include "watch.h"
+
+#ifdef _MSC_VER
+#define strtoull	_strtoui64
+#endif
+
+#define MAX_SUITES		16
+#define LINE_MAX_LEN	1024
+#define SLICE_CYCLES	1000000
+#define DEFAULT_START	0x0400
+#define DEFAULT_TIMEOUT	1000000000
+#define NO_ADDR			0xffffffff
+
+typedef struct suite_t {
+	const char *image, *lst;
+	uint32_t start, success, feedback;
+	uint64_t timeout;
+} suite_t;
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [options] <image>[@addr] [[options] <image>[@addr] ...]\n", name);
+	fprintf(stderr, "Images are raw, loaded at addr (default 0000).\n");
+	fprintf(stderr, "  --start <addr>     Start the following suites at addr (default %04x).\n", DEFAULT_START);
+	fprintf(stderr, "  --timeout <n>      Fail the following suites after n cycles (default %d).\n", DEFAULT_TIMEOUT);
+	fprintf(stderr, "  --feedback <addr>  Map the next suite's interrupt feedback register at\n");
+	fprintf(stderr, "                     addr instead of the I_port in the listing.\n");
+	fprintf(stderr, "  --lst <file>       The next suite's listing (default: the image's .lst).\n");
+	fprintf(stderr, "  --success <addr>   The next suite passes at addr instead of the success\n");
+	fprintf(stderr, "                     trap in the listing.\n");
+}
+
+static int is_addr_line(const char *line) {
+	int i;
+
+	for(i = 0; i < 4; i++) {
+		if(!isxdigit((unsigned char)line[i]))
+			return 0;
+	}
+
+	return !strncmp(line + 4, " :", 2);
+}
+
+/* The image name with .lst for its extension. */
+static char *lst_name(const char *image) {
+	const char *at = strrchr(image, '@'), *dot, *slash;
+	size_t len = at ? (size_t)(at - image) : strlen(image);
+	char *out;
+
+	if((out = malloc(len + 5)) == NULL)
+		return NULL;
+
+	memcpy(out, image, len);
+	out[len] = '\0';
+
+	dot = strrchr(out, '.');
+	slash = strrchr(out, '/');
+	if(slash == NULL)
+		slash = strrchr(out, '\\');
+	if(dot && (slash == NULL || dot > slash))
+		out[dot - out] = '\0';
+
+	strcat(out, ".lst");
+	return out;
+}
+
+/* The value of "name = ..." in the listing. */
+static uint32_t find_equate(const char *lst, const char *name) {
+	FILE *fp;
+	char line[LINE_MAX_LEN], w1[64];
+	uint32_t ret = NO_ADDR;
+
+	if((fp = fopen(lst, "r")) == NULL)
+		return NO_ADDR;
+
+	while(fgets(line, LINE_MAX_LEN, fp)) {
+		if(isxdigit((unsigned char)line[0]) && !strncmp(line + 4, " =", 2) &&
+		   sscanf(line + 6, "%63s", w1) == 1 && !strcmp(w1, name)) {
+			ret = strtoul(line, NULL, 16);
+			break;
+		}
+	}
+
+	fclose(fp);
+	return ret;
+}
+
+/* The address of the line after the "success" macro call. */
+static uint32_t find_success(const char *lst) {
+	FILE *fp;
+	char line[LINE_MAX_LEN], w1[64], w2[64];
+	uint32_t ret = NO_ADDR;
+	int found = 0, n;
+
+	if((fp = fopen(lst, "r")) == NULL)
+		return NO_ADDR;
+
+	while(fgets(line, LINE_MAX_LEN, fp)) {
+		if(is_addr_line(line)) {
+			if(found) {
+				ret = strtoul(line, NULL, 16);
+				break;
+			}
+			continue;
+		}
+
+		if((n = sscanf(line, "%63s %63s", w1, w2)) >= 1 && !strcmp(w1, "success") && (n == 1 || strcmp(w2, "macro")))
+			found = 1;
+	}
+
+	fclose(fp);
+	return ret;
+}
+
+static void print_lst_line(const char *lst, const uint16_t pc) {
+	FILE *fp;
+	char line[LINE_MAX_LEN];
+
+	if((fp = fopen(lst, "r")) == NULL)
+		return;
+
+	while(fgets(line, LINE_MAX_LEN, fp)) {
+		if(is_addr_line(line) && strtoul(line, NULL, 16) == pc) {
+			line[strcspn(line, "\r\n")] = '\0';
+			printf("      %s\n", line);
+			break;
+		}
+	}
+
+	fclose(fp);
+}
+
+static int load_image(vm_t *vm, const char *image) {
+	uint32_t start = LOAD_NO_START;
+	char *spec;
+	int ret;
+
+	if(strrchr(image, '@'))
+		return load_program(vm, image, &start);
+
+	if((spec = malloc(strlen(image) + 3)) == NULL)
+		return RET_ERR_ALLOC;
+
+	sprintf(spec, "%s@0", image);
+	ret = load_program(vm, spec, &start);
+	free(spec);
+
+	return ret;
+}
+
+static void print_speed(const vm_t *vm, const double secs) {
+	printf("      %llu instructions, %llu cycles in %.2f s", (unsigned long long)vm->step, (unsigned long long)vm->cycle, secs);
+	if(secs > 0)
+		printf(", %.2f M instructions/s (%.1f MHz)", vm->step / secs / 1e6, vm->cycle / secs / 1e6);
+	printf("\n");
+}
+
+/* RET_OK if the suite passed. */
+static int run_suite(const suite_t *suite) {
+	vm_t *vm;
+	symbols_t *syms;
+	char *lst = NULL, bp[16];
+	uint64_t t0;
+	uint32_t success, feedback;
+	uint16_t pc, test_case;
+	uint8_t op;
+	double secs;
+	int status, ret = RET_ERR_ALLOC;
+
+	if(input_init() != RET_OK)
+		goto fail;
+	if(mmio_init() != RET_OK)
+		goto cleaninput;
+	if((vm = vm_init(cpu_6502, display_null, &status)) == NULL)
+		goto cleanmmio;
+	if((syms = symbols_init()) == NULL)
+		goto cleanvm;
+	if(suite->lst == NULL && (lst = lst_name(suite->image)) == NULL)
+		goto freesyms;
+
+	if((ret = load_image(vm, suite->image)) != RET_OK) {
+		printf("FAIL  %s: couldn't load the image\n", suite->image);
+		goto freelst;
+	}
+
+	if(symbols_load(syms, suite->lst ? suite->lst : lst) != RET_OK)
+		fprintf(stderr, "WARNING: Couldn't read the listing %s.\n", suite->lst ? suite->lst : lst);
+
+	success = suite->success;
+	if(success == NO_ADDR) {
+		success = find_success(suite->lst ? suite->lst : lst);
+	} else {
+		/* Success code that isn't a trap */
+		sprintf(bp, "%04x", success);
+		watch_add(vm, TRAP_EXEC, bp);
+	}
+
+	feedback = suite->feedback;
+	if(feedback == NO_ADDR)
+		feedback = find_equate(suite->lst ? suite->lst : lst, "I_port");
+	if(feedback != NO_ADDR && (ret = feedback_init(vm, (uint16_t)feedback)) != RET_OK)
+		goto freelst;
+
+	vm->cpu_def.reset(vm->cpu_state);
+	vm->cpu_def.set_pc(vm->cpu_state, (uint16_t)suite->start);
+
+	t0 = SDL_GetPerformanceCounter();
+	do {
+		vm_run(vm, (suite->timeout - vm->cycle > SLICE_CYCLES) ? vm->cycle + SLICE_CYCLES : suite->timeout, &status);
+	} while(status == RET_OK && vm->cycle < suite->timeout);
+	secs = (double)(SDL_GetPerformanceCounter() - t0) / SDL_GetPerformanceFrequency();
+
+	pc = vm->cpu_def.get_pc(vm->cpu_state);
+	op = vm->mem[pc];
+	ret = RET_ERR_INVAL;
+
+	if(status == RET_OK) {
+		printf("FAIL  %s: no trap after %llu cycles, PC $%04x\n", suite->image, (unsigned long long)vm->cycle, pc);
+	} else if(status == RET_BREAK && pc != success) {
+		printf("FAIL  %s: diagnostic stop at $%04x\n", suite->image, pc);
+	} else if(pc == success) {
+		printf("PASS  %s at $%04x\n", suite->image, pc);
+		ret = RET_OK;
+	} else {
+		/* Anything but JMP or a branch is an opcode the CPU doesn't know */
+		printf("FAIL  %s: %s at $%04x", suite->image, (op == 0x4c || (op & 0x1f) == 0x10) ? "trap" : "stuck", pc);
+		if(symbols_lookup(syms, "test_case", &test_case) == RET_OK)
+			printf(", test $%02x", vm->mem[test_case]);
+		if(success == NO_ADDR)
+			printf(", no success trap in the listing");
+		printf("\n");
+		print_lst_line(suite->lst ? suite->lst : lst, pc);
+	}
+
+	print_speed(vm, secs);
+	feedback_clean();
+
+freelst:
+	if(lst)
+		free(lst);
+freesyms:
+	symbols_free(syms);
+cleanvm:
+	vm_clean(vm);
+cleanmmio:
+	mmio_clean();
+cleaninput:
+	input_clean();
+fail:
+	if(ret == RET_ERR_ALLOC)
+		fprintf(stderr, "ERROR: Initialization failed.\n");
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	suite_t suite[MAX_SUITES], next;
+	uint16_t addr;
+	int n_suites = 0, failed = 0, i;
+
+	next.lst = NULL;
+	next.start = DEFAULT_START;
+	next.success = NO_ADDR;
+	next.timeout = DEFAULT_TIMEOUT;
+	next.feedback = NO_ADDR;
+
+	for(i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--start") && i + 1 < argc && parse_address(argv[i + 1], &addr) == RET_OK) {
+			next.start = addr;
+			i++;
+		} else if(!strcmp(argv[i], "--success") && i + 1 < argc && parse_address(argv[i + 1], &addr) == RET_OK) {
+			next.success = addr;
+			i++;
+		} else if(!strcmp(argv[i], "--feedback") && i + 1 < argc && parse_address(argv[i + 1], &addr) == RET_OK) {
+			next.feedback = addr;
+			i++;
+		} else if(!strcmp(argv[i], "--lst") && i + 1 < argc) {
+			next.lst = argv[++i];
+		} else if(!strcmp(argv[i], "--timeout") && i + 1 < argc) {
+			next.timeout = strtoull(argv[++i], NULL, 0);
+		} else if(argv[i][0] != '-' && n_suites < MAX_SUITES) {
+			next.image = argv[i];
+			suite[n_suites++] = next;
+			next.lst = NULL;
+			next.success = NO_ADDR;
+			next.feedback = NO_ADDR;
+		} else {
+			n_suites = 0;
+			break;
+		}
+	}
+
+	if(n_suites == 0) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	for(i = 0; i < n_suites; i++) {
+		if(run_suite(&suite[i]) != RET_OK)
+			failed++;
+	}
+
+	printf("%d of %d suites passed.\n", n_suites - failed, n_suites);
+
+#ifdef _DEBUG
+	mem_stats(stdout);
+#endif
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
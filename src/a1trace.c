@@ -0,0 +1,79 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Prints an execution trace written with --trace in the format of the
+ * emulator's per-step CPU state output. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leakcheck.h"
+
+#include "status.h"
+#include "tracefile.h"
+
+#ifdef _MSC_VER
+#define strtoull	_strtoui64
+#endif
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [options] <trace>\n", name);
+	fprintf(stderr, "  -w           Show the memory writes of each step.\n");
+	fprintf(stderr, "  -c           Show the cycle count.\n");
+	fprintf(stderr, "  --from <n>   Start at step n.\n");
+	fprintf(stderr, "  --to <n>     Stop after step n.\n");
+}
+
+int main(int argc, char **argv) {
+	trace_reader_t *tr;
+	trace_rec_t rec;
+	const char *filename = NULL;
+	uint64_t from = 0, to = UINT64_MAX;
+	int show = 0, ret, i;
+
+	for(i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-w")) {
+			show |= TRACE_SHOW_WRITES;
+		} else if(!strcmp(argv[i], "-c")) {
+			show |= TRACE_SHOW_CYCLES;
+		} else if(!strcmp(argv[i], "--from") && i + 1 < argc) {
+			from = strtoull(argv[++i], NULL, 0);
+		} else if(!strcmp(argv[i], "--to") && i + 1 < argc) {
+			to = strtoull(argv[++i], NULL, 0);
+		} else if(filename == NULL && argv[i][0] != '-') {
+			filename = argv[i];
+		} else {
+			filename = NULL;
+			break;
+		}
+	}
+
+	if(filename == NULL) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if((tr = trace_open(filename, &ret)) == NULL) {
+		fprintf(stderr, "ERROR: Couldn't open the trace %s.\n", filename);
+		return EXIT_FAILURE;
+	}
+
+	while((ret = trace_read(tr, &rec)) == RET_OK) {
+		if(rec.step < from || rec.step > to)
+			continue;
+		trace_print(stdout, &rec, show);
+	}
+
+	trace_close_reader(tr);
+
+	if(ret != RET_EOF) {
+		fprintf(stderr, "ERROR: The trace is cut off.\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
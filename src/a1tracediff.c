@@ -0,0 +1,565 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Compares two execution traces and reports the first instruction where
+ * they differ. Each trace is either a binary trace written with --trace or
+ * a text log in the per-step state format, e.g. from another emulator.
+ * With -w the memory writes count as well: every write since the record
+ * before, in order, so all three pushes of a BRK are compared.
+ *
+ * The traces are read in fixed-size blocks through a bounded queue per
+ * input, so memory use doesn't depend on the length of the traces. Text
+ * blocks are cut at line ends by a reader thread and parsed by a pool of
+ * workers, which is where the time goes for long logs; binary traces are
+ * decoded by their reader thread. The main thread walks both record
+ * streams in order and compares them.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+#undef main
+
+#include "leakcheck.h"
+
+#include "status.h"
+#include "tracefile.h"
+
+#ifdef _MSC_VER
+#define strtoull	_strtoui64
+#endif
+
+#define BLOCK_BYTES		(1 << 20)
+#define BLOCK_RECS		(BLOCK_BYTES / 32)	/* A state line is longer than 32 chars */
+#define MAX_WORKERS		16
+#define MAX_CONTEXT		1000
+#define DEFAULT_CONTEXT	5
+
+#define BLK_FREE		0
+#define BLK_RAW			1		/* Text waiting for a worker */
+#define BLK_PARSING		2
+#define BLK_READY		3
+
+#define CMP_STEP		0x01
+#define CMP_CYCLES		0x02
+#define CMP_WRITES		0x04
+
+typedef struct block_t {
+	int state;
+	int last, error;
+	char *text;
+	size_t len;
+	trace_rec_t *recs;
+	size_t n;
+} block_t;
+
+typedef struct source_t {
+	const char *filename;
+	trace_reader_t *tr;		/* Binary trace */
+	FILE *fp;				/* Text log */
+	char *carry;			/* Unfinished line from the previous block */
+	size_t carry_len;
+
+	block_t *blocks;
+	unsigned int produced, consumed;
+
+	block_t *cur;
+	size_t pos;
+	uint64_t count;
+
+	SDL_Thread *reader;
+	struct diff_t *diff;
+} source_t;
+
+typedef struct diff_t {
+	source_t src[2];
+	int depth;
+
+	SDL_mutex *lock;
+	SDL_cond *cond;
+	int quit;
+
+	SDL_Thread *workers[MAX_WORKERS];
+	int nworkers;
+} diff_t;
+
+typedef struct options_t {
+	int compare, show, context, workers;
+	uint8_t flag_mask;
+	uint64_t skip[2];
+} options_t;
+
+/* Threads */
+
+static void fill_binary(source_t *s, block_t *blk) {
+	int ret = RET_OK;
+
+	blk->n = 0;
+	while(blk->n < BLOCK_RECS && (ret = trace_read(s->tr, &blk->recs[blk->n])) == RET_OK)
+		blk->n++;
+
+	if(ret != RET_OK) {
+		blk->last = 1;
+		blk->error = (ret != RET_EOF);
+	}
+}
+
+/* Fills the block with whole lines and keeps the rest for the next one. */
+static void fill_text(source_t *s, block_t *blk) {
+	size_t want = BLOCK_BYTES - s->carry_len, got, end;
+
+	memcpy(blk->text, s->carry, s->carry_len);
+	got = fread(blk->text + s->carry_len, 1, want, s->fp);
+	blk->len = s->carry_len + got;
+	s->carry_len = 0;
+
+	if(got < want) {
+		blk->last = 1;
+		blk->error = ferror(s->fp) ? 1 : 0;
+	} else {
+		for(end = blk->len; end > 0 && blk->text[end - 1] != '\n'; end--);
+		if(end == 0) {
+			blk->last = blk->error = 1;
+		} else {
+			s->carry_len = blk->len - end;
+			memcpy(s->carry, blk->text + end, s->carry_len);
+			blk->len = end;
+		}
+	}
+
+	blk->text[blk->len] = '\0';
+}
+
+static int reader_thread(void *data) {
+	source_t *s = data;
+	diff_t *d = s->diff;
+	block_t *blk;
+
+	for(;;) {
+		SDL_LockMutex(d->lock);
+		blk = &s->blocks[s->produced % d->depth];
+		while(blk->state != BLK_FREE && !d->quit)
+			SDL_CondWait(d->cond, d->lock);
+		if(d->quit) {
+			SDL_UnlockMutex(d->lock);
+			break;
+		}
+		SDL_UnlockMutex(d->lock);
+
+		blk->last = blk->error = 0;
+		blk->n = 0;
+		if(s->tr)
+			fill_binary(s, blk);
+		else
+			fill_text(s, blk);
+
+		SDL_LockMutex(d->lock);
+		blk->state = s->tr ? BLK_READY : BLK_RAW;
+		s->produced++;
+		SDL_CondBroadcast(d->cond);
+		SDL_UnlockMutex(d->lock);
+
+		if(blk->last)
+			break;
+	}
+
+	return 0;
+}
+
+static void parse_block(block_t *blk) {
+	char *line = blk->text, *nl;
+
+	blk->n = 0;
+	while(*line) {
+		if((nl = strchr(line, '\n')) != NULL)
+			*nl = '\0';
+
+		if(trace_parse_line(line, &blk->recs[blk->n]) && ++blk->n == BLOCK_RECS) {
+			blk->error = 1;
+			break;
+		}
+
+		if(nl == NULL)
+			break;
+		line = nl + 1;
+	}
+}
+
+static block_t *find_raw(diff_t *d) {
+	int i, j;
+
+	for(i = 0; i < 2; i++) {
+		for(j = 0; j < d->depth; j++) {
+			if(d->src[i].blocks[j].state == BLK_RAW)
+				return &d->src[i].blocks[j];
+		}
+	}
+
+	return NULL;
+}
+
+static int worker_thread(void *data) {
+	diff_t *d = data;
+	block_t *blk;
+
+	SDL_LockMutex(d->lock);
+	for(;;) {
+		while((blk = find_raw(d)) == NULL && !d->quit)
+			SDL_CondWait(d->cond, d->lock);
+		if(blk == NULL)
+			break;
+
+		blk->state = BLK_PARSING;
+		SDL_UnlockMutex(d->lock);
+
+		parse_block(blk);
+
+		SDL_LockMutex(d->lock);
+		blk->state = BLK_READY;
+		SDL_CondBroadcast(d->cond);
+	}
+	SDL_UnlockMutex(d->lock);
+
+	return 0;
+}
+
+/* Record streams */
+
+/* RET_OK with the next record, RET_EOF at the end or RET_ERR_FORMAT. */
+static int next_rec(diff_t *d, source_t *s, trace_rec_t **rec) {
+	while(s->cur == NULL || s->pos == s->cur->n) {
+		SDL_LockMutex(d->lock);
+		if(s->cur) {
+			if(s->cur->error || s->cur->last) {
+				SDL_UnlockMutex(d->lock);
+				return s->cur->error ? RET_ERR_FORMAT : RET_EOF;
+			}
+			s->cur->state = BLK_FREE;
+			s->consumed++;
+			SDL_CondBroadcast(d->cond);
+		}
+
+		s->cur = &s->blocks[s->consumed % d->depth];
+		while(s->cur->state != BLK_READY)
+			SDL_CondWait(d->cond, d->lock);
+		SDL_UnlockMutex(d->lock);
+
+		s->pos = 0;
+	}
+
+	*rec = &s->cur->recs[s->pos++];
+	s->count++;
+	return RET_OK;
+}
+
+static int source_open(diff_t *d, source_t *s, const char *filename) {
+	int ret, i;
+
+	s->diff = d;
+	s->filename = filename;
+
+	if((s->blocks = malloc(d->depth * sizeof(block_t))) == NULL)
+		return RET_ERR_ALLOC;
+	for(i = 0; i < d->depth; i++) {
+		s->blocks[i].state = BLK_FREE;
+		s->blocks[i].text = NULL;
+		s->blocks[i].recs = NULL;
+	}
+
+	for(i = 0; i < d->depth; i++) {
+		if((s->blocks[i].recs = malloc(BLOCK_RECS * sizeof(trace_rec_t))) == NULL)
+			return RET_ERR_ALLOC;
+	}
+
+	if((s->tr = trace_open(filename, &ret)) != NULL)
+		return RET_OK;
+	if(ret != RET_ERR_FORMAT)
+		return ret;
+
+	if((s->fp = fopen(filename, "rb")) == NULL)
+		return RET_ERR_OPEN;
+	if((s->carry = malloc(BLOCK_BYTES)) == NULL)
+		return RET_ERR_ALLOC;
+	for(i = 0; i < d->depth; i++) {
+		if((s->blocks[i].text = malloc(BLOCK_BYTES + 1)) == NULL)
+			return RET_ERR_ALLOC;
+	}
+
+	return RET_OK;
+}
+
+static void source_close(source_t *s) {
+	int i;
+
+	if(s->blocks) {
+		for(i = 0; i < s->diff->depth; i++) {
+			free(s->blocks[i].text);
+			free(s->blocks[i].recs);
+		}
+		free(s->blocks);
+	}
+
+	free(s->carry);
+	if(s->fp)
+		fclose(s->fp);
+	if(s->tr)
+		trace_close_reader(s->tr);
+}
+
+static int diff_start(diff_t *d, const char *a, const char *b, const options_t *opt) {
+	int ret, i;
+
+	memset(d, 0, sizeof(diff_t));
+	d->nworkers = opt->workers;
+	d->depth = d->nworkers + 2;
+
+	if((d->lock = SDL_CreateMutex()) == NULL) return RET_ERR_SDL;
+	if((d->cond = SDL_CreateCond()) == NULL) return RET_ERR_SDL;
+
+	if((ret = source_open(d, &d->src[0], a)) != RET_OK) return ret;
+	if((ret = source_open(d, &d->src[1], b)) != RET_OK) return ret;
+
+	for(i = 0; i < 2; i++) {
+		if((d->src[i].reader = SDL_CreateThread(reader_thread, "reader", &d->src[i])) == NULL)
+			return RET_ERR_SDL;
+	}
+
+	for(i = 0; i < d->nworkers; i++) {
+		if((d->workers[i] = SDL_CreateThread(worker_thread, "parser", d)) == NULL)
+			return RET_ERR_SDL;
+	}
+
+	return RET_OK;
+}
+
+static void diff_stop(diff_t *d) {
+	int i;
+
+	if(d->lock) {
+		SDL_LockMutex(d->lock);
+		d->quit = 1;
+		SDL_CondBroadcast(d->cond);
+		SDL_UnlockMutex(d->lock);
+	}
+
+	for(i = 0; i < d->nworkers; i++)
+		SDL_WaitThread(d->workers[i], NULL);
+	for(i = 0; i < 2; i++)
+		SDL_WaitThread(d->src[i].reader, NULL);
+
+	for(i = 0; i < 2; i++) {
+		if(d->src[i].diff)
+			source_close(&d->src[i]);
+	}
+
+	SDL_DestroyCond(d->cond);
+	SDL_DestroyMutex(d->lock);
+}
+
+/* Comparison */
+
+static int writes_differ(const trace_rec_t *a, const trace_rec_t *b) {
+	int i;
+
+	if(a->n_writes != b->n_writes)
+		return 1;
+
+	for(i = 0; i < a->n_writes; i++) {
+		if(a->write[i] != b->write[i])
+			return 1;
+	}
+
+	return 0;
+}
+
+static int differs(const trace_rec_t *a, const trace_rec_t *b, const options_t *opt, char *fields) {
+	fields[0] = '\0';
+
+	if((opt->compare & CMP_STEP) && a->step != b->step) strcat(fields, " ST");
+	if(a->pc != b->pc) strcat(fields, " PC");
+	if(a->op != b->op) strcat(fields, " I");
+	if(a->a != b->a) strcat(fields, " A");
+	if(a->x != b->x) strcat(fields, " X");
+	if(a->y != b->y) strcat(fields, " Y");
+	if(a->sp != b->sp) strcat(fields, " SP");
+	if((a->flags ^ b->flags) & opt->flag_mask) strcat(fields, " P");
+	if((opt->compare & CMP_CYCLES) && a->cycle != b->cycle) strcat(fields, " CY");
+	if((opt->compare & CMP_WRITES) && writes_differ(a, b)) strcat(fields, " W");
+
+	return fields[0] != '\0';
+}
+
+static void print_following(diff_t *d, source_t *s, const char *prefix, const options_t *opt) {
+	trace_rec_t *rec;
+	int i;
+
+	for(i = 0; i < opt->context && next_rec(d, s, &rec) == RET_OK; i++) {
+		printf("%s", prefix);
+		trace_print(stdout, rec, opt->show);
+	}
+}
+
+static int report_end(source_t *s, const int ret) {
+	if(ret == RET_ERR_FORMAT)
+		fprintf(stderr, "ERROR: %s is cut off or has an overlong line.\n", s->filename);
+	return ret;
+}
+
+/* RET_OK if the traces match, RET_LOOP at a divergence. */
+static int compare(diff_t *d, const options_t *opt, trace_rec_t *history) {
+	source_t *a = &d->src[0], *b = &d->src[1];
+	trace_rec_t *ra, *rb;
+	uint64_t i, matched = 0;
+	char fields[40];
+	int ret_a, ret_b, nhist;
+
+	for(i = 0; i < opt->skip[0] && (ret_a = next_rec(d, a, &ra)) == RET_OK; i++);
+	for(i = 0; i < opt->skip[1] && (ret_b = next_rec(d, b, &rb)) == RET_OK; i++);
+
+	for(;;) {
+		ret_a = next_rec(d, a, &ra);
+		ret_b = next_rec(d, b, &rb);
+
+		if(ret_a == RET_ERR_FORMAT) return report_end(a, ret_a);
+		if(ret_b == RET_ERR_FORMAT) return report_end(b, ret_b);
+
+		if(ret_a != RET_OK || ret_b != RET_OK)
+			break;
+
+		if(differs(ra, rb, opt, fields))
+			break;
+
+		if(opt->context)
+			history[matched % opt->context] = *ra;
+		matched++;
+	}
+
+	if(ret_a == RET_EOF && ret_b == RET_EOF) {
+		printf("No difference in %llu instructions.\n", (unsigned long long)matched);
+		return RET_OK;
+	}
+
+	if(ret_a != RET_OK || ret_b != RET_OK) {
+		printf("%s ends after %llu matching instructions.\n",
+			(ret_a == RET_EOF) ? a->filename : b->filename, (unsigned long long)matched);
+	} else {
+		printf("First difference after %llu matching instructions, at record %llu of %s and %llu of %s:%s\n",
+			(unsigned long long)matched,
+			(unsigned long long)a->count, a->filename,
+			(unsigned long long)b->count, b->filename, fields);
+	}
+
+	nhist = (matched < (uint64_t)opt->context) ? (int)matched : opt->context;
+	for(i = matched - nhist; i < matched; i++) {
+		printf("  ");
+		trace_print(stdout, &history[i % opt->context], opt->show);
+	}
+
+	if(ret_a == RET_OK) {
+		printf("- ");
+		trace_print(stdout, ra, opt->show);
+		print_following(d, a, "- ", opt);
+	}
+
+	if(ret_b == RET_OK) {
+		printf("+ ");
+		trace_print(stdout, rb, opt->show);
+		print_following(d, b, "+ ", opt);
+	}
+
+	return RET_LOOP;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [options] <trace> <reference>\n", name);
+	fprintf(stderr, "Either trace can be a binary trace or a text log.\n");
+	fprintf(stderr, "  -C <n>             Show n instructions around the difference (%d).\n", DEFAULT_CONTEXT);
+	fprintf(stderr, "  -j <n>             Parse text logs on n threads.\n");
+	fprintf(stderr, "  -c                 Compare cycle counts.\n");
+	fprintf(stderr, "  -w                 Compare memory writes, all of them in order.\n");
+	fprintf(stderr, "  --steps            Compare step numbers.\n");
+	fprintf(stderr, "  --flags-mask <m>   Only compare these status flags, e.g. 0xcf.\n");
+	fprintf(stderr, "  --skip <n>,<m>     Skip n records of the trace and m of the reference.\n");
+}
+
+static int parse_args(int argc, char **argv, options_t *opt, const char **files) {
+	char *end;
+	int i, nfiles = 0;
+
+	opt->compare = 0;
+	opt->show = 0;
+	opt->context = DEFAULT_CONTEXT;
+	opt->workers = SDL_GetCPUCount() - 1;
+	opt->flag_mask = 0xff;
+	opt->skip[0] = opt->skip[1] = 0;
+
+	for(i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-C") && i + 1 < argc) {
+			opt->context = atoi(argv[++i]);
+			if(opt->context < 0 || opt->context > MAX_CONTEXT)
+				return RET_ERR_INVAL;
+		} else if(!strcmp(argv[i], "-j") && i + 1 < argc) {
+			opt->workers = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "-c")) {
+			opt->compare |= CMP_CYCLES;
+			opt->show |= TRACE_SHOW_CYCLES;
+		} else if(!strcmp(argv[i], "-w")) {
+			opt->compare |= CMP_WRITES;
+			opt->show |= TRACE_SHOW_WRITES;
+		} else if(!strcmp(argv[i], "--steps")) {
+			opt->compare |= CMP_STEP;
+		} else if(!strcmp(argv[i], "--flags-mask") && i + 1 < argc) {
+			opt->flag_mask = (uint8_t)strtoul(argv[++i], NULL, 0);
+		} else if(!strcmp(argv[i], "--skip") && i + 1 < argc) {
+			opt->skip[0] = strtoull(argv[++i], &end, 0);
+			if(*end++ != ',')
+				return RET_ERR_INVAL;
+			opt->skip[1] = strtoull(end, NULL, 0);
+		} else if(argv[i][0] != '-' && nfiles < 2) {
+			files[nfiles++] = argv[i];
+		} else {
+			return RET_ERR_INVAL;
+		}
+	}
+
+	if(opt->workers < 1)
+		opt->workers = 1;
+	if(opt->workers > MAX_WORKERS)
+		opt->workers = MAX_WORKERS;
+
+	return (nfiles == 2) ? RET_OK : RET_ERR_INVAL;
+}
+
+int main(int argc, char **argv) {
+	options_t opt;
+	const char *files[2];
+	trace_rec_t *history = NULL;
+	diff_t diff;
+	int ret;
+
+	if(parse_args(argc, argv, &opt, files) != RET_OK) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if(opt.context && (history = malloc(opt.context * sizeof(trace_rec_t))) == NULL) {
+		fprintf(stderr, "ERROR: Out of memory.\n");
+		return EXIT_FAILURE;
+	}
+
+	if((ret = diff_start(&diff, files[0], files[1], &opt)) != RET_OK) {
+		fprintf(stderr, "ERROR: Couldn't read the traces (%d).\n", ret);
+	} else {
+		ret = compare(&diff, &opt, history);
+	}
+
+	diff_stop(&diff);
+	free(history);
+
+	return (ret == RET_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
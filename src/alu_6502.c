@@ -0,0 +1,99 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* ADC and SBC of the NMOS 6502, for every input. Decimal mode follows
+ * Bruce Clark's description of the chip (6502.org, "Decimal Mode"),
+ * invalid BCD digits included:
+ *
+ * ADC: the low digit is added and, if it is above 9, corrected by 6
+ * with a carry into the high digit. N and V come from the high digits
+ * before their correction, Z from the binary sum.
+ *
+ * SBC: both digits are corrected by 6 on a borrow. All flags are those
+ * of the binary subtraction.
+ *
+ * a1alu checks these against an independent model.
+ */
+
+#include <stdint.h>
+
+#include "alu_6502.h"
+#include "cpu_6502.h"
+
+#define NZ(val)		((((val) & 0xff) ? 0 : FLAG_ZERO) | ((val) & FLAG_NEGATIVE))
+
+static uint8_t adc_binary(const uint8_t a, const uint8_t b, const int carry, uint8_t *flags) {
+	unsigned int sum = a + b + carry;
+
+	*flags &= ~(FLAG_NEGATIVE | FLAG_OVERFLOW | FLAG_ZERO | FLAG_CARRY);
+	*flags |= NZ(sum);
+
+	if(~(a ^ b) & (a ^ sum) & 0x80)
+		*flags |= FLAG_OVERFLOW;
+	if(sum > 0xff)
+		*flags |= FLAG_CARRY;
+
+	return sum & 0xff;
+}
+
+static uint8_t adc_decimal(const uint8_t a, const uint8_t b, const int carry, uint8_t *flags) {
+	int lo, sum, sgn;
+
+	lo = (a & 0x0f) + (b & 0x0f) + carry;
+	if(lo >= 0x0a)
+		lo = ((lo + 0x06) & 0x0f) + 0x10;
+
+	sum = (a & 0xf0) + (b & 0xf0) + lo;
+	sgn = (int8_t)(a & 0xf0) + (int8_t)(b & 0xf0) + lo;
+
+	*flags &= ~(FLAG_NEGATIVE | FLAG_OVERFLOW | FLAG_ZERO | FLAG_CARRY);
+	*flags |= NZ(a + b + carry) & FLAG_ZERO;
+	*flags |= sum & FLAG_NEGATIVE;
+
+	if(sgn < -128 || sgn > 127)
+		*flags |= FLAG_OVERFLOW;
+
+	if(sum >= 0xa0)
+		sum += 0x60;
+	if(sum > 0xff)
+		*flags |= FLAG_CARRY;
+
+	return sum & 0xff;
+}
+
+static uint8_t sbc_decimal(const uint8_t a, const uint8_t b, const int carry, uint8_t *flags) {
+	int lo, diff;
+
+	adc_binary(a, ~b & 0xff, carry, flags);
+
+	lo = (a & 0x0f) - (b & 0x0f) + carry - 1;
+	if(lo < 0)
+		lo = ((lo - 0x06) & 0x0f) - 0x10;
+
+	diff = (a & 0xf0) - (b & 0xf0) + lo;
+	if(diff < 0)
+		diff -= 0x60;
+
+	return diff & 0xff;
+}
+
+uint8_t alu_adc(const uint8_t a, const uint8_t b, uint8_t *flags) {
+	int carry = (*flags & FLAG_CARRY) ? 1 : 0;
+
+	if(*flags & FLAG_DECIMAL)
+		return adc_decimal(a, b, carry, flags);
+
+	return adc_binary(a, b, carry, flags);
+}
+
+/* A - b - !C is A + ~b + C. */
+uint8_t alu_sbc(const uint8_t a, const uint8_t b, uint8_t *flags) {
+	int carry = (*flags & FLAG_CARRY) ? 1 : 0;
+
+	if(*flags & FLAG_DECIMAL)
+		return sbc_decimal(a, b, carry, flags);
+
+	return adc_binary(a, ~b & 0xff, carry, flags);
+}
@@ -0,0 +1,142 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Apple 1 BASIC programs as their tokenized memory image. The program
+ * sits from PP up to HIMEM, the variables from LOMEM up to PV, and the
+ * four pointers in zero page say where. Saving takes both areas and the
+ * pointers; loading puts them back as they were, which is what the
+ * interpreter would have after typing the program in and running it.
+ * Enter BASIC with the warm start E2B3R afterwards, E000R clears it.
+ *
+ * File:	"A1BA" u16 version, u16 lomem, himem, pp, pv
+ *		variables (pv - lomem), program (himem - pp)
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leakcheck.h"
+
+#include "basic.h"
+#include "serial.h"
+#include "status.h"
+#include "vm.h"
+
+#define BA_MAGIC		"A1BA"
+#define BA_VERSION		1
+#define BA_HDR_SIZE		14
+
+#define ZP_LOMEM		0x4a
+#define ZP_HIMEM		0x4c
+#define ZP_PP			0xca
+#define ZP_PV			0xcc
+
+typedef struct basicptr_t {
+	uint16_t lomem, himem, pp, pv;
+} basicptr_t;
+
+static uint16_t get_ptr(vm_t *vm, const uint8_t zp) {
+	return vm->mem[zp] | (vm->mem[zp + 1] << 8);
+}
+
+static void set_ptr(vm_t *vm, const uint8_t zp, const uint16_t val) {
+	vm->ram[zp] = vm->mem[zp] = val & 0xff;
+	vm->ram[zp + 1] = vm->mem[zp + 1] = val >> 8;
+}
+
+/* Variables below the program, both between LOMEM and HIMEM. */
+static int valid(const basicptr_t *ptr) {
+	return (ptr->lomem <= ptr->pv) && (ptr->pv <= ptr->pp) && (ptr->pp <= ptr->himem);
+}
+
+int basic_save(vm_t *vm, const char *filename) {
+	uint8_t hdr[BA_HDR_SIZE], *p = hdr;
+	basicptr_t ptr;
+	FILE *fp;
+	int ret = RET_ERR_IO;
+
+	ptr.lomem = get_ptr(vm, ZP_LOMEM);
+	ptr.himem = get_ptr(vm, ZP_HIMEM);
+	ptr.pp = get_ptr(vm, ZP_PP);
+	ptr.pv = get_ptr(vm, ZP_PV);
+
+	if(!valid(&ptr))
+		return RET_ERR_FORMAT;
+
+	if((fp = fopen(filename, "wb")) == NULL)
+		return RET_ERR_OPEN;
+
+	put_bytes(&p, (const uint8_t*)BA_MAGIC, 4);
+	put_u16(&p, BA_VERSION);
+	put_u16(&p, ptr.lomem);
+	put_u16(&p, ptr.himem);
+	put_u16(&p, ptr.pp);
+	put_u16(&p, ptr.pv);
+
+	if(fwrite(hdr, BA_HDR_SIZE, 1, fp) != 1) goto closefile;
+	if(fwrite(vm->mem + ptr.lomem, 1, ptr.pv - ptr.lomem, fp) != (size_t)(ptr.pv - ptr.lomem)) goto closefile;
+	if(fwrite(vm->mem + ptr.pp, 1, ptr.himem - ptr.pp, fp) != (size_t)(ptr.himem - ptr.pp)) goto closefile;
+
+	ret = RET_OK;
+
+closefile:
+	if(fclose(fp) != 0 && ret == RET_OK)
+		ret = RET_ERR_IO;
+	return ret;
+}
+
+int basic_load(vm_t *vm, const char *filename) {
+	uint8_t hdr[BA_HDR_SIZE], *data;
+	const uint8_t *p = hdr;
+	basicptr_t ptr;
+	size_t n_vars, n_prog;
+	FILE *fp;
+	int ret = RET_ERR_FORMAT;
+
+	if((fp = fopen(filename, "rb")) == NULL)
+		return RET_ERR_OPEN;
+
+	if(fread(hdr, BA_HDR_SIZE, 1, fp) != 1) goto closefile;
+	if(memcmp(hdr, BA_MAGIC, 4) != 0) goto closefile;
+	p += 4;
+	if(get_u16(&p) != BA_VERSION) goto closefile;
+
+	ptr.lomem = get_u16(&p);
+	ptr.himem = get_u16(&p);
+	ptr.pp = get_u16(&p);
+	ptr.pv = get_u16(&p);
+	if(!valid(&ptr)) goto closefile;
+
+	n_vars = ptr.pv - ptr.lomem;
+	n_prog = ptr.himem - ptr.pp;
+
+	if((data = malloc(n_vars + n_prog + 1)) == NULL) {
+		ret = RET_ERR_ALLOC;
+		goto closefile;
+	}
+
+	/* Nothing is touched unless the whole file is there. */
+	if(fread(data, 1, n_vars + n_prog, fp) != n_vars + n_prog) goto freedata;
+
+	memcpy(vm->ram + ptr.lomem, data, n_vars);
+	memcpy(vm->mem + ptr.lomem, data, n_vars);
+	memcpy(vm->ram + ptr.pp, data + n_vars, n_prog);
+	memcpy(vm->mem + ptr.pp, data + n_vars, n_prog);
+
+	set_ptr(vm, ZP_LOMEM, ptr.lomem);
+	set_ptr(vm, ZP_HIMEM, ptr.himem);
+	set_ptr(vm, ZP_PP, ptr.pp);
+	set_ptr(vm, ZP_PV, ptr.pv);
+
+	ret = RET_OK;
+
+freedata:
+	free(data);
+closefile:
+	fclose(fp);
+	return ret;
+}
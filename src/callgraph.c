@@ -0,0 +1,223 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Exact guest call graph profile. JSR, BRK and interrupts push a frame on
+ * a shadow stack, and a frame is dropped as soon as the guest's stack
+ * pointer moves above the return address it pushed, whether by RTS, RTI,
+ * PLA or TXS. Code that uses RTS as a computed jump leaves the shadow
+ * stack alone because its stack pointer stays below the caller's frame.
+ *
+ * Every instruction's cycles go to the node of the current call path.
+ * Outside of any call they go to the closest symbol below the PC. The
+ * tree is written in the folded format of flamegraph.pl on stop.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leakcheck.h"
+
+#include "callgraph.h"
+#include "status.h"
+#include "symbols.h"
+
+#define MAX_DEPTH		256
+#define MAX_NODES		(1 << 20)
+#define NO_SYMBOL		0x10000
+
+#define OP_BRK			0x00
+#define OP_JSR			0x20
+
+typedef struct node_t {
+	uint32_t addr;			/* Entry point, or NO_SYMBOL */
+	uint32_t child, sibling;
+	uint64_t cycles;		/* Spent in the node itself */
+} node_t;
+
+typedef struct frame_t {
+	uint32_t node;
+	int sp;					/* Stack pointer before the call */
+} frame_t;
+
+static struct {
+	const char *filename;
+	const symbols_t *syms;
+
+	node_t *nodes;
+	uint32_t n_nodes, n_alloced;
+
+	frame_t stack[MAX_DEPTH];
+	int depth, truncated;
+} cg;
+
+static char path[(MAX_DEPTH + 1) * (SYMBOL_MAX_LEN + 1)];
+
+static uint32_t add_node(const uint32_t addr) {
+	node_t *newnodes;
+
+	if(cg.n_nodes == cg.n_alloced) {
+		if(cg.n_alloced == MAX_NODES)
+			return 0;
+		if((newnodes = malloc(cg.n_alloced * 2 * sizeof(node_t))) == NULL)
+			return 0;
+
+		memcpy(newnodes, cg.nodes, cg.n_nodes * sizeof(node_t));
+		free(cg.nodes);
+		cg.nodes = newnodes;
+		cg.n_alloced *= 2;
+	}
+
+	cg.nodes[cg.n_nodes].addr = addr;
+	cg.nodes[cg.n_nodes].child = 0;
+	cg.nodes[cg.n_nodes].sibling = 0;
+	cg.nodes[cg.n_nodes].cycles = 0;
+
+	return cg.n_nodes++;
+}
+
+/* 0 if the tree is full. Node 0 is the root and never a child. */
+static uint32_t child_of(const uint32_t parent, const uint32_t addr) {
+	uint32_t i, n;
+
+	for(i = cg.nodes[parent].child; i; i = cg.nodes[i].sibling) {
+		if(cg.nodes[i].addr == addr)
+			return i;
+	}
+
+	if((n = add_node(addr)) == 0) {
+		cg.truncated = 1;
+		return 0;
+	}
+
+	cg.nodes[n].sibling = cg.nodes[parent].child;
+	cg.nodes[parent].child = n;
+
+	return n;
+}
+
+static uint32_t current(const uint16_t pc) {
+	const char *name = NULL;
+	uint16_t base;
+
+	if(cg.depth)
+		return cg.stack[cg.depth - 1].node;
+
+	if(cg.syms)
+		name = symbols_find(cg.syms, pc, &base);
+
+	return child_of(0, name ? base : NO_SYMBOL);
+}
+
+static void call(const uint32_t caller, const uint16_t target, const int sp) {
+	uint32_t n;
+
+	if(cg.depth == MAX_DEPTH || (n = child_of(caller, target)) == 0) {
+		cg.truncated = 1;
+		return;
+	}
+
+	cg.stack[cg.depth].node = n;
+	cg.stack[cg.depth].sp = sp;
+	cg.depth++;
+}
+
+static void unwind(const uint8_t sp) {
+	while(cg.depth && cg.stack[cg.depth - 1].sp <= sp)
+		cg.depth--;
+}
+
+/* pc is the instruction's address, next_pc and sp the state after it. */
+void callgraph_instr(const uint8_t op, const uint16_t pc, const uint16_t next_pc, const uint8_t sp, const int cycles) {
+	uint32_t n;
+
+	if(cg.nodes == NULL)
+		return;
+
+	n = current(pc);
+	cg.nodes[n].cycles += cycles;
+
+	unwind(sp);
+
+	if(op == OP_JSR)
+		call(n, next_pc, sp + 2);
+	else if(op == OP_BRK)
+		call(n, next_pc, sp + 3);
+}
+
+/* After an IRQ or NMI has been taken. */
+void callgraph_interrupt(const uint16_t pc, const uint8_t sp, const int cycles) {
+	if(cg.nodes == NULL)
+		return;
+
+	unwind(sp);
+	call(current(pc), pc, sp + 3);
+	cg.nodes[current(pc)].cycles += cycles;
+}
+
+int callgraph_start(const char *filename, const symbols_t *syms) {
+	if((cg.nodes = malloc(PREALLOC_LIST * sizeof(node_t))) == NULL)
+		return RET_ERR_ALLOC;
+
+	cg.n_alloced = PREALLOC_LIST;
+	cg.n_nodes = 0;
+	cg.depth = 0;
+	cg.truncated = 0;
+	cg.filename = filename;
+	cg.syms = syms;
+
+	add_node(NO_SYMBOL);
+
+	return RET_OK;
+}
+
+static void write_node(FILE *fp, const uint32_t n, const size_t len) {
+	uint32_t i;
+	size_t newlen = len;
+
+	if(n) {
+		if(len)
+			path[newlen++] = ';';
+
+		if(cg.nodes[n].addr == NO_SYMBOL)
+			strcpy(path + newlen, "[top]");
+		else
+			symbols_format(cg.syms, (uint16_t)cg.nodes[n].addr, path + newlen);
+		newlen += strlen(path + newlen);
+
+		if(cg.nodes[n].cycles)
+			fprintf(fp, "%s %llu\n", path, (unsigned long long)cg.nodes[n].cycles);
+	}
+
+	for(i = cg.nodes[n].child; i; i = cg.nodes[i].sibling)
+		write_node(fp, i, newlen);
+}
+
+int callgraph_stop(void) {
+	FILE *fp;
+	int ret = RET_OK;
+
+	if(cg.nodes == NULL)
+		return RET_OK;
+
+	if((fp = fopen(cg.filename, "w")) == NULL) {
+		ret = RET_ERR_OPEN;
+	} else {
+		write_node(fp, 0, 0);
+		if(ferror(fp))
+			ret = RET_ERR_IO;
+		if(fclose(fp) != 0)
+			ret = RET_ERR_IO;
+	}
+
+	if(cg.truncated)
+		fprintf(stderr, "WARNING: The call graph was too deep or too large and is incomplete.\n");
+
+	free(cg.nodes);
+	cg.nodes = NULL;
+
+	return ret;
+}
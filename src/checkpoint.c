@@ -0,0 +1,425 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Checkpoint files hold a sequence of machine images (see vm_save_state()).
+ * Every frame is either a keyframe or the XOR delta against the previous
+ * frame, run-length packed. Packing and disk I/O happen on a writer thread,
+ * the emulation thread only copies the image into a hand-off buffer.
+ *
+ * File:	"A1CP" u16 version, u32 image size, u16 keyframe interval
+ * Frame:	u8 type, u64 cycle, u32 packed size, packed data
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "leakcheck.h"
+
+#include "checkpoint.h"
+#include "serial.h"
+#include "status.h"
+#include "vm.h"
+
+#define CP_MAGIC		"A1CP"
+#define CP_VERSION		1
+#define CP_KEY_INTERVAL	16
+
+#define FILE_HDR_SIZE	12
+#define FRAME_HDR_SIZE	13
+
+#define RUN_MIN			4
+
+struct checkpoint_t {
+	FILE *fp;
+	size_t size;
+
+	uint8_t *pending, *work, *prev, *packed;
+	uint64_t pending_cycle;
+	int has_pending, quit;
+	int error;				/* A write failed, nothing more is written */
+	uint32_t n_frames, n_dropped;
+
+	SDL_Thread *thread;
+	SDL_mutex *lock;
+	SDL_cond *cond;
+};
+
+struct checkpoint_reader_t {
+	FILE *fp;
+	size_t size;
+
+	uint8_t *image, *packed;
+	size_t packed_size;
+	uint64_t cycle;
+	int type;
+	uint32_t n_frames;
+};
+
+/* Run-length codec. Tokens are a varint (length << 1 | is_run) followed by
+ * the literal bytes or the single repeated byte. XOR deltas of a machine
+ * image are mostly zero, so this gets most of the way for a fraction of
+ * the cost of a real compressor. */
+
+static size_t packed_bound(const size_t size) {
+	return size + size / 2 + 16;
+}
+
+static void put_varint(uint8_t **p, uint32_t val) {
+	while(val >= 0x80) {
+		put_u8(p, (val & 0x7f) | 0x80);
+		val >>= 7;
+	}
+	put_u8(p, val);
+}
+
+static int get_varint(const uint8_t **p, const uint8_t *end, uint32_t *val) {
+	int shift = 0;
+	uint8_t c;
+
+	*val = 0;
+	do {
+		if(*p == end || shift > 28)
+			return 0;
+		c = get_u8(p);
+		*val |= (uint32_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while(c & 0x80);
+
+	return 1;
+}
+
+static size_t rle_pack(const uint8_t *in, const size_t size, uint8_t *out) {
+	uint8_t *p = out;
+	size_t pos = 0, lit = 0, run;
+
+	while(pos < size) {
+		run = 1;
+		while((pos + run < size) && (in[pos + run] == in[pos]))
+			run++;
+
+		if(run < RUN_MIN) {
+			pos += run;
+			continue;
+		}
+
+		if(lit < pos) {
+			put_varint(&p, (pos - lit) << 1);
+			put_bytes(&p, in + lit, pos - lit);
+		}
+		put_varint(&p, (run << 1) | 1);
+		put_u8(&p, in[pos]);
+
+		pos += run;
+		lit = pos;
+	}
+
+	if(lit < size) {
+		put_varint(&p, (size - lit) << 1);
+		put_bytes(&p, in + lit, size - lit);
+	}
+
+	return p - out;
+}
+
+static int rle_unpack(const uint8_t *in, const size_t in_size, uint8_t *out, const size_t size, const int xor) {
+	const uint8_t *p = in, *end = in + in_size;
+	size_t pos = 0, i;
+	uint32_t token, len;
+	uint8_t val;
+
+	while(p < end) {
+		if(!get_varint(&p, end, &token))
+			return RET_ERR_FORMAT;
+
+		len = token >> 1;
+		if(pos + len > size)
+			return RET_ERR_FORMAT;
+
+		if(token & 1) {
+			if(p == end)
+				return RET_ERR_FORMAT;
+			val = get_u8(&p);
+			if(!xor)
+				memset(out + pos, val, len);
+			else if(val)
+				for(i = 0; i < len; i++) out[pos + i] ^= val;
+		} else {
+			if((size_t)(end - p) < len)
+				return RET_ERR_FORMAT;
+			if(!xor)
+				memcpy(out + pos, p, len);
+			else
+				for(i = 0; i < len; i++) out[pos + i] ^= p[i];
+			p += len;
+		}
+		pos += len;
+	}
+
+	return (pos == size) ? RET_OK : RET_ERR_FORMAT;
+}
+
+/* Writer */
+
+static void write_frame(checkpoint_t *cp, const uint64_t cycle) {
+	uint8_t hdr[FRAME_HDR_SIZE], *p = hdr;
+	size_t packed_size, i;
+	int type;
+
+	if(cp->error)
+		return;
+
+	if(cp->n_frames % CP_KEY_INTERVAL == 0) {
+		type = CP_KEYFRAME;
+		packed_size = rle_pack(cp->work, cp->size, cp->packed);
+	} else {
+		type = CP_DELTA;
+		for(i = 0; i < cp->size; i++)
+			cp->prev[i] ^= cp->work[i];
+		packed_size = rle_pack(cp->prev, cp->size, cp->packed);
+	}
+	memcpy(cp->prev, cp->work, cp->size);
+
+	put_u8(&p, type);
+	put_u64(&p, cycle);
+	put_u32(&p, packed_size);
+
+	/* Later deltas would build on a frame that isn't in the file. */
+	if(fwrite(hdr, FRAME_HDR_SIZE, 1, cp->fp) != 1 ||
+	   fwrite(cp->packed, packed_size, 1, cp->fp) != 1 ||
+	   fflush(cp->fp) != 0) {
+		cp->error = 1;
+		return;
+	}
+
+	cp->n_frames++;
+}
+
+static int writer_thread(void *data) {
+	checkpoint_t *cp = data;
+	uint8_t *buf;
+	uint64_t cycle;
+
+	for(;;) {
+		SDL_LockMutex(cp->lock);
+		while(!cp->has_pending && !cp->quit)
+			SDL_CondWait(cp->cond, cp->lock);
+
+		if(!cp->has_pending) {
+			SDL_UnlockMutex(cp->lock);
+			break;
+		}
+
+		buf = cp->pending;
+		cp->pending = cp->work;
+		cp->work = buf;
+		cycle = cp->pending_cycle;
+		cp->has_pending = 0;
+		SDL_CondBroadcast(cp->cond);
+		SDL_UnlockMutex(cp->lock);
+
+		write_frame(cp, cycle);
+	}
+
+	return 0;
+}
+
+static void free_writer(checkpoint_t *cp) {
+	if(cp->cond) SDL_DestroyCond(cp->cond);
+	if(cp->lock) SDL_DestroyMutex(cp->lock);
+	free(cp->packed);
+	free(cp->prev);
+	free(cp->work);
+	free(cp->pending);
+	if(cp->fp) fclose(cp->fp);
+	free(cp);
+}
+
+checkpoint_t *checkpoint_create(vm_t *vm, const char *filename, int *status) {
+	checkpoint_t *cp;
+	uint8_t hdr[FILE_HDR_SIZE], *p = hdr;
+
+	*status = RET_ERR_ALLOC;
+	if((cp = malloc(sizeof(checkpoint_t))) == NULL)
+		return NULL;
+
+	memset(cp, 0, sizeof(checkpoint_t));
+	cp->size = vm_state_size(vm, 1);
+
+	if((cp->pending = malloc(cp->size)) == NULL) goto fail;
+	if((cp->work = malloc(cp->size)) == NULL) goto fail;
+	if((cp->prev = malloc(cp->size)) == NULL) goto fail;
+	if((cp->packed = malloc(packed_bound(cp->size))) == NULL) goto fail;
+	if((cp->lock = SDL_CreateMutex()) == NULL) goto fail;
+	if((cp->cond = SDL_CreateCond()) == NULL) goto fail;
+
+	*status = RET_ERR_OPEN;
+	if((cp->fp = fopen(filename, "wb")) == NULL) goto fail;
+
+	put_bytes(&p, (const uint8_t*)CP_MAGIC, 4);
+	put_u16(&p, CP_VERSION);
+	put_u32(&p, cp->size);
+	put_u16(&p, CP_KEY_INTERVAL);
+
+	*status = RET_ERR_IO;
+	if(fwrite(hdr, FILE_HDR_SIZE, 1, cp->fp) != 1) goto fail;
+
+	*status = RET_ERR_SDL;
+	if((cp->thread = SDL_CreateThread(writer_thread, "checkpoint", cp)) == NULL) goto fail;
+
+	*status = RET_OK;
+	return cp;
+
+fail:
+	free_writer(cp);
+	return NULL;
+}
+
+/* Hands the current machine image to the writer. Unless waiting is
+ * requested, a checkpoint is dropped while the previous one is still
+ * being packed, so the caller never blocks on the disk. */
+int checkpoint_write(checkpoint_t *cp, vm_t *vm, const int wait) {
+	SDL_LockMutex(cp->lock);
+	if(cp->has_pending) {
+		if(!wait) {
+			cp->n_dropped++;
+			SDL_UnlockMutex(cp->lock);
+			return RET_BUSY;
+		}
+		while(cp->has_pending)
+			SDL_CondWait(cp->cond, cp->lock);
+	}
+	SDL_UnlockMutex(cp->lock);
+
+	vm_save_state(vm, cp->pending, 1);
+
+	SDL_LockMutex(cp->lock);
+	cp->pending_cycle = vm->cycle;
+	cp->has_pending = 1;
+	SDL_CondBroadcast(cp->cond);
+	SDL_UnlockMutex(cp->lock);
+
+	return RET_OK;
+}
+
+/* RET_ERR_IO if a frame couldn't be written. The file then ends with
+ * the last complete frame before it. */
+int checkpoint_close(checkpoint_t *cp) {
+	int ret;
+
+	SDL_LockMutex(cp->lock);
+	cp->quit = 1;
+	SDL_CondBroadcast(cp->cond);
+	SDL_UnlockMutex(cp->lock);
+
+	SDL_WaitThread(cp->thread, NULL);
+
+	if(cp->n_dropped)
+		fprintf(stderr, "checkpoint_close(): %u frames written, %u dropped.\n", cp->n_frames, cp->n_dropped);
+
+	ret = cp->error ? RET_ERR_IO : RET_OK;
+	free_writer(cp);
+	return ret;
+}
+
+/* Reader */
+
+checkpoint_reader_t *checkpoint_open(const char *filename, int *status) {
+	checkpoint_reader_t *cr;
+	uint8_t hdr[FILE_HDR_SIZE];
+	const uint8_t *p = hdr;
+
+	*status = RET_ERR_ALLOC;
+	if((cr = malloc(sizeof(checkpoint_reader_t))) == NULL)
+		return NULL;
+
+	memset(cr, 0, sizeof(checkpoint_reader_t));
+
+	*status = RET_ERR_OPEN;
+	if((cr->fp = fopen(filename, "rb")) == NULL) goto fail;
+
+	*status = RET_ERR_FORMAT;
+	if(fread(hdr, FILE_HDR_SIZE, 1, cr->fp) != 1) goto fail;
+	if(memcmp(hdr, CP_MAGIC, 4) != 0) goto fail;
+	p += 4;
+	if(get_u16(&p) != CP_VERSION) goto fail;
+	cr->size = get_u32(&p);
+
+	*status = RET_ERR_ALLOC;
+	if((cr->image = malloc(cr->size)) == NULL) goto fail;
+	if((cr->packed = malloc(packed_bound(cr->size))) == NULL) goto fail;
+
+	*status = RET_OK;
+	return cr;
+
+fail:
+	checkpoint_close_reader(cr);
+	return NULL;
+}
+
+/* Advances to the next frame. A frame cut short by a crash reads as EOF,
+ * so the image stays at the last complete checkpoint. */
+int checkpoint_next(checkpoint_reader_t *cr) {
+	uint8_t hdr[FRAME_HDR_SIZE];
+	const uint8_t *p = hdr;
+	int type, ret;
+	uint64_t cycle;
+	uint32_t packed_size;
+
+	if(fread(hdr, FRAME_HDR_SIZE, 1, cr->fp) != 1)
+		return RET_EOF;
+
+	type = get_u8(&p);
+	cycle = get_u64(&p);
+	packed_size = get_u32(&p);
+
+	if((type != CP_KEYFRAME && type != CP_DELTA) || packed_size > packed_bound(cr->size))
+		return RET_ERR_FORMAT;
+	if(type == CP_DELTA && cr->n_frames == 0)
+		return RET_ERR_FORMAT;
+
+	if(fread(cr->packed, 1, packed_size, cr->fp) != packed_size)
+		return RET_EOF;
+
+	if((ret = rle_unpack(cr->packed, packed_size, cr->image, cr->size, type == CP_DELTA)) != RET_OK)
+		return ret;
+
+	cr->type = type;
+	cr->cycle = cycle;
+	cr->packed_size = packed_size;
+	cr->n_frames++;
+
+	return RET_OK;
+}
+
+int checkpoint_restore(checkpoint_reader_t *cr, vm_t *vm) {
+	if(cr->n_frames == 0 || cr->size != vm_state_size(vm, 1))
+		return RET_ERR_FORMAT;
+
+	vm_load_state(vm, cr->image, 1);
+	return RET_OK;
+}
+
+uint64_t checkpoint_cycle(checkpoint_reader_t *cr) {
+	return cr->cycle;
+}
+
+int checkpoint_type(checkpoint_reader_t *cr) {
+	return cr->type;
+}
+
+size_t checkpoint_packed_size(checkpoint_reader_t *cr) {
+	return cr->packed_size;
+}
+
+void checkpoint_close_reader(checkpoint_reader_t *cr) {
+	free(cr->packed);
+	free(cr->image);
+	if(cr->fp) fclose(cr->fp);
+	free(cr);
+}
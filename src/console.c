@@ -0,0 +1,276 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Apple 1 console on a Unix-domain socket, so other local processes can
+ * type into the VM and read what it displays. One client at a time.
+ * Everything is nonblocking and polled by the main loop between slices:
+ * received bytes go to the keyboard only as far as the keyboard FIFO has
+ * room, the rest stays in the socket buffer. Displayed characters are
+ * buffered and sent with LF line ends; if the client does not keep up,
+ * output beyond CONSOLE_OUT_SIZE is dropped.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <winsock2.h>
+#include <afunix.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "leakcheck.h"
+
+#include "console.h"
+#include "io_6820.h"
+#include "replay.h"
+#include "status.h"
+#include "vm.h"
+
+#ifdef _WIN32
+typedef SOCKET sock_t;
+#define SOCK_INVALID	INVALID_SOCKET
+#define close_sock(s)	closesocket(s)
+#define would_block()	(WSAGetLastError() == WSAEWOULDBLOCK)
+#define unlink(path)	_unlink(path)
+#else
+typedef int sock_t;
+#define SOCK_INVALID	-1
+#define close_sock(s)	close(s)
+#define would_block()	(errno == EAGAIN || errno == EWOULDBLOCK)
+#endif
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS		MSG_NOSIGNAL
+#else
+#define SEND_FLAGS		0
+#endif
+
+#define RECV_CHUNK		64
+
+struct console_t {
+	vm_t *vm;
+	sock_t listener, client;
+	struct sockaddr_un addr;
+	uint8_t prev;				/* Last byte received, for CR LF */
+
+	uint8_t out[CONSOLE_OUT_SIZE];
+	size_t out_head, out_len;
+};
+
+/* Removes a socket file left behind by an earlier run. Anything else at
+ * path stays where it is and the console doesn't start. */
+static int remove_stale(const char *path) {
+#ifdef _WIN32
+	DWORD attr = GetFileAttributesA(path);
+
+	if(attr == INVALID_FILE_ATTRIBUTES)
+		return 1;
+	if(!(attr & FILE_ATTRIBUTE_REPARSE_POINT))
+		return 0;
+#else
+	struct stat st;
+
+	if(lstat(path, &st) != 0)
+		return errno == ENOENT;
+	if(!S_ISSOCK(st.st_mode))
+		return 0;
+#endif
+
+	return unlink(path) == 0;
+}
+
+static int set_nonblocking(sock_t s) {
+#ifdef _WIN32
+	u_long on = 1;
+	return ioctlsocket(s, FIONBIO, &on) == 0;
+#else
+	int flags = fcntl(s, F_GETFL, 0);
+	return (flags != -1) && (fcntl(s, F_SETFL, flags | O_NONBLOCK) != -1);
+#endif
+}
+
+static void drop_client(console_t *con) {
+	close_sock(con->client);
+	con->client = SOCK_INVALID;
+	con->out_len = 0;
+}
+
+static void console_output(void *data, const uint8_t c) {
+	console_t *con = data;
+
+	if(con->client == SOCK_INVALID || con->out_len == CONSOLE_OUT_SIZE)
+		return;
+
+	con->out[(con->out_head + con->out_len) % CONSOLE_OUT_SIZE] = (c == '\r') ? '\n' : c;
+	con->out_len++;
+}
+
+static void accept_client(console_t *con) {
+	sock_t s;
+#ifdef SO_NOSIGPIPE
+	int on = 1;
+#endif
+
+	if((s = accept(con->listener, NULL, NULL)) == SOCK_INVALID)
+		return;
+
+	if(!set_nonblocking(s)) {
+		close_sock(s);
+		return;
+	}
+
+#ifdef SO_NOSIGPIPE
+	setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+	con->client = s;
+	con->prev = 0;
+	con->out_head = con->out_len = 0;
+}
+
+static void receive(console_t *con) {
+	uint8_t buf[RECV_CHUNK];
+	size_t space;
+	int i, n, key;
+
+	/* Recorded input would diverge from the log. */
+	if(replay_playing())
+		return;
+
+	while((space = pia_kbd_space()) > 0) {
+		n = recv(con->client, (char*)buf, (int)((space < RECV_CHUNK) ? space : RECV_CHUNK), 0);
+
+		if(n == 0 || (n < 0 && !would_block())) {
+			drop_client(con);
+			return;
+		}
+
+		if(n < 0)
+			return;
+
+		for(i = 0; i < n; i++) {
+			if((key = pia_ascii_key(buf[i], con->prev)) >= 0)
+				pia_event(con->vm, REPLAY_KEY, key);
+			con->prev = buf[i];
+		}
+	}
+}
+
+static void transmit(console_t *con) {
+	size_t chunk;
+	int n;
+
+	while(con->out_len) {
+		chunk = CONSOLE_OUT_SIZE - con->out_head;
+		if(chunk > con->out_len)
+			chunk = con->out_len;
+
+		n = send(con->client, (const char*)&con->out[con->out_head], (int)chunk, SEND_FLAGS);
+
+		if(n < 0) {
+			if(!would_block())
+				drop_client(con);
+			return;
+		}
+
+		con->out_head = (con->out_head + n) % CONSOLE_OUT_SIZE;
+		con->out_len -= n;
+	}
+}
+
+void console_poll(console_t *con) {
+	if(con->client == SOCK_INVALID)
+		accept_client(con);
+
+	if(con->client != SOCK_INVALID)
+		receive(con);
+
+	if(con->client != SOCK_INVALID)
+		transmit(con);
+}
+
+console_t *console_create(vm_t *vm, const char *path, int *status) {
+	console_t *con;
+#ifdef _WIN32
+	WSADATA wsa;
+#endif
+
+	*status = RET_ERR_INVAL;
+	if(strlen(path) >= sizeof(con->addr.sun_path))
+		return NULL;
+
+	*status = RET_ERR_ALLOC;
+	if((con = malloc(sizeof(console_t))) == NULL)
+		return NULL;
+
+	con->vm = vm;
+	con->client = SOCK_INVALID;
+	con->out_head = con->out_len = 0;
+
+	memset(&con->addr, 0, sizeof(con->addr));
+	con->addr.sun_family = AF_UNIX;
+	strcpy(con->addr.sun_path, path);
+
+	*status = RET_ERR_OPEN;
+
+#ifdef _WIN32
+	if(WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		goto freecon;
+#endif
+
+	if((con->listener = socket(AF_UNIX, SOCK_STREAM, 0)) == SOCK_INVALID)
+		goto cleanup;
+
+	if(!remove_stale(path))
+		goto closelistener;
+
+	if(bind(con->listener, (struct sockaddr*)&con->addr, sizeof(con->addr)) != 0)
+		goto closelistener;
+
+	if(listen(con->listener, 1) != 0 || !set_nonblocking(con->listener))
+		goto unlinkpath;
+
+	if((*status = pia_output_reg(console_output, con)) != RET_OK)
+		goto unlinkpath;
+
+	*status = RET_OK;
+	return con;
+
+unlinkpath:
+	unlink(path);
+closelistener:
+	close_sock(con->listener);
+cleanup:
+#ifdef _WIN32
+	WSACleanup();
+freecon:
+#endif
+	free(con);
+	return NULL;
+}
+
+/* Call after the VM is gone, the PIA holds a pointer to con until then. */
+void console_close(console_t *con) {
+	if(con->client != SOCK_INVALID)
+		close_sock(con->client);
+
+	close_sock(con->listener);
+	unlink(con->addr.sun_path);
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	free(con);
+}
@@ -0,0 +1,67 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Guest code coverage. The CPU core sets a bit for every opcode it
+ * fetches, and with rw the memory functions set one for every address
+ * read or written. Reads include instruction fetches. The maps are added
+ * to what the file already holds, so repeated runs accumulate.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "leakcheck.h"
+
+#include "coverage.h"
+#include "covfile.h"
+#include "status.h"
+#include "vm.h"
+
+static coverage_t *g_cov = NULL;
+static const char *g_filename = NULL;
+
+int coverage_start(vm_t *vm, const char *filename, const int rw) {
+	int ret;
+
+	if((g_cov = malloc(sizeof(coverage_t))) == NULL)
+		return RET_ERR_ALLOC;
+
+	coverage_clear(g_cov);
+
+	/* A missing file is fine, anything else we'd overwrite is not. */
+	if((ret = coverage_load(g_cov, filename)) != RET_OK && ret != RET_ERR_OPEN) {
+		free(g_cov);
+		g_cov = NULL;
+		return ret;
+	}
+
+	g_filename = filename;
+	g_cov->maps |= COV_EXEC;
+	vm->cov_exec = g_cov->exec;
+
+	if(rw) {
+		g_cov->maps |= COV_READ | COV_WRITE;
+		vm->cov_read = g_cov->read;
+		vm->cov_write = g_cov->write;
+	}
+
+	return RET_OK;
+}
+
+int coverage_stop(vm_t *vm) {
+	int ret;
+
+	if(g_cov == NULL)
+		return RET_OK;
+
+	vm->cov_exec = vm->cov_read = vm->cov_write = NULL;
+
+	ret = coverage_save(g_cov, g_filename);
+
+	free(g_cov);
+	g_cov = NULL;
+
+	return ret;
+}
@@ -0,0 +1,122 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Coverage file. Loading ORs the file into the maps in memory, so
+ * coverage from several runs or machines adds up.
+ *
+ * File:	"A1CV" u16 version, u8 maps, then 8K per map in the order
+ *		exec, read, write for each map present
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leakcheck.h"
+
+#include "covfile.h"
+#include "serial.h"
+#include "status.h"
+
+#define CV_MAGIC		"A1CV"
+#define CV_VERSION		1
+#define CV_HDR_SIZE		7
+
+void coverage_clear(coverage_t *cov) {
+	memset(cov, 0, sizeof(coverage_t));
+}
+
+static void or_map(uint8_t *dst, const uint8_t *src) {
+	int i;
+
+	for(i = 0; i < COV_MAP_SIZE; i++)
+		dst[i] |= src[i];
+}
+
+void coverage_merge(coverage_t *dst, const coverage_t *src) {
+	or_map(dst->exec, src->exec);
+	or_map(dst->read, src->read);
+	or_map(dst->write, src->write);
+	dst->maps |= src->maps;
+}
+
+int coverage_flags(const coverage_t *cov, const uint16_t addr) {
+	return (COV_TEST(cov->exec, addr) ? COV_EXEC : 0) |
+		(COV_TEST(cov->read, addr) ? COV_READ : 0) |
+		(COV_TEST(cov->write, addr) ? COV_WRITE : 0);
+}
+
+static uint8_t *map_of(coverage_t *cov, const int map) {
+	switch(map) {
+		case COV_EXEC:	return cov->exec;
+		case COV_READ:	return cov->read;
+		default:		return cov->write;
+	}
+}
+
+static const uint8_t *const_map_of(const coverage_t *cov, const int map) {
+	switch(map) {
+		case COV_EXEC:	return cov->exec;
+		case COV_READ:	return cov->read;
+		default:		return cov->write;
+	}
+}
+
+int coverage_load(coverage_t *cov, const char *filename) {
+	FILE *fp;
+	uint8_t hdr[CV_HDR_SIZE], buf[COV_MAP_SIZE];
+	const uint8_t *p = hdr;
+	int maps, map, ret = RET_ERR_FORMAT;
+
+	if((fp = fopen(filename, "rb")) == NULL)
+		return RET_ERR_OPEN;
+
+	if(fread(hdr, CV_HDR_SIZE, 1, fp) != 1) goto closefile;
+	if(memcmp(hdr, CV_MAGIC, 4) != 0) goto closefile;
+	p += 4;
+	if(get_u16(&p) != CV_VERSION) goto closefile;
+	maps = get_u8(&p);
+
+	for(map = COV_EXEC; map <= COV_WRITE; map <<= 1) {
+		if(!(maps & map))
+			continue;
+		if(fread(buf, COV_MAP_SIZE, 1, fp) != 1) goto closefile;
+		or_map(map_of(cov, map), buf);
+	}
+
+	cov->maps |= maps;
+	ret = RET_OK;
+
+closefile:
+	fclose(fp);
+	return ret;
+}
+
+int coverage_save(const coverage_t *cov, const char *filename) {
+	FILE *fp;
+	uint8_t hdr[CV_HDR_SIZE], *p = hdr;
+	int map, ret = RET_OK;
+
+	if((fp = fopen(filename, "wb")) == NULL)
+		return RET_ERR_OPEN;
+
+	put_bytes(&p, (const uint8_t*)CV_MAGIC, 4);
+	put_u16(&p, CV_VERSION);
+	put_u8(&p, (uint8_t)cov->maps);
+
+	if(fwrite(hdr, CV_HDR_SIZE, 1, fp) != 1)
+		ret = RET_ERR_IO;
+
+	for(map = COV_EXEC; map <= COV_WRITE && ret == RET_OK; map <<= 1) {
+		if((cov->maps & map) && fwrite(const_map_of(cov, map), COV_MAP_SIZE, 1, fp) != 1)
+			ret = RET_ERR_IO;
+	}
+
+	if(fclose(fp) != 0)
+		ret = RET_ERR_IO;
+
+	return ret;
+}
@@ -8,8 +8,14 @@
 
 #include "leakcheck.h"
 
+#include "alu_6502.h"
+#include "callgraph.h"
+#include "covfile.h"
 #include "cpu_6502.h"
+#include "heatmap.h"
 #include "mem.h"
+#include "profile.h"
+#include "serial.h"
 #include "status.h"
 #include "vm.h"
 
@@ -23,6 +29,7 @@
 
 struct cpu_6502_t {
 	uint8_t flags;
+	uint8_t poll_flags;	/* Flags the last instruction polled IRQ with */
 	uint16_t pc;	/* Program Counter */
 	uint8_t sp;		/* Stack Pointer */
 
@@ -82,324 +89,300 @@ static void flip_flags(cpu_6502_t *cpu, uint8_t val) {
 	}
 }
 
-static void adc_binary(cpu_6502_t *cpu, const uint8_t b) {
-	uint8_t sum8 = cpu->a + b + (QUERY_FLAG(FLAG_CARRY) ? 1 : 0);
-	uint16_t sum16 = cpu->a + b + (QUERY_FLAG(FLAG_CARRY) ? 1 : 0);
-
-	if((cpu->a ^ sum8) & (b ^ sum8) & 0x80)
-		SET_FLAG(FLAG_OVERFLOW);
-	else
-		CLEAR_FLAG(FLAG_OVERFLOW);
-
-	if(sum16 > 255)
-		SET_FLAG(FLAG_CARRY);
-	else
-		CLEAR_FLAG(FLAG_CARRY);
-
-	cpu->a = sum8;
-}
-
-static void adc_decimal(cpu_6502_t *cpu, const uint8_t b) {
-	int abin, bbin, rbin;
-	int carry = QUERY_FLAG(FLAG_CARRY) ? 1 : 0;
-
-	abin = (cpu->a >> 4) * 10 + (cpu->a & 0x0f);
-	bbin = (b >> 4) * 10 + (b & 0x0f);
-	rbin = abin + bbin + carry;
-
-	if(rbin > 99) 
-		SET_FLAG(FLAG_CARRY);
-	else
-		CLEAR_FLAG(FLAG_CARRY);
-
-	cpu->a = ((rbin % 100) / 10) << 4 | (rbin % 10);
-}
-
-static void sbc_decimal(cpu_6502_t *cpu, const uint8_t b) {
-	int abin, bbin, rbin;
-	int carry = QUERY_FLAG(FLAG_CARRY) ? 0 : 1;
-
-	abin = (cpu->a >> 4) * 10 + (cpu->a & 0x0f);
-	bbin = (b >> 4) * 10 + (b & 0x0f);
-	rbin = abin - bbin - carry;
-	if(rbin < 0) {
-		CLEAR_FLAG(FLAG_CARRY);
-		rbin += 100;
-	} else {
-		SET_FLAG(FLAG_CARRY);
-	}
-
-	cpu->a = ((rbin % 100) / 10) << 4 | (rbin % 10);
-}
-
-static void sbc_binary(cpu_6502_t *cpu, const uint8_t b) {
-	uint8_t sum8 = cpu->a - b - (QUERY_FLAG(FLAG_CARRY) ? 0 : 1);
-	uint16_t sum16 = cpu->a - b - (QUERY_FLAG(FLAG_CARRY) ? 0 : 1);
-
-	if((cpu->a ^ sum8) & (~b ^ sum8) & 0x80)
-		SET_FLAG(FLAG_OVERFLOW);
-	else
-		CLEAR_FLAG(FLAG_OVERFLOW);
-
-	if(sum16 > 0xff)
-		CLEAR_FLAG(FLAG_CARRY);
-	else
-		SET_FLAG(FLAG_CARRY);
-
-	cpu->a = sum8;
-}
-
 static uint16_t read_ptr_zp(vm_t *vm, const uint16_t addr) {
 	return read_ptr_wrap(vm, addr & 0xff);
 }
 
-static int interrupt(cpu_6502_t *cpu, const uint16_t vector, int *cyc) {
-	cpu->pc += 2;
-	push(cpu, (cpu->pc >> 8) & 0xff);
-	push(cpu, cpu->pc & 0xff);	
-	push(cpu, cpu->flags);
+/* Indexed reads take an extra cycle when the index carries into the
+ * high byte of the address. */
+static int crossed(const uint16_t base, const uint8_t index) {
+	return (((base + index) ^ base) & 0xff00) ? 1 : 0;
+}
+
+/* BRK pushes the address after its padding byte with B set, IRQ and NMI
+ * push the address of the next instruction with B clear. */
+static int interrupt(cpu_6502_t *cpu, const uint16_t vector, const uint16_t ret, const uint8_t brk, int *cyc) {
+	push(cpu, (ret >> 8) & 0xff);
+	push(cpu, ret & 0xff);
+	push(cpu, (cpu->flags & ~FLAG_BREAK) | brk | FLAG_RESERVED);
 
 	SET_FLAG(FLAG_INTERRUPT);
 	cpu->pc = read_ptr(cpu->vm, vector);
-	*cyc = 6;
+	*cyc = 7;
 
 	return RET_JUMP;
 }
 
+/* The memory forms of the read-modify-write instructions go over the bus
+ * once each way, so devices, watchpoints, coverage, the heatmap and the
+ * trace see them. The NMOS chip writes the old value back first; that
+ * dummy write is left out, it would only show up as a second access. */
+static void rmw_store(cpu_6502_t *cpu, const int mem, const uint16_t addr, const uint8_t val) {
+	if(mem)
+		write_mem(cpu->vm, addr, val);
+	else
+		cpu->a = val;
+}
+
 /* Opcode implementations */
 
 /* RMW instructions */
 static int asl(cpu_6502_t *cpu, int *cyc) {
-	uint8_t *target;
+	uint16_t addr = 0;
+	uint8_t val;
+	int mem = 1;
 	
 	switch(cpu->ir) {
 		case 0x0a:	/* ASL A */
-			target = &(cpu->a);						
+			mem = 0;
 			*cyc=2; break;
 
 		case 0x06:	/* ASL $xx */
-			target = get_pointer(cpu->vm, cpu->arg);
+			addr = cpu->arg;
 			*cyc=5; break;
 
 		case 0x16:	/* ASL $xx, X */
-			target = get_pointer(cpu->vm, cpu->arg + cpu->x);
+			addr = (cpu->arg + cpu->x) & 0xff;
 			*cyc=6; break;
 
 		case 0x0e:	/* ASL $xxxx */
-			target = get_pointer(cpu->vm, cpu->arg);
+			addr = cpu->arg;
 			*cyc=6; break;
 
 		case 0x1e:	/* ASL $xxxx, X */
-			target = get_pointer(cpu->vm, cpu->arg + cpu->x);
+			addr = cpu->arg + cpu->x;
 			*cyc=7; break;
 
 		default:
 			return RET_ERR_INSTR;
 	}
 
-	if(*target >> 7)
+	val = mem ? read_mem(cpu->vm, addr) : cpu->a;
+
+	if(val >> 7)
 		SET_FLAG(FLAG_CARRY);
 	else
 		CLEAR_FLAG(FLAG_CARRY);
 
-	*target = *target << 1;
+	val = val << 1;
 
-	flip_flags(cpu, *target);
+	rmw_store(cpu, mem, addr, val);
+	flip_flags(cpu, val);
 	return RET_OK;
 }
 
 static int dec(cpu_6502_t *cpu, int *cyc) {
-	uint8_t *target;
+	uint16_t addr = 0;
+	uint8_t val;
+	int mem = 1;
 
 	switch(cpu->ir) {
 		case 0xc6:	/* DEC $xx */
-			target = get_pointer(cpu->vm, cpu->arg);
+			addr = cpu->arg;
 			*cyc=5; break;
 
 		case 0xd6:	/* DEC $xx, X */
-			target = get_pointer(cpu->vm, cpu->arg + cpu->x);
+			addr = (cpu->arg + cpu->x) & 0xff;
 			*cyc=6; break;
 
 		case 0xce:	/* DEC $xxxx */
-			target = get_pointer(cpu->vm, cpu->arg);
+			addr = cpu->arg;
 			*cyc=6; break;
 
 		case 0xde:	/* DEC $xxxx, X */
-			target = get_pointer(cpu->vm, cpu->arg + cpu->x);
+			addr = cpu->arg + cpu->x;
 			*cyc=7; break;
 
 		default:
 			return RET_ERR_INSTR;
 	}
 
-	(*target)--;
-	flip_flags(cpu, *target);
+	val = mem ? read_mem(cpu->vm, addr) : cpu->a;
+
+	val--;
+	rmw_store(cpu, mem, addr, val);
+	flip_flags(cpu, val);
 	return RET_OK;
 }
 
 static int inc(cpu_6502_t *cpu, int *cyc) {
-	uint8_t *target = NULL;
+	uint16_t addr = 0;
+	uint8_t val;
+	int mem = 1;
 
 	switch(cpu->ir) {
 		case 0xe6:	/* INC $xx */
-			target = get_pointer(cpu->vm, cpu->arg);
+			addr = cpu->arg;
 			*cyc=5; break;
 
 		case 0xf6:	/* INC $xx, X */
-			target = get_pointer(cpu->vm, cpu->arg + cpu->x);
+			addr = (cpu->arg + cpu->x) & 0xff;
 			*cyc=6; break;
 
 		case 0xee:	/* INC $xxxx */
-			target = get_pointer(cpu->vm, cpu->arg);
+			addr = cpu->arg;
 			*cyc=6; break;
 
 		case 0xfe:	/* INC $xxxx, X */
-			target = get_pointer(cpu->vm, cpu->arg + cpu->x);
+			addr = cpu->arg + cpu->x;
 			*cyc=7; break;
 
 		default:
 			return RET_ERR_INSTR;
 	}
 
-	(*target)++;
-	flip_flags(cpu, *target);
+	val = mem ? read_mem(cpu->vm, addr) : cpu->a;
+
+	val++;
+	rmw_store(cpu, mem, addr, val);
+	flip_flags(cpu, val);
 	return RET_OK;
 }
 
 static int lsr(cpu_6502_t *cpu, int *cyc) {
-	uint8_t *target;
+	uint16_t addr = 0;
+	uint8_t val;
+	int mem = 1;
 	
 	switch(cpu->ir) {
 		case 0x4a:	/* LSR A */
-			target = &(cpu->a);
+			mem = 0;
 			*cyc=2; break;
 
 		case 0x46:	/* LSR $xx */
-			target = get_pointer(cpu->vm, cpu->arg);
+			addr = cpu->arg;
 			*cyc=5; break;
 
 		case 0x56:	/* LSR $xx, X */
-			target = get_pointer(cpu->vm, cpu->arg + cpu->x);
+			addr = (cpu->arg + cpu->x) & 0xff;
 			*cyc=6; break;
 
 		case 0x4e:	/* LSR $xxxx */
-			target = get_pointer(cpu->vm, cpu->arg);
+			addr = cpu->arg;
 			*cyc=6; break;
 
 		case 0x5e:	/* LSR $xxxx, X */
-			target = get_pointer(cpu->vm, cpu->arg + cpu->x);
+			addr = cpu->arg + cpu->x;
 			*cyc=7; break;
 
 		default:
 			return RET_ERR_INSTR;
 	}
 
-	if(*target & 0x01)
+	val = mem ? read_mem(cpu->vm, addr) : cpu->a;
+
+	if(val & 0x01)
 		SET_FLAG(FLAG_CARRY);
 	else
 		CLEAR_FLAG(FLAG_CARRY);
 
-	*target = *target >> 1;
-	flip_flags(cpu, *target);
+	val = val >> 1;
+	rmw_store(cpu, mem, addr, val);
+	flip_flags(cpu, val);
 
 	return RET_OK;
 }
 
 static int rol(cpu_6502_t *cpu, int *cyc) {
-	uint8_t *target;
+	uint16_t addr = 0;
+	uint8_t val;
+	int mem = 1;
 	int carry_in;
 	
 	switch(cpu->ir) {
 		case 0x2a:	/* ROL A */
-			target = &(cpu->a);
+			mem = 0;
 			*cyc=2; break;
 
 		case 0x26:	/* ROL $xx */
-			target = get_pointer(cpu->vm, cpu->arg);
+			addr = cpu->arg;
 			*cyc=5; break;
 
 		case 0x36:	/* ROL $xx, X */
-			target = get_pointer(cpu->vm, cpu->arg + cpu->x);
+			addr = (cpu->arg + cpu->x) & 0xff;
 			*cyc=6; break;
 
 		case 0x2e:	/* ROL $xxxx */
-			target = get_pointer(cpu->vm, cpu->arg);
+			addr = cpu->arg;
 			*cyc=6; break;
 
 		case 0x3e:	/* ROL $xxxx, X */
-			target = get_pointer(cpu->vm, cpu->arg + cpu->x);
+			addr = cpu->arg + cpu->x;
 			*cyc=7; break;
 
 		default:
 			return RET_ERR_INSTR;
 	}
 
+	val = mem ? read_mem(cpu->vm, addr) : cpu->a;
+
 	carry_in = QUERY_FLAG(FLAG_CARRY) ? 1 : 0;
 
-	if(*target >> 7)
+	if(val >> 7)
 		SET_FLAG(FLAG_CARRY);
 	else
 		CLEAR_FLAG(FLAG_CARRY);
 
-	*target = *target << 1;
-	*target |= carry_in;
-	flip_flags(cpu, *target);
+	val = val << 1;
+	val |= carry_in;
+	rmw_store(cpu, mem, addr, val);
+	flip_flags(cpu, val);
 
 	return RET_OK;
 }
 
 static int ror(cpu_6502_t *cpu, int *cyc) {
-	uint8_t *target;
+	uint16_t addr = 0;
+	uint8_t val;
+	int mem = 1;
 	int carry_in;
 	
 	switch(cpu->ir) {
 		case 0x6a:	/* ROR A */
-			target = &(cpu->a);						
+			mem = 0;
 			*cyc=2; break;
 
 		case 0x66:	/* ROR $xx */
-			target = get_pointer(cpu->vm, cpu->arg);
+			addr = cpu->arg;
 			*cyc=5; break;
 
 		case 0x76:	/* ROR $xx, X */
-			target = get_pointer(cpu->vm, cpu->arg + cpu->x);
+			addr = (cpu->arg + cpu->x) & 0xff;
 			*cyc=6; break;
 
 		case 0x6e:	/* ROR $xxxx */
-			target = get_pointer(cpu->vm, cpu->arg);
+			addr = cpu->arg;
 			*cyc=6; break;
 
 		case 0x7e:	/* ROR $xxxx, X */
-			target = get_pointer(cpu->vm, cpu->arg + cpu->x);
+			addr = cpu->arg + cpu->x;
 			*cyc=7; break;
 
 		default:
 			return RET_ERR_INSTR;
 	}
 
+	val = mem ? read_mem(cpu->vm, addr) : cpu->a;
+
 	carry_in = QUERY_FLAG(FLAG_CARRY) ? 1 : 0;
 
-	if(*target & 0x01)
+	if(val & 0x01)
 		SET_FLAG(FLAG_CARRY);
 	else
 		CLEAR_FLAG(FLAG_CARRY);
 
-	*target = *target >> 1;
-	*target |= (carry_in << 7);
-	flip_flags(cpu, *target);
+	val = val >> 1;
+	val |= (carry_in << 7);
+	rmw_store(cpu, mem, addr, val);
+	flip_flags(cpu, val);
 
 	return RET_OK;
 }
 
 /* Simple instructions */
 static int adc(cpu_6502_t *cpu, int *cyc) {
-	void (*addfunc)(cpu_6502_t*, uint8_t);
 	uint8_t operand;
-
-	if(QUERY_FLAG(FLAG_DECIMAL)) 
-		addfunc = adc_decimal;
-	else
-		addfunc = adc_binary;
+	uint16_t ptr;
 
 	switch(cpu->ir) {
 		case 0x69:	/* ADC #$xx */
@@ -420,31 +403,32 @@ static int adc(cpu_6502_t *cpu, int *cyc) {
 
 		case 0x7d:	/* ADC $xxxx, X */
 			operand = read_mem(cpu->vm, cpu->arg + cpu->x);
-			*cyc=4; break;	/**/
+			*cyc=4 + crossed(cpu->arg, cpu->x); break;
 
 		case 0x79:	/* ADC $xxxx, Y */
 			operand = read_mem(cpu->vm, cpu->arg + cpu->y);
-			*cyc=4; break;	/**/
+			*cyc=4 + crossed(cpu->arg, cpu->y); break;
 
 		case 0x61:	/* ADC ($xx, X) */
 			operand = read_mem(cpu->vm, read_ptr_zp(cpu->vm, cpu->arg + cpu->x));
 			*cyc=6; break;
 
 		case 0x71:	/* ADC ($xx), Y */
-			operand = read_mem(cpu->vm, read_ptr_zp(cpu->vm, cpu->arg) + cpu->y);
-			*cyc=5; break;	/**/
+			ptr = read_ptr_zp(cpu->vm, cpu->arg);
+			operand = read_mem(cpu->vm, ptr + cpu->y);
+			*cyc=5 + crossed(ptr, cpu->y); break;
 
 		default:
 			return RET_ERR_INSTR;
 	}
 
-	addfunc(cpu, operand);
-	flip_flags(cpu, cpu->a);
+	cpu->a = alu_adc(cpu->a, operand, &cpu->flags);
 	return RET_OK;
 }
 
 static int and(cpu_6502_t *cpu, int *cyc) {
 	uint8_t operand;
+	uint16_t ptr;
 
 	switch(cpu->ir) {
 		case 0x29:	/* AND #$xx */
@@ -465,19 +449,20 @@ static int and(cpu_6502_t *cpu, int *cyc) {
 
 		case 0x3d:	/* AND $xxxx, X */
 			operand = read_mem(cpu->vm, cpu->arg + cpu->x);
-			*cyc=4; break;	/**/
+			*cyc=4 + crossed(cpu->arg, cpu->x); break;
 
 		case 0x39:	/* AND $xxxx, Y */
 			operand = read_mem(cpu->vm, cpu->arg + cpu->y);
-			*cyc=4; break;	/**/
+			*cyc=4 + crossed(cpu->arg, cpu->y); break;
 
 		case 0x21:	/* AND ($xx, X) */
 			operand = read_mem(cpu->vm, read_ptr_zp(cpu->vm, cpu->arg8 + cpu->x));
 			*cyc=6; break;
 
 		case 0x31:	/* AND ($xx), Y */
-			operand = read_mem(cpu->vm, read_ptr_zp(cpu->vm, cpu->arg) + cpu->y);
-			*cyc=5; break;	/**/
+			ptr = read_ptr_zp(cpu->vm, cpu->arg);
+			operand = read_mem(cpu->vm, ptr + cpu->y);
+			*cyc=5 + crossed(ptr, cpu->y); break;
 
 		default:
 			return RET_ERR_INSTR;
@@ -525,6 +510,7 @@ static int bit(cpu_6502_t *cpu, int *cyc) {
 static int bra(cpu_6502_t *cpu, int *cyc) {
 	int taken = 0;
 	int8_t distance = cpu->arg8;
+	uint16_t target;
 
 	switch(cpu->ir) {
 		case 0x10: /* BPL */
@@ -555,24 +541,25 @@ static int bra(cpu_6502_t *cpu, int *cyc) {
 			return RET_ERR_INSTR;
 	}
 	
-	*cyc = 2; /**/
+	*cyc = 2;
 	if(taken) {
-		*cyc++;
-		cpu->pc += distance + 2;
+		target = cpu->pc + 2 + distance;
+		*cyc += (((cpu->pc + 2) ^ target) & 0xff00) ? 2 : 1;
+		cpu->pc = target;
 		return RET_JUMP;
 	}
 	return RET_OK;
 }
 
 static int brk(cpu_6502_t *cpu, int *cyc) {
-	if(cpu->ir != 0x00) return RET_ERR_INSTR;
-	SET_FLAG(FLAG_BREAK);
+	if(cpu->ir != 0x00) return RET_ERR_INSTR;	/* BRK */
 
-	return interrupt(cpu, BRK_VECTOR, cyc);
+	return interrupt(cpu, BRK_VECTOR, cpu->pc + 2, FLAG_BREAK, cyc);
 }
 
 static int cmp(cpu_6502_t *cpu, int *cyc) {
 	uint8_t target;
+	uint16_t ptr;
 
 	switch(cpu->ir) {
 		case 0xc9:	/* CMP #$xx */
@@ -593,19 +580,20 @@ static int cmp(cpu_6502_t *cpu, int *cyc) {
 
 		case 0xdd:	/* CMP $xxxx, X */
 			target = read_mem(cpu->vm, cpu->arg + cpu->x); 
-			*cyc=4; break; /**/
+			*cyc=4 + crossed(cpu->arg, cpu->x); break;
 
 		case 0xd9:	/* CMP $xxxx, Y */
 			target = read_mem(cpu->vm, cpu->arg + cpu->y); 
-			*cyc=4; break; /**/
+			*cyc=4 + crossed(cpu->arg, cpu->y); break;
 
 		case 0xc1:	/* CMP ($xx, X) */
 			target = read_mem(cpu->vm, read_ptr_zp(cpu->vm, cpu->arg + cpu->x));
 			*cyc=6; break;
 
 		case 0xd1:	/* CMP ($xx), Y */
-			target = read_mem(cpu->vm, read_ptr_zp(cpu->vm, cpu->arg) + cpu->y);
-			*cyc=5; break; /**/
+			ptr = read_ptr_zp(cpu->vm, cpu->arg);
+			target = read_mem(cpu->vm, ptr + cpu->y);
+			*cyc=5 + crossed(ptr, cpu->y); break;
 
 		default:
 			return RET_ERR_INSTR;
@@ -665,6 +653,7 @@ static int cpy(cpu_6502_t *cpu, int *cyc) {
 
 static int eor(cpu_6502_t *cpu, int *cyc) {
 	uint8_t operand;
+	uint16_t ptr;
 
 	switch(cpu->ir) {
 		case 0x49:	/* EOR #$xx */
@@ -685,19 +674,20 @@ static int eor(cpu_6502_t *cpu, int *cyc) {
 
 		case 0x5d:	/* EOR $xxxx, X */
 			operand = read_mem(cpu->vm, cpu->arg + cpu->x);
-			*cyc=4; break;	/**/
+			*cyc=4 + crossed(cpu->arg, cpu->x); break;
 
 		case 0x59:	/* EOR $xxxx, Y */
 			operand = read_mem(cpu->vm, cpu->arg + cpu->y);
-			*cyc=4; break;	/**/
+			*cyc=4 + crossed(cpu->arg, cpu->y); break;
 
 		case 0x41:	/* EOR ($xx, X) */
 			operand = read_mem(cpu->vm, read_ptr_zp(cpu->vm, cpu->arg + cpu->x));
 			*cyc=6; break;
 
 		case 0x51:	/* EOR ($xx), Y */
-			operand = read_mem(cpu->vm, read_ptr_zp(cpu->vm, cpu->arg) + cpu->y);
-			*cyc=5; break;	/**/
+			ptr = read_ptr_zp(cpu->vm, cpu->arg);
+			operand = read_mem(cpu->vm, ptr + cpu->y);
+			*cyc=5 + crossed(ptr, cpu->y); break;
 
 		default:
 			return RET_ERR_INSTR;
@@ -767,7 +757,7 @@ static int jmp(cpu_6502_t *cpu, int *cyc) {
 }
 
 static int jsr(cpu_6502_t *cpu, int *cyc) {
-	if(cpu->ir != 0x20) return RET_ERR_INSTR;
+	if(cpu->ir != 0x20) return RET_ERR_INSTR;	/* JSR $xxxx */
 
 	cpu->pc += 2;
 	push(cpu, (cpu->pc >> 8) & 0xff);
@@ -779,6 +769,8 @@ static int jsr(cpu_6502_t *cpu, int *cyc) {
 }
 
 static int lda(cpu_6502_t *cpu, int *cyc) {
+	uint16_t ptr;
+
 	switch(cpu->ir) {
 		case 0xa9:	/* LDA #$xx */
 			cpu->a = cpu->arg8;
@@ -798,19 +790,20 @@ static int lda(cpu_6502_t *cpu, int *cyc) {
 
 		case 0xbd:	/* LDA $xxxx, X */
 			cpu->a = read_mem(cpu->vm, cpu->arg + cpu->x);
-			*cyc=4; break; /**/
+			*cyc=4 + crossed(cpu->arg, cpu->x); break;
 
 		case 0xb9:	/* LDA $xxxx, Y */
 			cpu->a = read_mem(cpu->vm, cpu->arg + cpu->y);
-			*cyc=4; break; /**/
+			*cyc=4 + crossed(cpu->arg, cpu->y); break;
 
 		case 0xa1:	/* LDA ($xx, X) */
 			cpu->a = read_mem(cpu->vm, read_ptr_zp(cpu->vm, cpu->arg + cpu->x));
 			*cyc=6; break;
 
 		case 0xb1:	/* LDA ($xx), Y */
-			cpu->a = read_mem(cpu->vm, read_ptr_zp(cpu->vm, cpu->arg) + cpu->y);
-			*cyc=5; break; /**/
+			ptr = read_ptr_zp(cpu->vm, cpu->arg);
+			cpu->a = read_mem(cpu->vm, ptr + cpu->y);
+			*cyc=5 + crossed(ptr, cpu->y); break;
 
 		default:
 			return RET_ERR_INSTR;
@@ -840,7 +833,7 @@ static int ldx(cpu_6502_t *cpu, int *cyc) {
 
 		case 0xbe:	/* LDX $xxxx, Y */
 			cpu->x = read_mem(cpu->vm, cpu->arg + cpu->y);
-			*cyc=4; break; /**/
+			*cyc=4 + crossed(cpu->arg, cpu->y); break;
 
 		default:
 			return RET_ERR_INSTR;
@@ -870,7 +863,7 @@ static int ldy(cpu_6502_t *cpu, int *cyc) {
 
 		case 0xbc:	/* LDY $xxxx, X */
 			cpu->y = read_mem(cpu->vm, cpu->arg + cpu->x);
-			*cyc=4; break; /**/
+			*cyc=4 + crossed(cpu->arg, cpu->x); break;
 
 		default:
 			return RET_ERR_INSTR;
@@ -881,13 +874,14 @@ static int ldy(cpu_6502_t *cpu, int *cyc) {
 }
 
 static int nop(cpu_6502_t *cpu, int *cyc) {
-	if(cpu->ir != 0xea) return RET_ERR_INSTR;
+	if(cpu->ir != 0xea) return RET_ERR_INSTR;	/* NOP */
 	*cyc=2;
 	return RET_OK;
 }
 
 static int ora(cpu_6502_t *cpu, int *cyc) {
 	uint8_t operand;
+	uint16_t ptr;
 
 	switch(cpu->ir) {
 		case 0x09:	/* ORA #$xx */
@@ -908,19 +902,20 @@ static int ora(cpu_6502_t *cpu, int *cyc) {
 
 		case 0x1d:	/* ORA $xxxx, X */
 			operand = read_mem(cpu->vm, cpu->arg + cpu->x);
-			*cyc=4; break;	/**/
+			*cyc=4 + crossed(cpu->arg, cpu->x); break;
 
 		case 0x19:	/* ORA $xxxx, Y */
 			operand = read_mem(cpu->vm, cpu->arg + cpu->y);
-			*cyc=4; break;	/**/
+			*cyc=4 + crossed(cpu->arg, cpu->y); break;
 
 		case 0x01:	/* ORA ($xx, X) */
 			operand = read_mem(cpu->vm, read_ptr_zp(cpu->vm, cpu->arg + cpu->x));
 			*cyc=6; break;
 
 		case 0x11:	/* ORA ($xx), Y */
-			operand = read_mem(cpu->vm, read_ptr_zp(cpu->vm, cpu->arg) + cpu->y);
-			*cyc=5; break;	/**/
+			ptr = read_ptr_zp(cpu->vm, cpu->arg);
+			operand = read_mem(cpu->vm, ptr + cpu->y);
+			*cyc=5 + crossed(ptr, cpu->y); break;
 
 		default:
 			return RET_ERR_INSTR;
@@ -985,13 +980,16 @@ static int rti(cpu_6502_t *cpu, int *cyc) {
 	uint8_t hi, lo;
 	uint16_t addr;
 
-	if(cpu->ir != 0x40) return RET_ERR_INSTR;
+	if(cpu->ir != 0x40) return RET_ERR_INSTR;	/* RTI */
 	*cyc = 6;
 
 	pull(cpu, &(cpu->flags));
 	pull(cpu, &lo);
 	pull(cpu, &hi);
 
+	/* The only instruction that changes I before the poll */
+	cpu->poll_flags = cpu->flags;
+
 	addr = hi << 8 | lo;
 	cpu->pc = addr;
 
@@ -1002,7 +1000,7 @@ static int rts(cpu_6502_t *cpu, int *cyc) {
 	uint8_t hi, lo;
 	uint16_t addr;
 
-	if(cpu->ir != 0x60) return RET_ERR_INSTR;
+	if(cpu->ir != 0x60) return RET_ERR_INSTR;	/* RTS */
 	*cyc = 6;
 
 	pull(cpu, &lo);
@@ -1015,12 +1013,7 @@ static int rts(cpu_6502_t *cpu, int *cyc) {
 
 static int sbc(cpu_6502_t *cpu, int *cyc) {
 	uint8_t operand;
-	void (*subfunc)(cpu_6502_t*, uint8_t);
-
-	if(QUERY_FLAG(FLAG_DECIMAL))
-		subfunc = sbc_decimal;
-	else
-		subfunc = sbc_binary;
+	uint16_t ptr;
 
 	switch(cpu->ir) {
 		case 0xe9:	/* SBC #$xx */
@@ -1041,26 +1034,26 @@ static int sbc(cpu_6502_t *cpu, int *cyc) {
 
 		case 0xfd:	/* SBC $xxxx, X */
 			operand = read_mem(cpu->vm, cpu->arg + cpu->x);
-			*cyc=4; break;	/**/
+			*cyc=4 + crossed(cpu->arg, cpu->x); break;
 
 		case 0xf9:	/* SBC $xxxx, Y */
 			operand = read_mem(cpu->vm, cpu->arg + cpu->y);
-			*cyc=4; break;	/**/
+			*cyc=4 + crossed(cpu->arg, cpu->y); break;
 
 		case 0xe1:	/* SBC ($xx, X) */
 			operand = read_mem(cpu->vm, read_ptr_zp(cpu->vm, cpu->arg + cpu->x));
 			*cyc=6; break;
 
 		case 0xf1:	/* SBC ($xx), Y */
-			operand = read_mem(cpu->vm, read_ptr_zp(cpu->vm, cpu->arg) + cpu->y);
-			*cyc=5; break;	/**/
+			ptr = read_ptr_zp(cpu->vm, cpu->arg);
+			operand = read_mem(cpu->vm, ptr + cpu->y);
+			*cyc=5 + crossed(ptr, cpu->y); break;
 
 		default:
 			return RET_ERR_INSTR;
 	}
 
-	subfunc(cpu, operand);
-	flip_flags(cpu, cpu->a);
+	cpu->a = alu_sbc(cpu->a, operand, &cpu->flags);
 	return RET_OK;
 }
 
@@ -1183,6 +1176,7 @@ static int sty(cpu_6502_t *cpu, int *cyc) {
 
 /* Illegal instruction */
 static int x(cpu_6502_t *cpu, int *cyc) {
+	*cyc = 2;
 	return RET_ERR_INSTR;
 }
 
@@ -1244,37 +1238,77 @@ void cpu_6502_reset(cpu_6502_t *cpu) {
 	cpu->x = 0;
 	cpu->y = 0;
 	cpu->sp = 0xff;
-	cpu->flags = FLAG_RESERVED;
+	cpu->flags = FLAG_RESERVED | FLAG_INTERRUPT;
+	cpu->poll_flags = cpu->flags;
 
 	cpu->pc = read_ptr(cpu->vm, RES_VECTOR);
 }
 
 void cpu_6502_fetch_instr(cpu_6502_t *cpu) {
-	cpu->ir = read_mem(cpu->vm, cpu->pc);
+	vm_t *vm = cpu->vm;
+
+	if(vm->cov_exec)
+		COV_MARK(vm->cov_exec, cpu->pc);
+
+	if(vm->heat_fetch)
+		HEAT_COUNT(vm->heat_fetch, cpu->pc);
+
+	cpu->ir = read_mem(vm, cpu->pc);
 
-	cpu->arg = read_mem(cpu->vm, (cpu->pc + 1) & 0xffff);
+	cpu->arg = read_mem(vm, (cpu->pc + 1) & 0xffff);
 
 	if(len[cpu->ir] == 3)
-		cpu->arg |= read_mem(cpu->vm, (cpu->pc + 2) & 0xffff) << 8;
+		cpu->arg |= read_mem(vm, (cpu->pc + 2) & 0xffff) << 8;
 }
 
 int cpu_6502_exec_instr(cpu_6502_t *cpu, int *cyc) {
 	int status;
+#ifdef CPU_PROFILE
+	uint16_t pc = cpu->pc;
+#endif
 
+	/* Interrupts are polled in the last cycle, before CLI, SEI and PLP
+	 * have changed I. */
+	cpu->poll_flags = cpu->flags;
 	status = instr_table[cpu->ir](cpu, cyc);
 
 	if(status != RET_JUMP)
 		cpu->pc += len[cpu->ir];
 
+#ifdef CPU_PROFILE
+	profile_instr(cpu->ir, pc, *cyc);
+	callgraph_instr(cpu->ir, pc, cpu->pc, cpu->sp, *cyc);
+#endif
+
 	return status;
 }
 
 int cpu_6502_nmi(cpu_6502_t *cpu, int *cyc) {
-	return interrupt(cpu, NMI_VECTOR, cyc);
+	int status = interrupt(cpu, NMI_VECTOR, cpu->pc, 0, cyc);
+
+#ifdef CPU_PROFILE
+	callgraph_interrupt(cpu->pc, cpu->sp, *cyc);
+#endif
+
+	return status;
 }
 
+/* RET_OK and no cycles if I masked the IRQ at the last poll. */
 int cpu_6502_irq(cpu_6502_t *cpu, int *cyc) {
-	return interrupt(cpu, BRK_VECTOR, cyc);
+	int status;
+
+	if(cpu->poll_flags & FLAG_INTERRUPT) {
+		*cyc = 0;
+		return RET_OK;
+	}
+
+	status = interrupt(cpu, BRK_VECTOR, cpu->pc, 0, cyc);
+
+#ifdef CPU_PROFILE
+	callgraph_interrupt(cpu->pc, cpu->sp, *cyc);
+#endif
+
+	return status;
 }
 
 uint16_t cpu_6502_get_pc(cpu_6502_t *cpu) {
@@ -1304,9 +1338,13 @@ int cpu_6502_count_instr(void) {
 
 #define FLAG_DISP(flag, sym) ((cpu->flags & (flag)) ? sym : '-')
 
-void cpu_6502_print_state(cpu_6502_t *cpu, const uint32_t step) {
-	printf("ST: %8d PC: %04x I: %02x A: %02x X: %02x Y: %02x SP: 01%02x [%c%c%c%c%c%c%c%c]\n", 
-		step, cpu->pc, read_mem(cpu->vm, cpu->pc), 
+/* Reads the opcode past the bus: showing the state mustn't mark
+ * coverage, count in the heatmap or trip a watchpoint. */
+void cpu_6502_print_state(cpu_6502_t *cpu, const uint64_t step) {
+	vm_t *vm = cpu->vm;
+
+	printf("ST: %8llu PC: %04x I: %02x A: %02x X: %02x Y: %02x SP: 01%02x [%c%c%c%c%c%c%c%c]\n", 
+		(unsigned long long)step, cpu->pc, vm->mem[cpu->pc], 
 		cpu->a, cpu->x, cpu->y, cpu->sp,
 		FLAG_DISP(FLAG_NEGATIVE, 'N'),
 		FLAG_DISP(FLAG_OVERFLOW, 'V'),
@@ -1318,4 +1356,44 @@ void cpu_6502_print_state(cpu_6502_t *cpu, const uint32_t step) {
 		FLAG_DISP(FLAG_CARRY, 'C'));
 }
 
-DEF_CPU_INTERFACE(cpu_6502, cpu_6502_init, cpu_6502_quit, cpu_6502_reset, cpu_6502_fetch_instr, cpu_6502_exec_instr, cpu_6502_nmi, cpu_6502_irq, cpu_6502_get_pc, cpu_6502_set_pc, cpu_6502_print_state);
\ No newline at end of file
+void cpu_6502_get_regs(cpu_6502_t *cpu, cpu_regs_t *regs) {
+	regs->pc = cpu->pc;
+	regs->a = cpu->a;
+	regs->x = cpu->x;
+	regs->y = cpu->y;
+	regs->sp = cpu->sp;
+	regs->flags = cpu->flags;
+}
+
+#define STATE_SIZE	10
+
+size_t cpu_6502_save_state(cpu_6502_t *cpu, uint8_t *buf) {
+	if(buf == NULL)
+		return STATE_SIZE;
+
+	put_u8(&buf, cpu->flags);
+	put_u16(&buf, cpu->pc);
+	put_u8(&buf, cpu->sp);
+	put_u8(&buf, cpu->ir);
+	put_u16(&buf, cpu->arg);
+	put_u8(&buf, cpu->a);
+	put_u8(&buf, cpu->x);
+	put_u8(&buf, cpu->y);
+
+	return STATE_SIZE;
+}
+
+void cpu_6502_load_state(cpu_6502_t *cpu, const uint8_t *buf) {
+	cpu->flags = get_u8(&buf);
+	cpu->pc = get_u16(&buf);
+	cpu->sp = get_u8(&buf);
+	cpu->ir = get_u8(&buf);
+	cpu->arg = get_u16(&buf);
+	cpu->a = get_u8(&buf);
+	cpu->x = get_u8(&buf);
+	cpu->y = get_u8(&buf);
+
+	cpu->poll_flags = cpu->flags;
+}
+
+DEF_CPU_INTERFACE(cpu_6502, cpu_6502_init, cpu_6502_quit, cpu_6502_reset, cpu_6502_fetch_instr, cpu_6502_exec_instr, cpu_6502_nmi, cpu_6502_irq, cpu_6502_get_pc, cpu_6502_set_pc, cpu_6502_print_state, cpu_6502_get_regs, cpu_6502_save_state, cpu_6502_load_state);
\ No newline at end of file
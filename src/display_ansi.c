@@ -0,0 +1,52 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Streams the guest's output to stdout and leaves scrolling and the
+ * cursor to the terminal. Output is flushed once per frame. */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "leakcheck.h"
+
+#include "display.h"
+#include "status.h"
+
+#define ANSI_CLEAR	"\x1b[2J\x1b[H"
+
+static int pending;
+
+static int ansi_init(void) {
+	pending = 0;
+	return RET_OK;
+}
+
+static void ansi_quit(void) {
+	fputs("\n", stdout);
+	fflush(stdout);
+}
+
+static void ansi_reset(void) {
+	fputs(ANSI_CLEAR, stdout);
+	pending = 1;
+}
+
+static void ansi_putc(const uint8_t c) {
+	if(c == '\r')
+		fputs("\n", stdout);
+	else
+		putchar(c);
+
+	pending = 1;
+}
+
+static void ansi_frame(const screen_t *screen, const int changed) {
+	if(pending) {
+		fflush(stdout);
+		pending = 0;
+	}
+}
+
+DEF_DISPLAY_INTERFACE(display_ansi, "ansi", ansi_init, ansi_quit, ansi_reset, ansi_putc, ansi_frame);
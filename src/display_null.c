@@ -0,0 +1,24 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* No output at all. The PIA still keeps the screen cells, so they end up
+ * in machine images, but nothing is ever rendered. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "leakcheck.h"
+
+#include "display.h"
+#include "status.h"
+
+static int null_init(void) {
+	return RET_OK;
+}
+
+static void null_quit(void) {
+}
+
+DEF_DISPLAY_INTERFACE(display_null, "null", null_init, null_quit, NULL, NULL, NULL);
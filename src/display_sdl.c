@@ -0,0 +1,391 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* The window belongs to a render thread running at the display refresh
+ * rate. It is also the producer of the input ring, since SDL delivers
+ * events to the thread that owns the window.
+ *
+ * The emulator thread publishes the screen once per frame into a seqlock
+ * protected copy and never waits on the renderer: it bumps the sequence
+ * to odd, copies the cells and bumps it back to even. The render thread
+ * retries its copy if it saw an odd or changed sequence.
+ *
+ * Rows whose generation changed, or that hold the blinking cursor, are
+ * rasterized into a software framebuffer laid out by ring slot, which is
+ * uploaded to a single streaming texture. Scrolling never touches the
+ * framebuffer: the texture is drawn in two parts split at the top slot.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "leakcheck.h"
+
+#include "display.h"
+#include "input.h"
+#include "status.h"
+
+#define CHAR_WIDTH	6
+#define CHAR_HEIGHT 8
+#define CHAR_COL_R	0xff
+#define CHAR_COL_G	0xff
+#define CHAR_COL_B	0xff
+
+#define SCR_SCALE	2
+
+#define FB_WIDTH	(CHAR_WIDTH * SCR_COLS)
+#define FB_HEIGHT	(CHAR_HEIGHT * SCR_ROWS)
+
+#define SCR_WIDTH	(FB_WIDTH * SCR_SCALE)
+#define SCR_HEIGHT	(FB_HEIGHT * SCR_SCALE)
+
+#define SCR_TITLE	"A1 Console"
+
+#define BLINK_DELAY		400
+#define REFRESH_RATE	60
+
+#define CSR_CHAR		'@'		/* For more authenticity */
+//#define CSR_CHAR		'_'		/* For more beauticity */
+
+typedef struct vidinfo_t {
+	SDL_Window *window;
+	SDL_Renderer *renderer;
+	SDL_Texture *texture;
+	uint8_t font[128][CHAR_HEIGHT];
+	uint32_t pixel_on, pixel_off;
+	int last_blink, show_cursor;
+
+	uint32_t drawn[SCR_ROWS];		/* Generation of each rasterized slot */
+	uint32_t cursor_slot;
+	uint32_t fb[FB_WIDTH * FB_HEIGHT];
+
+	SDL_Thread *thread;
+	SDL_mutex *lock;
+	SDL_cond *cond;
+	int started, status;
+	SDL_atomic_t quit;
+
+	SDL_atomic_t seq;
+	screen_t shared;		/* Written by the emulator, under seq */
+	screen_t local;			/* Render thread's copy */
+} vidinfo_t;
+
+static vidinfo_t *video;
+
+static int load_charmap(const char *filename) {
+	FILE *fp = fopen(filename, "rb");
+	SDL_PixelFormat *format;
+
+	if(fp == NULL) 
+		return RET_ERR_OPEN;
+
+	if(fread(video->font, sizeof(video->font), 1, fp) != 1) {
+		fclose(fp);
+		return RET_ERR_OPEN;
+	}
+	fclose(fp);
+
+	if((format = SDL_AllocFormat(SDL_GetWindowPixelFormat(video->window))) == NULL)
+		return RET_ERR_SDL;
+
+	video->pixel_off = SDL_MapRGB(format, 0, 0, 0);
+	video->pixel_on = SDL_MapRGB(format, CHAR_COL_R, CHAR_COL_G, CHAR_COL_B);
+	SDL_FreeFormat(format);
+
+	return RET_OK;
+}
+
+/* Expands one glyph scanline, bit x set means pixel x is lit. */
+#ifdef USE_SSE2
+static void expand(uint32_t *dst, const uint8_t bits) {
+	const __m128i lo_mask = _mm_set_epi32(0x08, 0x04, 0x02, 0x01);
+	const __m128i hi_mask = _mm_set_epi32(0x80, 0x40, 0x20, 0x10);
+	__m128i on = _mm_set1_epi32(video->pixel_on);
+	__m128i off = _mm_set1_epi32(video->pixel_off);
+	__m128i b = _mm_set1_epi32(bits);
+	__m128i lo, hi;
+
+	lo = _mm_cmpeq_epi32(_mm_and_si128(b, lo_mask), lo_mask);
+	hi = _mm_cmpeq_epi32(_mm_and_si128(b, hi_mask), hi_mask);
+
+	lo = _mm_or_si128(_mm_and_si128(lo, on), _mm_andnot_si128(lo, off));
+	hi = _mm_or_si128(_mm_and_si128(hi, on), _mm_andnot_si128(hi, off));
+
+	_mm_storeu_si128((__m128i*)dst, lo);
+	_mm_storel_epi64((__m128i*)(dst + 4), hi);
+}
+#else
+static void expand(uint32_t *dst, const uint8_t bits) {
+	int x;
+
+	for(x = 0; x < CHAR_WIDTH; x++)
+		dst[x] = (bits & (1 << x)) ? video->pixel_on : video->pixel_off;
+}
+#endif
+
+/* Rasterizes one ring slot. cursor is the column to draw the cursor in,
+ * or -1. */
+static void raster_row(const uint32_t slot, const int cursor) {
+	const uint8_t *cells = &video->local.cell[slot * SCR_COLS];
+	uint32_t *line = &video->fb[slot * CHAR_HEIGHT * FB_WIDTH];
+	int x, y;
+	uint8_t c;
+
+	for(y = 0; y < CHAR_HEIGHT; y++) {
+		for(x = 0; x < SCR_COLS; x++) {
+			c = (x == cursor) ? '_' : cells[x] & 0x7f;
+			expand(&line[x * CHAR_WIDTH], video->font[c][y]);
+		}
+		line += FB_WIDTH;
+	}
+}
+
+/* Copies the published screen. Returns 0 if nothing changed since the
+ * last copy. */
+static int fetch_screen(int *last_seq) {
+	int seq;
+
+	for(;;) {
+		seq = SDL_AtomicGet(&video->seq);
+		if(seq == *last_seq)
+			return 0;
+
+		if(seq & 1)
+			continue;
+
+		SDL_MemoryBarrierAcquire();
+		memcpy(&video->local, &video->shared, sizeof(screen_t));
+		SDL_MemoryBarrierAcquire();
+
+		if(SDL_AtomicGet(&video->seq) == seq)
+			break;
+	}
+
+	*last_seq = seq;
+	return 1;
+}
+
+/* Redraws dirty slots, uploads the framebuffer if any were redrawn and
+ * presents it with the top slot at the top of the window. */
+static void render(const int force) {
+	screen_t *scr = &video->local;
+	uint32_t slot, cursor_slot, top_h;
+	int dirty = 0;
+	SDL_Rect src, dst;
+
+	cursor_slot = scrslot(scr, scr->row);
+
+	for(slot = 0; slot < SCR_ROWS; slot++) {
+		if(!force && video->drawn[slot] == scr->gen[slot] &&
+			slot != cursor_slot && slot != video->cursor_slot)
+			continue;
+
+		raster_row(slot, (slot == cursor_slot && video->show_cursor) ? (int)scr->col : -1);
+		video->drawn[slot] = scr->gen[slot];
+		dirty = 1;
+	}
+	video->cursor_slot = cursor_slot;
+
+	if(dirty)
+		SDL_UpdateTexture(video->texture, NULL, video->fb, FB_WIDTH * sizeof(uint32_t));
+
+	top_h = (SCR_ROWS - scr->top) * CHAR_HEIGHT;
+
+	src.x = dst.x = 0;
+	src.w = FB_WIDTH;
+	dst.w = SCR_WIDTH;
+
+	src.y = scr->top * CHAR_HEIGHT;
+	src.h = top_h;
+	dst.y = 0;
+	dst.h = top_h * SCR_SCALE;
+	SDL_RenderCopy(video->renderer, video->texture, &src, &dst);
+
+	if(scr->top) {
+		src.y = 0;
+		src.h = FB_HEIGHT - top_h;
+		dst.y = top_h * SCR_SCALE;
+		dst.h = src.h * SCR_SCALE;
+		SDL_RenderCopy(video->renderer, video->texture, &src, &dst);
+	}
+
+	SDL_RenderPresent(video->renderer);
+}
+
+static int open_window(void) {
+	int ret = RET_ERR_SDL;
+
+	if((video->window = SDL_CreateWindow(SCR_TITLE, SDL_WINDOWPOS_UNDEFINED, 
+		SDL_WINDOWPOS_UNDEFINED, SCR_WIDTH, SCR_HEIGHT, SDL_WINDOW_SHOWN)) == NULL) {
+
+		fprintf(stderr, "sdl_init(): ERROR! SDL_CreateWindow() failed: %s\n", SDL_GetError());
+		return ret;
+	}
+
+	if((video->renderer = SDL_CreateRenderer(video->window, -1, SDL_RENDERER_ACCELERATED)) == NULL) {
+		fprintf(stderr, "sdl_init(): ERROR! SDL_CreateRenderer() failed: %s\n", SDL_GetError());
+		goto freewindow;
+	}
+
+	if((ret = load_charmap("rom/a1chr.bin")) != RET_OK) {
+		goto freerenderer;
+	}
+
+	if((video->texture = SDL_CreateTexture(video->renderer, SDL_GetWindowPixelFormat(video->window),
+		SDL_TEXTUREACCESS_STREAMING, FB_WIDTH, FB_HEIGHT)) == NULL) {
+
+		fprintf(stderr, "sdl_init(): ERROR! SDL_CreateTexture() failed: %s\n", SDL_GetError());
+		ret = RET_ERR_SDL;
+		goto freerenderer;
+	}
+	
+	SDL_SetRenderDrawColor(video->renderer, 0x00, 0x00, 0x00, 0xff);
+	return RET_OK;
+
+freerenderer:
+	SDL_DestroyRenderer(video->renderer);
+freewindow:
+	SDL_DestroyWindow(video->window);
+
+	return ret;
+}
+
+static void close_window(void) {
+	SDL_DestroyTexture(video->texture);
+
+	SDL_DestroyRenderer(video->renderer);
+	SDL_DestroyWindow(video->window);
+}
+
+static int render_thread(void *data) {
+	int status, redraw, force = 1, last_seq = -1;
+	uint64_t freq, period, next, now;
+
+	status = open_window();
+
+	SDL_LockMutex(video->lock);
+	video->status = status;
+	video->started = 1;
+	SDL_CondBroadcast(video->cond);
+	SDL_UnlockMutex(video->lock);
+
+	if(status != RET_OK)
+		return status;
+
+	freq = SDL_GetPerformanceFrequency();
+	period = freq / REFRESH_RATE;
+	next = SDL_GetPerformanceCounter();
+
+	while(!SDL_AtomicGet(&video->quit)) {
+		input_pump();
+
+		redraw = fetch_screen(&last_seq);
+
+		if(SDL_GetTicks() - video->last_blink > BLINK_DELAY) {
+			video->show_cursor = video->show_cursor ? 0 : 1;
+			video->last_blink = SDL_GetTicks();
+			redraw = 1;
+		}
+
+		if(redraw || force)
+			render(force);
+		force = 0;
+
+		next += period;
+		now = SDL_GetPerformanceCounter();
+		if(now < next)
+			SDL_Delay((Uint32)((next - now) * 1000 / freq));
+		else
+			next = now;
+	}
+
+	close_window();
+	return RET_OK;
+}
+
+/* Runs on the emulator thread, only publishes the cells. */
+static void sdl_frame(const screen_t *screen, const int changed) {
+	if(!changed)
+		return;
+
+	SDL_AtomicIncRef(&video->seq);
+	SDL_MemoryBarrierRelease();
+	memcpy(&video->shared, screen, sizeof(screen_t));
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicIncRef(&video->seq);
+}
+
+static int sdl_init(void) {
+	int ret = RET_ERR_SDL;
+	
+	if((video = malloc(sizeof(vidinfo_t))) == NULL) {
+		fprintf(stderr, "sdl_init(): ERROR! malloc() failed.\n");
+		return RET_ERR_ALLOC;
+	}
+
+	memset(&video->shared, 0, sizeof(screen_t));
+	memset(&video->local, 0, sizeof(screen_t));
+	memset(video->drawn, 0, sizeof(video->drawn));
+	video->cursor_slot = 0;
+	SDL_AtomicSet(&video->seq, 0);
+	SDL_AtomicSet(&video->quit, 0);
+	video->last_blink = SDL_GetTicks();
+	video->show_cursor = 0;
+	video->started = 0;
+
+	if((video->lock = SDL_CreateMutex()) == NULL) goto freevid;
+	if((video->cond = SDL_CreateCond()) == NULL) goto freelock;
+
+	/* From now on, only the render thread pumps events. */
+	input_set_producer(1);
+
+	if((video->thread = SDL_CreateThread(render_thread, "render", NULL)) == NULL) {
+		fprintf(stderr, "sdl_init(): ERROR! SDL_CreateThread() failed: %s\n", SDL_GetError());
+		input_set_producer(0);
+		goto freecond;
+	}
+
+	SDL_LockMutex(video->lock);
+	while(!video->started)
+		SDL_CondWait(video->cond, video->lock);
+	ret = video->status;
+	SDL_UnlockMutex(video->lock);
+
+	if(ret == RET_OK)
+		return RET_OK;
+
+	input_set_producer(0);
+
+	SDL_WaitThread(video->thread, NULL);
+freecond:
+	SDL_DestroyCond(video->cond);
+freelock:
+	SDL_DestroyMutex(video->lock);
+freevid:
+	free(video);
+	video = NULL;
+
+	return ret;
+}
+
+static void sdl_quit(void) {
+	input_set_producer(0);
+	SDL_AtomicSet(&video->quit, 1);
+	SDL_WaitThread(video->thread, NULL);
+
+	SDL_DestroyCond(video->cond);
+	SDL_DestroyMutex(video->lock);
+	free(video);
+}
+
+DEF_DISPLAY_INTERFACE(display_sdl, "sdl", sdl_init, sdl_quit, NULL, NULL, sdl_frame);
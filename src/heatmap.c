@@ -0,0 +1,388 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Memory access heatmap. The memory functions count the reads and writes
+ * of every address, the CPU core the opcode fetches, in saturating 16 bit
+ * counters. Reads include fetches. The emulation thread never waits: other
+ * threads only copy the counters into a snapshot, which is exact per
+ * counter but not taken at one instant.
+ *
+ * With an interval, a writer thread replaces the file with a snapshot
+ * that often, so it can be watched while the guest runs. The last one is
+ * written on stop.
+ *
+ * Binary:	"A1HM" u16 version, then 64K u16 counters each of read, write
+ *			and fetch
+ * PNG:		256x256, one pixel per address and one row per page. Red shows
+ *			writes, green reads and blue fetches, on a log scale.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "leakcheck.h"
+
+#include "heatmap.h"
+#include "serial.h"
+#include "status.h"
+#include "vm.h"
+
+#define HM_MAGIC		"A1HM"
+#define HM_VERSION		1
+#define HM_MAPS			3		/* read, write, fetch */
+#define HM_SIZE			65536
+
+#define PNG_SIZE		256
+#define PNG_ROW			(1 + 3 * PNG_SIZE)
+#define PNG_RAW			(PNG_SIZE * PNG_ROW)
+#define STORED_MAX		65535
+
+#define OUT_BUF_SIZE	4096
+#define TOP_N			8
+
+typedef struct heatmap_t {
+	uint16_t *count;		/* Written by the emulation thread */
+	uint16_t *snap;
+	uint8_t *raw;			/* PNG scanlines */
+	char *filename, *tmpname;
+	int png, interval, error;
+
+	SDL_atomic_t quit;
+	SDL_Thread *thread;
+} heatmap_t;
+
+static heatmap_t *g_hm = NULL;
+static uint32_t crc_table[256];
+
+static void init_crc(void) {
+	uint32_t c;
+	int n, k;
+
+	for(n = 0; n < 256; n++) {
+		c = (uint32_t)n;
+		for(k = 0; k < 8; k++)
+			c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		crc_table[n] = c;
+	}
+}
+
+static uint32_t crc(uint32_t c, const uint8_t *buf, const size_t len) {
+	size_t i;
+
+	for(i = 0; i < len; i++)
+		c = crc_table[(c ^ buf[i]) & 0xff] ^ (c >> 8);
+
+	return c;
+}
+
+static uint32_t adler(const uint8_t *buf, const size_t len) {
+	uint32_t a = 1, b = 0;
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		a = (a + buf[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	return (b << 16) | a;
+}
+
+static int is_png(const char *filename) {
+	size_t len = strlen(filename);
+	const char *ext = filename + len - 4;
+	int i;
+
+	if(len < 4)
+		return 0;
+
+	for(i = 0; i < 4; i++) {
+		if((ext[i] | 0x20) != ".png"[i])
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Called from any thread. */
+static void snapshot(heatmap_t *hm) {
+	memcpy(hm->snap, hm->count, HM_MAPS * HM_SIZE * sizeof(uint16_t));
+}
+
+static void put_u32_be(uint8_t *p, const uint32_t val) {
+	p[0] = (uint8_t)(val >> 24);
+	p[1] = (uint8_t)(val >> 16);
+	p[2] = (uint8_t)(val >> 8);
+	p[3] = (uint8_t)val;
+}
+
+static int write_chunk(FILE *fp, const char *type, const uint8_t *data, const size_t len, const uint8_t *more, const size_t more_len) {
+	uint8_t hdr[8], tail[4];
+	uint32_t c;
+
+	put_u32_be(hdr, (uint32_t)(len + more_len));
+	memcpy(hdr + 4, type, 4);
+	c = crc(0xffffffff, hdr + 4, 4);
+	c = crc(c, data, len);
+	c = crc(c, more, more_len);
+	put_u32_be(tail, c ^ 0xffffffff);
+
+	if(fwrite(hdr, 8, 1, fp) != 1) return RET_ERR_IO;
+	if(len && fwrite(data, len, 1, fp) != 1) return RET_ERR_IO;
+	if(more_len && fwrite(more, more_len, 1, fp) != 1) return RET_ERR_IO;
+	if(fwrite(tail, 4, 1, fp) != 1) return RET_ERR_IO;
+
+	return RET_OK;
+}
+
+/* 0 for no accesses, then 16 steps up to 255 by the counter's bit length */
+static uint8_t level(uint16_t count) {
+	int bits = 0;
+
+	while(count) {
+		bits++;
+		count >>= 1;
+	}
+
+	return (uint8_t)(bits ? 15 + 15 * bits : 0);
+}
+
+/* Uncompressed deflate, one IDAT chunk per stored block. */
+static int write_png(heatmap_t *hm, FILE *fp) {
+	static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	const uint16_t *rd = hm->snap, *wr = hm->snap + HM_SIZE, *fe = hm->snap + 2 * HM_SIZE;
+	uint8_t ihdr[13], zhdr[2] = { 0x78, 0x01 }, blk[5], *row;
+	size_t pos, len;
+	int addr, ret;
+
+	for(addr = 0; addr < HM_SIZE; addr++) {
+		row = hm->raw + (addr >> 8) * PNG_ROW;
+		row[0] = 0;
+		row[1 + 3 * (addr & 0xff)] = level(wr[addr]);
+		row[2 + 3 * (addr & 0xff)] = level(rd[addr]);
+		row[3 + 3 * (addr & 0xff)] = level(fe[addr]);
+	}
+
+	put_u32_be(ihdr, PNG_SIZE);
+	put_u32_be(ihdr + 4, PNG_SIZE);
+	ihdr[8] = 8;		/* Bit depth */
+	ihdr[9] = 2;		/* RGB */
+	ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+	if(fwrite(sig, 8, 1, fp) != 1) return RET_ERR_IO;
+	if((ret = write_chunk(fp, "IHDR", ihdr, 13, NULL, 0)) != RET_OK) return ret;
+	if((ret = write_chunk(fp, "IDAT", zhdr, 2, NULL, 0)) != RET_OK) return ret;
+
+	for(pos = 0; pos < PNG_RAW; pos += len) {
+		len = (PNG_RAW - pos > STORED_MAX) ? STORED_MAX : PNG_RAW - pos;
+		blk[0] = (pos + len == PNG_RAW);
+		blk[1] = (uint8_t)len;
+		blk[2] = (uint8_t)(len >> 8);
+		blk[3] = (uint8_t)~len;
+		blk[4] = (uint8_t)(~len >> 8);
+		if((ret = write_chunk(fp, "IDAT", blk, 5, hm->raw + pos, len)) != RET_OK) return ret;
+	}
+
+	put_u32_be(blk, adler(hm->raw, PNG_RAW));
+	if((ret = write_chunk(fp, "IDAT", blk, 4, NULL, 0)) != RET_OK) return ret;
+
+	return write_chunk(fp, "IEND", NULL, 0, NULL, 0);
+}
+
+static int write_bin(heatmap_t *hm, FILE *fp) {
+	uint8_t buf[OUT_BUF_SIZE], *p = buf;
+	int i;
+
+	put_bytes(&p, (const uint8_t*)HM_MAGIC, 4);
+	put_u16(&p, HM_VERSION);
+
+	for(i = 0; i < HM_MAPS * HM_SIZE; i++) {
+		if(p - buf > OUT_BUF_SIZE - 2) {
+			if(fwrite(buf, p - buf, 1, fp) != 1)
+				return RET_ERR_IO;
+			p = buf;
+		}
+		put_u16(&p, hm->snap[i]);
+	}
+
+	if(fwrite(buf, p - buf, 1, fp) != 1)
+		return RET_ERR_IO;
+
+	return RET_OK;
+}
+
+/* Writes the snapshot to a temporary file and puts it in place, so
+ * nothing ever sees half a heatmap. */
+static int write_snapshot(heatmap_t *hm) {
+	FILE *fp;
+	int ret;
+
+	if((fp = fopen(hm->tmpname, "wb")) == NULL)
+		return RET_ERR_OPEN;
+
+	ret = hm->png ? write_png(hm, fp) : write_bin(hm, fp);
+
+	if(fclose(fp) != 0)
+		ret = RET_ERR_IO;
+
+	if(ret == RET_OK) {
+		remove(hm->filename);
+		if(rename(hm->tmpname, hm->filename) != 0)
+			ret = RET_ERR_IO;
+	}
+
+	return ret;
+}
+
+static int writer_thread(void *data) {
+	heatmap_t *hm = data;
+	uint32_t last = SDL_GetTicks();
+
+	while(!SDL_AtomicGet(&hm->quit)) {
+		SDL_Delay(10);
+		if(SDL_GetTicks() - last < (uint32_t)hm->interval)
+			continue;
+
+		last = SDL_GetTicks();
+		snapshot(hm);
+		if(write_snapshot(hm) != RET_OK)
+			hm->error = 1;
+	}
+
+	return 0;
+}
+
+/* interval is in ms, 0 writes the file only on stop. */
+int heatmap_start(vm_t *vm, const char *filename, const int interval) {
+	heatmap_t *hm;
+	size_t len = strlen(filename);
+	int ret = RET_ERR_ALLOC;
+
+	if((hm = malloc(sizeof(heatmap_t))) == NULL)
+		return RET_ERR_ALLOC;
+
+	hm->raw = NULL;
+	hm->thread = NULL;
+	hm->png = is_png(filename);
+	hm->interval = interval;
+	hm->error = 0;
+	SDL_AtomicSet(&hm->quit, 0);
+
+	if((hm->count = malloc(HM_MAPS * HM_SIZE * sizeof(uint16_t))) == NULL) goto freehm;
+	if((hm->snap = malloc(HM_MAPS * HM_SIZE * sizeof(uint16_t))) == NULL) goto freecount;
+	if((hm->filename = malloc(len + 1)) == NULL) goto freesnap;
+	if((hm->tmpname = malloc(len + 5)) == NULL) goto freename;
+	if(hm->png && (hm->raw = malloc(PNG_RAW)) == NULL) goto freetmp;
+
+	memset(hm->count, 0, HM_MAPS * HM_SIZE * sizeof(uint16_t));
+	strcpy(hm->filename, filename);
+	strcpy(hm->tmpname, filename);
+	strcat(hm->tmpname, ".tmp");
+	init_crc();
+
+	ret = RET_ERR_SDL;
+	if(interval && (hm->thread = SDL_CreateThread(writer_thread, "heatmap", hm)) == NULL) goto freeraw;
+
+	vm->heat_read = hm->count;
+	vm->heat_write = hm->count + HM_SIZE;
+	vm->heat_fetch = hm->count + 2 * HM_SIZE;
+	g_hm = hm;
+
+	return RET_OK;
+
+freeraw:
+	if(hm->raw)
+		free(hm->raw);
+freetmp:
+	free(hm->tmpname);
+freename:
+	free(hm->filename);
+freesnap:
+	free(hm->snap);
+freecount:
+	free(hm->count);
+freehm:
+	free(hm);
+	return ret;
+}
+
+static void print_top(FILE *fp, const char *title, const uint32_t *total, const int n, const int digits) {
+	uint32_t best;
+	uint8_t used[256];
+	int i, j, k;
+
+	memset(used, 0, sizeof(used));
+	fprintf(fp, "%s\n", title);
+
+	for(i = 0; i < TOP_N; i++) {
+		for(j = 0, k = -1, best = 0; j < n; j++) {
+			if(!used[j] && total[j] > best) {
+				best = total[j];
+				k = j;
+			}
+		}
+		if(k < 0)
+			break;
+
+		used[k] = 1;
+		fprintf(fp, "  $%0*x  %10lu\n", digits, digits == 2 ? k : k << 8, (unsigned long)best);
+	}
+}
+
+/* The pages and zero page locations with the most accesses. */
+static void print_summary(FILE *fp, const uint16_t *snap) {
+	uint32_t page[256], zp[256];
+	int addr, map;
+
+	memset(page, 0, sizeof(page));
+	memset(zp, 0, sizeof(zp));
+
+	for(map = 0; map < HM_MAPS; map++) {
+		for(addr = 0; addr < HM_SIZE; addr++) {
+			page[addr >> 8] += snap[map * HM_SIZE + addr];
+			if(addr < 256)
+				zp[addr] += snap[map * HM_SIZE + addr];
+		}
+	}
+
+	print_top(fp, "Busiest pages (reads + writes + fetches):", page, 256, 4);
+	print_top(fp, "Busiest zero page locations:", zp, 256, 2);
+}
+
+int heatmap_stop(vm_t *vm) {
+	heatmap_t *hm = g_hm;
+	int ret;
+
+	if(hm == NULL)
+		return RET_OK;
+
+	vm->heat_read = vm->heat_write = vm->heat_fetch = NULL;
+
+	if(hm->thread) {
+		SDL_AtomicSet(&hm->quit, 1);
+		SDL_WaitThread(hm->thread, NULL);
+	}
+
+	snapshot(hm);
+	ret = write_snapshot(hm);
+	if(hm->error)
+		ret = RET_ERR_IO;
+
+	print_summary(stdout, hm->snap);
+
+	if(hm->raw)
+		free(hm->raw);
+	free(hm->tmpname);
+	free(hm->filename);
+	free(hm->snap);
+	free(hm->count);
+	free(hm);
+	g_hm = NULL;
+
+	return ret;
+}
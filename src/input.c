@@ -10,171 +10,135 @@
 #include "input.h"
 #include "status.h"
 
-typedef struct input_queue_t {
-	input_t *event;
-	struct input_queue_t *next;
-} input_queue_t;
+#define INPUT_RING_SIZE		256		/* Power of two */
 
 typedef struct handler_list_t {
 	size_t n_registered, n_alloced;
 	input_proc_t *proc;
 } handler_list_t;
 
-input_queue_t *queue_start = NULL;
-input_queue_t *queue_end = NULL;
+/* Single producer, single consumer ring of fixed-size records. The
+ * producer is whichever thread owns the SDL event queue, the consumer is
+ * the emulation thread. Each side only ever writes its own index. */
+typedef struct input_ring_t {
+	input_t rec[INPUT_RING_SIZE];
+	SDL_atomic_t head;		/* Written by the producer */
+	SDL_atomic_t tail;		/* Written by the consumer */
+	SDL_atomic_t external;	/* Producer is another thread */
+} input_ring_t;
+
+static input_ring_t ring;
 
 static handler_list_t *kb_handlers;
 static handler_list_t *btn_handlers;
 static handler_list_t *move_handlers;
 
-static key_input_t *get_keys(SDL_KeyboardEvent ev, Uint32 type) {
-	key_input_t *out;
+static void get_keys(input_t *out, SDL_KeyboardEvent ev, Uint32 type) {
+	out->type = KEYBOARD;
 
-	if((out = malloc(sizeof(key_input_t))) == NULL)
-		return NULL;
-	
 	switch(type) {
-		case SDL_KEYDOWN:	out->type = DOWN;	break;
-		case SDL_KEYUP:		out->type = UP;		break;
-		default:			out->type = NONE;
+		case SDL_KEYDOWN:	out->key.type = DOWN;	break;
+		case SDL_KEYUP:		out->key.type = UP;		break;
+		default:			out->key.type = NONE;
 	}
 
-	out->Keysym = ev.keysym;
-
-	return out;
+	out->key.Keysym = ev.keysym;
 }
 
-static mouse_input_t *get_mouse_button(SDL_MouseButtonEvent ev, Uint32 type) {
-	mouse_input_t *out;
-
-	if((out = malloc(sizeof(mouse_input_t))) == NULL)
-		return NULL;
+static void get_mouse_button(input_t *out, SDL_MouseButtonEvent ev, Uint32 type) {
+	out->type = MOUSE;
 
 	switch(type) {
-		case SDL_MOUSEBUTTONUP:		out->dir = UP;		break;
-		case SDL_MOUSEBUTTONDOWN:	out->dir = DOWN;	break;
-		default:					out->dir = NONE;
+		case SDL_MOUSEBUTTONUP:		out->mouse.dir = UP;		break;
+		case SDL_MOUSEBUTTONDOWN:	out->mouse.dir = DOWN;	break;
+		default:					out->mouse.dir = NONE;
 	}
 
-	out->type = BUTTON;
-	out->Button = ev;
-
-	return out;
+	out->mouse.type = BUTTON;
+	out->mouse.Button = ev;
 }
 
-static mouse_input_t *get_mouse_motion(SDL_MouseMotionEvent ev) {
-	mouse_input_t *out;
-
-	if((out = malloc(sizeof(mouse_input_t))) == NULL)
-		return NULL;
-	
-	out->dir = NONE;
-	out->type = MOTION;
-	out->Motion = ev;
-	return out;
+static void get_mouse_motion(input_t *out, SDL_MouseMotionEvent ev) {
+	out->type = MOUSE;
+	out->mouse.dir = NONE;
+	out->mouse.type = MOTION;
+	out->mouse.Motion = ev;
 }
 
-static mouse_input_t *get_mouse_wheel(SDL_MouseWheelEvent ev) {
-	mouse_input_t *out;
-
-	if((out = malloc(sizeof(mouse_input_t))) == NULL)
-		return NULL;
+static void get_mouse_wheel(input_t *out, SDL_MouseWheelEvent ev) {
+	out->type = MOUSE;
 
 	if(ev.y > 0)
-		out->dir = UP;
+		out->mouse.dir = UP;
 	else if(ev.y < 0)
-		out->dir = DOWN;
+		out->mouse.dir = DOWN;
 	else
-		out->dir = NONE;
+		out->mouse.dir = NONE;
 
-	out->type = WHEEL;
-	out->Wheel = ev;
-	return out;
+	out->mouse.type = WHEEL;
+	out->mouse.Wheel = ev;
 }
 
-static int add_to_queue(input_t *input) {
-	input_queue_t *newent;
-
-	if((newent = malloc(sizeof(input_queue_t))) == NULL)
-		return 0;
-
-	newent->event = input;
-	newent->next = NULL;
+/* Producer side. Events that don't fit are dropped. */
+void input_pump(void) {
+	SDL_Event ev;
+	unsigned int head, tail;
+	input_t *rec;
 
-	if(queue_end == NULL) {
-		queue_start = newent;
-	} else {
-		queue_end->next = newent;
-	}
+	SDL_PumpEvents();
 
-	queue_end = newent;
-	return 1;
-}
-
-void input_get(void) {
-	SDL_Event ev;
-	input_t *input;
-	key_input_t *key_input;
-	mouse_input_t *mouse_input;
+	while(SDL_PeepEvents(&ev, 1, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT) > 0) {
+		head = SDL_AtomicGet(&ring.head);
+		tail = SDL_AtomicGet(&ring.tail);
+		if(head - tail == INPUT_RING_SIZE)
+			continue;
 
-	while(SDL_PollEvent(&ev)) {
-		input = NULL;
-		key_input = NULL;
-		mouse_input = NULL;
+		rec = &ring.rec[head % INPUT_RING_SIZE];
 
 		switch(ev.type) {
 			case SDL_KEYDOWN:
 			case SDL_KEYUP:
-				key_input = get_keys(ev.key, ev.type);
+				get_keys(rec, ev.key, ev.type);
 				break;
 			/*
 			case SDL_MOUSEBUTTONUP:
 			case SDL_MOUSEBUTTONDOWN:
-				mouse_input = get_mouse_button(ev.button, ev.type);
+				get_mouse_button(rec, ev.button, ev.type);
 				break;
 			case SDL_MOUSEMOTION:
-				mouse_input = get_mouse_motion(ev.motion);
+				get_mouse_motion(rec, ev.motion);
 				break;
 			case SDL_MOUSEWHEEL:
-				mouse_input = get_mouse_wheel(ev.wheel);
+				get_mouse_wheel(rec, ev.wheel);
 				break;
 			*/
-		}
-
-		if(key_input) {
-			if((input = malloc(sizeof(input_t))) == NULL) {
-				free(key_input);
+			default:
 				continue;
-			}
-			input->type = KEYBOARD;
-			input->key = key_input;
-		} else if(mouse_input) {
-			if((input = malloc(sizeof(input_t))) == NULL) {
-				free(mouse_input);
-				continue;
-			}
-			input->type = MOUSE;
-			input->mouse = mouse_input;
 		}
 
-		if(input) {
-			add_to_queue(input);
-		}
+		SDL_MemoryBarrierRelease();
+		SDL_AtomicSet(&ring.head, head + 1);
 	}
 }
 
+/* Set while another thread owns the SDL event queue and calls
+ * input_pump(). Otherwise input_get() pumps on the calling thread. */
+void input_set_producer(const int external) {
+	SDL_AtomicSet(&ring.external, external);
+}
+
+void input_get(void) {
+	if(!SDL_AtomicGet(&ring.external))
+		input_pump();
+}
+
 static int dispatch_keyboard(key_input_t *key_input) {
 	int ret = INPUT_IGNORED;
 	size_t i;
 
-	if(key_input == NULL)
-		return INPUT_IGNORED;
-
 	for(i = 0; i < kb_handlers->n_registered; i++)
-		if((ret = kb_handlers->proc[i](key_input)) == INPUT_CONSUMED) goto done;
+		if((ret = kb_handlers->proc[i](key_input)) == INPUT_CONSUMED) break;
 
-done:
-	free(key_input);
 	return ret;
 }
 
@@ -182,43 +146,36 @@ static int dispatch_mouse(mouse_input_t *mouse_input) {
 	int ret = INPUT_IGNORED;
 	size_t i;
 
-	if(mouse_input == NULL)
-		return ret;
-
 	if(mouse_input->type != MOTION) {
 		for(i = 0; i < btn_handlers->n_registered; i++)
-			if(btn_handlers->proc[i](mouse_input) == INPUT_CONSUMED) goto done;
+			if(btn_handlers->proc[i](mouse_input) == INPUT_CONSUMED) break;
 	} else {
 		for(i = 0; i < move_handlers->n_registered; i++)
 			move_handlers->proc[i](mouse_input);
 	}
 
-done:
-	free(mouse_input);
 	return ret;
 }
 
+/* Consumer side. */
 void input_dispatch(void) {
-	input_queue_t *current;
-	input_t *input;
-
-	while(queue_start != NULL) {
-		current = queue_start;
-		input = current->event;
-		
-		if(input) {
-			if(input->type == KEYBOARD) {
-				dispatch_keyboard(input->key);
-			} else if(input->type == MOUSE) {
-				dispatch_mouse(input->mouse);
-			} free(input);
+	unsigned int head, tail;
+	input_t input;
+
+	tail = SDL_AtomicGet(&ring.tail);
+	head = SDL_AtomicGet(&ring.head);
+	SDL_MemoryBarrierAcquire();
+
+	while(tail != head) {
+		input = ring.rec[tail % INPUT_RING_SIZE];
+		SDL_MemoryBarrierRelease();
+		SDL_AtomicSet(&ring.tail, ++tail);
+
+		if(input.type == KEYBOARD) {
+			dispatch_keyboard(&input.key);
+		} else if(input.type == MOUSE) {
+			dispatch_mouse(&input.mouse);
 		}
-
-		if(current == queue_end)
-			queue_end = NULL;
-
-		queue_start = queue_start->next;
-		free(current);
 	}
 }
 
@@ -267,6 +224,10 @@ int input_init(void) {
 	move_handlers->n_registered = 0;
 	move_handlers->n_alloced = PREALLOC_LIST;
 
+	SDL_AtomicSet(&ring.head, 0);
+	SDL_AtomicSet(&ring.tail, 0);
+	SDL_AtomicSet(&ring.external, 0);
+
 	return RET_OK;
 
 freemove:
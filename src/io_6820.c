@@ -5,72 +5,82 @@
 
 #include <ctype.h> /*!!*/
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <SDL.h>
 
 #include "leakcheck.h"
 
 #include "input.h"
+#include "io_6820.h"
 #include "mem.h"
+#include "replay.h"
+#include "serial.h"
 #include "status.h"
 #include "vm.h"
 
-#define CHAR_WIDTH	6
-#define CHAR_HEIGHT 8
-#define CHAR_COL_R	0xff
-#define CHAR_COL_G	0xff
-#define CHAR_COL_B	0xff
-
-#define SCR_COLS	60
-#define SCR_ROWS	36
-#define SCR_SCALE	2
-
-#define SCR_WIDTH	(CHAR_WIDTH * SCR_COLS * SCR_SCALE)
-#define SCR_HEIGHT	(CHAR_HEIGHT * SCR_ROWS * SCR_SCALE)
-
-#define SCR_TITLE	"A1 Console"
-
-#define scrpos(x, y) ((y) * SCR_COLS + (x))
-
 #define KBD_DATA		0xd010
 #define KBD_CR			0xd011
 #define DSP_DATA		0xd012
 #define DSP_CR			0xd013
 
 #define	DSP_READY		0x80
-#define BLINK_DELAY		400
 
-#define CSR_CHAR		'@'		/* For more authenticity */
-//#define CSR_CHAR		'_'		/* For more beauticity */
+#define KBD_FIFO_SIZE	64
 
-typedef struct vidinfo_t {
-	SDL_Window *window;
-	SDL_Renderer *renderer;
-	SDL_Texture *char_texture[128];
-} vidinfo_t;
+/* Text being fed to the keyboard, already in Apple 1 characters. */
+typedef struct pasteinfo_t {
+	uint8_t *text;
+	size_t len, pos;
+	int scheduled;
+} pasteinfo_t;
 
-typedef struct scrinfo_t {
-	uint8_t cell[SCR_COLS * SCR_ROWS];
-	uint32_t col, row;
-	int last_blink, show_cursor;
-} scrinfo_t;
+/* Keys typed while the guest has not yet read the previous one. */
+typedef struct kbdfifo_t {
+	uint8_t key[KBD_FIFO_SIZE];
+	uint32_t head, count;
+	int scheduled;
+} kbdfifo_t;
 
 typedef struct reginfo_t {
 	uint8_t kbd_data, kbd_cr;
 	uint8_t dsp_data, dsp_cr;
 } reginfo_t;
 
-static vidinfo_t *video;
-static scrinfo_t screen;
+static dispdef_t display;
+static screen_t screen;
+static int redraw;
 static vm_t *g_vm = NULL;
+typedef struct output_list_t {
+	size_t n_registered, n_alloced;
+	pia_output_proc_t *proc;
+	void **data;
+} output_list_t;
+
 static reginfo_t reginfo;
+static kbdfifo_t kbd_fifo;
+static output_list_t outputs;
+static pasteinfo_t paste;
+
+static void touch_all(void) {
+	int i;
+
+	for(i = 0; i < SCR_ROWS; i++)
+		screen.gen[i]++;
+}
 
 static void init_screen(void) {
 	int i;
 	for(i = 0; i < SCR_COLS * SCR_ROWS; i++)
 		screen.cell[i] = 0;
 
+	screen.top = 0;
 	screen.col = screen.row = 0;
+	touch_all();
+
+	if(display.reset)
+		display.reset();
 }
 
 static void pia_reset(void) {
@@ -80,22 +90,24 @@ static void pia_reset(void) {
 	reginfo.kbd_data = 0x80;
 	reginfo.dsp_cr = 0;
 	reginfo.dsp_data = 0;
+
+	kbd_fifo.head = kbd_fifo.count = 0;
+
+	redraw = 1;
 }
 
+/* The old top row becomes the new, blank bottom row. */
 static void scroll(void) {
-	int x, y;
+	uint32_t slot = screen.top;
 
-	for(y = 1; y < SCR_ROWS; y++) {
-		for(x = 0; x < SCR_COLS; x++) {
-			screen.cell[scrpos(x, y - 1)] = screen.cell[scrpos(x, y)];
-		}
-	}
-	for(x = 0; x < SCR_COLS; x++)
-		screen.cell[scrpos(x, SCR_ROWS - 1)] = 0;
+	memset(&screen.cell[slot * SCR_COLS], 0, SCR_COLS);
+	screen.gen[slot]++;
+	screen.top = (screen.top + 1) % SCR_ROWS;
 }
 
 static void pia_chrout(void) {
 	uint8_t data, c;
+	size_t i;
 
 	data = reginfo.dsp_data;
 
@@ -104,12 +116,20 @@ static void pia_chrout(void) {
 	if(data == '\n' || data == '\r') {
 		screen.col = 0;
 		screen.row++;
+		c = '\r';
 	} else {
 		c = (data > 0x5f) ? data & 0x5f : data;
-		screen.cell[screen.row * SCR_COLS + screen.col] = c;
+		screen.cell[scrpos(&screen, screen.col, screen.row)] = c;
+		screen.gen[scrslot(&screen, screen.row)]++;
 		screen.col++;
 	}
 
+	if(display.putc)
+		display.putc(c);
+
+	for(i = 0; i < outputs.n_registered; i++)
+		outputs.proc[i](outputs.data[i], c);
+
 	if(screen.col == SCR_COLS) {
 		screen.col = 0;
 		screen.row++;
@@ -153,132 +173,288 @@ static uint8_t shift(const uint8_t key) {
 	return 0xff;
 }
 
-static int pia_keyboard(key_input_t *key_input) {
-	uint8_t key = key_input->Keysym.sym;
-	uint8_t c;
+static void paste_stop(void) {
+	if(paste.text)
+		free(paste.text);
 
-	if(key_input->type == DOWN) {
-		if(key_input->Keysym.sym == SDLK_ESCAPE) {
-			g_vm->quit = 1;
-		} else if(key_input->Keysym.sym == SDLK_F1) {
+	paste.text = NULL;
+	paste.len = paste.pos = 0;
+}
+
+static void kbd_latch(const uint8_t c) {
+	reginfo.kbd_data = c | 0x80;
+	reginfo.kbd_cr = 0xa7;
+}
+
+/* Latches the next queued key once the guest has read the last one. */
+static void kbd_event(vm_t *vm, void *data) {
+	kbd_fifo.scheduled = 0;
+
+	if(kbd_fifo.count == 0 || (reginfo.kbd_cr & 0x80))
+		return;
+
+	kbd_latch(kbd_fifo.key[kbd_fifo.head]);
+	kbd_fifo.head = (kbd_fifo.head + 1) % KBD_FIFO_SIZE;
+	kbd_fifo.count--;
+}
+
+static void kbd_next(void) {
+	if(kbd_fifo.count && !kbd_fifo.scheduled) {
+		sched_add(g_vm, g_vm->cycle, kbd_event, NULL);
+		kbd_fifo.scheduled = 1;
+	}
+}
+
+/* A key goes straight to the register if the guest has taken the last
+ * one and nothing is queued, otherwise it waits in the FIFO. Keys beyond
+ * the FIFO size are dropped. */
+static void kbd_put(const uint8_t c) {
+	if(!(reginfo.kbd_cr & 0x80) && kbd_fifo.count == 0) {
+		kbd_latch(c);
+	} else if(kbd_fifo.count < KBD_FIFO_SIZE) {
+		kbd_fifo.key[(kbd_fifo.head + kbd_fifo.count) % KBD_FIFO_SIZE] = c;
+		kbd_fifo.count++;
+	}
+}
+
+/* All guest-visible input passes through here, so it can be recorded and
+ * replayed at the same cycle. */
+void pia_event(vm_t *vm, const uint8_t type, const uint8_t data) {
+	replay_log(vm, type, data);
+
+	switch(type) {
+		case REPLAY_KEY:
+		case REPLAY_PASTE:
+			kbd_put(data);
+			break;
+
+		case REPLAY_RESET:
+			/* A paste alive after a rewind began after any reset that
+			 * is replayed on the way. */
+			if(!replay_rewinding())
+				paste_stop();
 			pia_reset();
-			vm_reset(g_vm);
-			init_screen();
-		} else {
-			if(key_input->Keysym.mod & KMOD_SHIFT) {
-				key = shift(key);
-			}
-			if(key == '\b') key = 0x5f;
+			vm_reset(vm);
+			break;
 
-			c = key & 0x7f;
-			
-			if ((c > 0x60) && (c < 0x7b))
-				c &= 0x5f;
+		case REPLAY_QUIT:
+			vm->quit = 1;
+			break;
+	}
+}
 
-			if(c < 0x60) {
-				reginfo.kbd_data = (c | 0x80);
-				reginfo.kbd_cr = 0xa7;
-			}
-		}
+/* Types the next pasted character. Posted when the guest has read the
+ * previous one, so the text goes in as fast as the guest takes it. The
+ * text stays until the next paste, a rewind may take keys back. While
+ * rewinding the input log types the keys instead. */
+static void paste_event(vm_t *vm, void *data) {
+	paste.scheduled = 0;
+	if(paste.pos == paste.len || replay_rewinding())
+		return;
+
+	pia_event(vm, REPLAY_PASTE, paste.text[paste.pos++]);
+}
+
+static void paste_next(void) {
+	if(paste.pos < paste.len && !paste.scheduled && !replay_rewinding()) {
+		sched_add(g_vm, g_vm->cycle, paste_event, NULL);
+		paste.scheduled = 1;
 	}
-	return INPUT_CONSUMED;
 }
 
-static int load_charmap(const char *filename) {
-	int x, y, n;
-	uint8_t c;
-	FILE *fp = fopen(filename, "rb");
-	SDL_Texture *texture;
-	uint32_t *pixels;
-	uint32_t pixel_off, pixel_on;
-	SDL_PixelFormat *format;
-	int pitch;
+/* Host character to keyboard character: upper case, CR line ends (CR LF
+ * and LF alike), tabs as blanks. Returns -1 for characters to drop; prev
+ * is the host character before c. */
+int pia_ascii_key(const uint8_t c, const uint8_t prev) {
+	uint8_t key = c & 0x7f;
+
+	if(key == '\n') {
+		if(prev == '\r')
+			return -1;
+		key = '\r';
+	} else if(key == '\t') {
+		key = ' ';
+	} else if((key > 0x60) && (key < 0x7b)) {
+		key &= 0x5f;
+	}
 
-	if((format = SDL_AllocFormat(SDL_GetWindowPixelFormat(video->window))) == NULL)
-		return RET_ERR_SDL;
+	if((key < 0x20 && key != '\r') || key >= 0x60)
+		return -1;
 
-	pixel_off = SDL_MapRGB(format, 0, 0, 0);
-	pixel_on = SDL_MapRGB(format, CHAR_COL_R, CHAR_COL_G, CHAR_COL_B);
+	return key;
+}
 
-	if(fp == NULL) 
-		return RET_ERR_OPEN;
+static size_t convert_text(uint8_t *dst, const char *src, const size_t len) {
+	size_t i, n = 0;
+	int key;
 
-	for(n = 0; n < 128; n++) {
-		if((texture = SDL_CreateTexture(video->renderer, 
-			SDL_GetWindowPixelFormat(video->window), SDL_TEXTUREACCESS_STREAMING,
-			CHAR_WIDTH, CHAR_HEIGHT)) == NULL) {
-				return RET_ERR_SDL;
-		}
+	for(i = 0; i < len; i++) {
+		if((key = pia_ascii_key(src[i], (i > 0) ? src[i - 1] : 0)) >= 0)
+			dst[n++] = key;
+	}
 
-		SDL_LockTexture(texture, NULL, &pixels, &pitch);
+	return n;
+}
 
-		for(y = 0; y < CHAR_HEIGHT; y++) {
-			c = fgetc(fp);
-			for(x = 0; x < CHAR_WIDTH; x++) {
-				if(c & (1 << x))
-					pixels[y * CHAR_WIDTH + x] = pixel_on;
-				else
-					pixels[y * CHAR_WIDTH + x] = pixel_off;
-			}
+/* Free room in the keyboard FIFO. */
+size_t pia_kbd_space(void) {
+	return KBD_FIFO_SIZE - kbd_fifo.count;
+}
+
+/* Registers a proc that sees every character the guest displays, with
+ * CR for a line end. */
+int pia_output_reg(pia_output_proc_t proc, void *data) {
+	pia_output_proc_t *newprocs;
+	void **newdata;
+
+	if(outputs.n_registered == outputs.n_alloced) {
+		if((newprocs = malloc((outputs.n_alloced + PREALLOC_LIST) * sizeof(pia_output_proc_t))) == NULL)
+			return RET_ERR_ALLOC;
+
+		if((newdata = malloc((outputs.n_alloced + PREALLOC_LIST) * sizeof(void*))) == NULL) {
+			free(newprocs);
+			return RET_ERR_ALLOC;
 		}
 
-		SDL_UnlockTexture(texture);
-		video->char_texture[n] = texture;
-		SDL_FreeFormat(format);
+		if(outputs.n_registered) {
+			memcpy(newprocs, outputs.proc, outputs.n_registered * sizeof(pia_output_proc_t));
+			memcpy(newdata, outputs.data, outputs.n_registered * sizeof(void*));
+			free(outputs.proc);
+			free(outputs.data);
+		}
 
+		outputs.proc = newprocs;
+		outputs.data = newdata;
+		outputs.n_alloced += PREALLOC_LIST;
 	}
 
-	fclose(fp);
+	outputs.proc[outputs.n_registered] = proc;
+	outputs.data[outputs.n_registered] = data;
+	outputs.n_registered++;
 
 	return RET_OK;
 }
 
-static void render(int redraw) {
-	int x, y;
-	uint8_t c;
-	SDL_Rect rect;
+int pia_paste_text(const char *text, const size_t len) {
+	if(replay_playing())
+		return RET_BUSY;
 
-	if(SDL_GetTicks() - screen.last_blink > BLINK_DELAY) {
-		screen.show_cursor = screen.show_cursor ? 0 : 1;
-		screen.last_blink = SDL_GetTicks();
-		redraw = 1;
+	paste_stop();
+
+	if(len == 0)
+		return RET_OK;
+
+	if((paste.text = malloc(len)) == NULL)
+		return RET_ERR_ALLOC;
+
+	if((paste.len = convert_text(paste.text, text, len)) == 0) {
+		paste_stop();
+		return RET_OK;
 	}
 
-	if(redraw) {
-		SDL_RenderClear(video->renderer);
+	/* Keys the guest has not read yet go first. */
+	if(!(reginfo.kbd_cr & 0x80) && kbd_fifo.count == 0)
+		paste_next();
 
-		rect.w = CHAR_WIDTH * SCR_SCALE;
-		rect.h = CHAR_HEIGHT * SCR_SCALE;
+	return RET_OK;
+}
 
-		for(x = 0; x < SCR_COLS; x++) {
-			for(y = 0; y < SCR_ROWS; y++) {
-				rect.x = x * CHAR_WIDTH * SCR_SCALE;
-				rect.y = y * CHAR_HEIGHT * SCR_SCALE;
-			
-				c = screen.cell[y * SCR_COLS + x];
+/* Live input resumes after a rewind that undid n pasted keys. */
+void pia_paste_branch(const size_t n_undone) {
+	paste.pos -= (n_undone < paste.pos) ? n_undone : paste.pos;
+
+	if(!(reginfo.kbd_cr & 0x80) && kbd_fifo.count == 0)
+		paste_next();
+}
+
+int pia_paste_file(const char *filename) {
+	FILE *fp;
+	char *text;
+	long len;
+	int ret = RET_ERR_IO;
 
-				SDL_RenderCopy(video->renderer, video->char_texture[c], NULL, &rect);
+	if((fp = fopen(filename, "rb")) == NULL)
+		return RET_ERR_OPEN;
+
+	if(fseek(fp, 0, SEEK_END) || (len = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET))
+		goto closefile;
+
+	if((text = malloc(len + 1)) == NULL) {
+		ret = RET_ERR_ALLOC;
+		goto closefile;
+	}
+
+	if(fread(text, 1, len, fp) == (size_t)len)
+		ret = pia_paste_text(text, len);
+
+	free(text);
+closefile:
+	fclose(fp);
+	return ret;
+}
+
+static void paste_clipboard(void) {
+	char *text;
+
+	if(!SDL_HasClipboardText())
+		return;
+
+	if((text = SDL_GetClipboardText()) == NULL)
+		return;
+
+	pia_paste_text(text, strlen(text));
+	SDL_free(text);
+}
+
+static int pia_keyboard(key_input_t *key_input) {
+	uint8_t key = key_input->Keysym.sym;
+	uint8_t c;
+
+	if(key_input->type == DOWN) {
+		if(key_input->Keysym.sym == SDLK_ESCAPE) {
+			pia_event(g_vm, REPLAY_QUIT, 0);
+		} else if(key_input->Keysym.sym == SDLK_F1) {
+			pia_event(g_vm, REPLAY_RESET, 0);
+		} else if(key_input->Keysym.sym == SDLK_F2) {
+			paste_clipboard();
+		} else if(key_input->Keysym.sym & SDLK_SCANCODE_MASK) {
+			return INPUT_IGNORED;
+		} else {
+			if(key_input->Keysym.mod & KMOD_SHIFT) {
+				key = shift(key);
 			}
-		}
+			if(key == '\b') key = 0x5f;
 
-		if(screen.show_cursor) {
-			rect.x = screen.col * CHAR_WIDTH * SCR_SCALE;
-			rect.y = screen.row * CHAR_HEIGHT * SCR_SCALE;
-			SDL_RenderCopy(video->renderer, video->char_texture['_'], NULL, &rect);
+			c = key & 0x7f;
+			
+			if ((c > 0x60) && (c < 0x7b))
+				c &= 0x5f;
+
+			if(c < 0x60)
+				pia_event(g_vm, REPLAY_KEY, c);
 		}
-		SDL_RenderPresent(video->renderer);
 	}
+	return INPUT_CONSUMED;
 }
 
-void pia_step(vm_t *vm) {
-	int redraw = 0;
-
-	if(reginfo.dsp_data & 0x80) {
+static void chrout_event(vm_t *vm, void *data) {
+	if(reginfo.dsp_data & DSP_READY) {
 		pia_chrout();
 		redraw = 1;
 	}
+}
 
-	render(redraw);
+/* Frames sit on a fixed grid of FRAME_CYCLES, the same boundaries the
+ * main loop ends its slices on. */
+static uint64_t next_frame(vm_t *vm) {
+	return (vm->cycle / FRAME_CYCLES + 1) * FRAME_CYCLES;
+}
+
+static void frame_event(vm_t *vm, void *data) {
+	display.frame(&screen, redraw);
+	redraw = 0;
+
+	sched_add(vm, next_frame(vm), frame_event, NULL);
 }
 
 static int hook_read(uint16_t addr, uint8_t *res) {
@@ -286,6 +462,8 @@ static int hook_read(uint16_t addr, uint8_t *res) {
 		case KBD_DATA:
 			reginfo.kbd_cr = 0x27;
 			*res = reginfo.kbd_data;
+			kbd_next();
+			paste_next();
 			return MEM_INTERCEPTED;
 		
 		case KBD_CR:
@@ -320,8 +498,11 @@ static int hook_write(const uint16_t addr, const uint8_t val) {
 			ret = MEM_USED; break;
 
 		case DSP_DATA:
-			if(reginfo.dsp_cr & 0x04)
-				reginfo.dsp_data = val | 0x80;
+			if(reginfo.dsp_cr & 0x04) {
+				if(!(reginfo.dsp_data & DSP_READY))
+					sched_add(g_vm, g_vm->cycle, chrout_event, NULL);
+				reginfo.dsp_data = val | DSP_READY;
+			}
 			ret = MEM_USED; break;
 
 		case DSP_CR:
@@ -332,34 +513,69 @@ static int hook_write(const uint16_t addr, const uint8_t val) {
 	return ret;
 }
 
-int pia_init(vm_t *vm) {
-	int ret = RET_ERR_SDL;
-	
-	if((video = malloc(sizeof(vidinfo_t))) == NULL) {
-		fprintf(stderr, "pia_init(): ERROR! malloc() failed.\n");
-		return RET_ERR_ALLOC;
-	}
-
-	if((video->window = SDL_CreateWindow(SCR_TITLE, SDL_WINDOWPOS_UNDEFINED, 
-		SDL_WINDOWPOS_UNDEFINED, SCR_WIDTH, SCR_HEIGHT, SDL_WINDOW_SHOWN)) == NULL) {
+/* Cells are stored in visible row order, independent of the ring. */
+size_t pia_save_state(uint8_t *buf) {
+	size_t size = 4 + sizeof(screen.cell) + 2 + 1 + KBD_FIFO_SIZE;
+	uint32_t i;
+	int y;
+
+	if(buf == NULL)
+		return size;
+
+	put_u8(&buf, reginfo.kbd_data);
+	put_u8(&buf, reginfo.kbd_cr);
+	put_u8(&buf, reginfo.dsp_data);
+	put_u8(&buf, reginfo.dsp_cr);
+	for(y = 0; y < SCR_ROWS; y++)
+		put_bytes(&buf, &screen.cell[scrpos(&screen, 0, y)], SCR_COLS);
+	put_u8(&buf, screen.col);
+	put_u8(&buf, screen.row);
+
+	put_u8(&buf, kbd_fifo.count);
+	for(i = 0; i < KBD_FIFO_SIZE; i++)
+		put_u8(&buf, kbd_fifo.key[(kbd_fifo.head + i) % KBD_FIFO_SIZE]);
+
+	return size;
+}
 
-		fprintf(stderr, "pia_init(): ERROR! SDL_CreateWindow() failed: %s\n", SDL_GetError());
-		goto freevid;
-	}
+void pia_load_state(const uint8_t *buf) {
+	reginfo.kbd_data = get_u8(&buf);
+	reginfo.kbd_cr = get_u8(&buf);
+	reginfo.dsp_data = get_u8(&buf);
+	reginfo.dsp_cr = get_u8(&buf);
+	get_bytes(&buf, screen.cell, sizeof(screen.cell));
+	screen.top = 0;
+	touch_all();
+	screen.col = get_u8(&buf);
+	screen.row = get_u8(&buf);
+
+	kbd_fifo.head = 0;
+	kbd_fifo.count = get_u8(&buf);
+	get_bytes(&buf, kbd_fifo.key, KBD_FIFO_SIZE);
+
+	sched_cancel(g_vm, chrout_event, NULL);
+	if(reginfo.dsp_data & DSP_READY)
+		sched_add(g_vm, g_vm->cycle, chrout_event, NULL);
+
+	sched_cancel(g_vm, kbd_event, NULL);
+	kbd_fifo.scheduled = 0;
+	if(!(reginfo.kbd_cr & 0x80))
+		kbd_next();
+
+	sched_cancel(g_vm, paste_event, NULL);
+	paste.scheduled = 0;
+
+	redraw = 1;
+}
 
-	if((video->renderer = SDL_CreateRenderer(video->window, -1, SDL_RENDERER_ACCELERATED)) == NULL) {
-		fprintf(stderr, "pia_init(): ERROR! SDL_CreateRenderer() failed: %s\n", SDL_GetError());
-		goto freewindow;
-	}
+int pia_init(vm_t *vm, dispdef_t dispdef) {
+	int ret;
 
-	if((ret = load_charmap("rom/a1chr.bin")) != RET_OK) {
-		goto freerenderer;
+	display = dispdef;
+	if((ret = display.init()) != RET_OK) {
+		fprintf(stderr, "pia_init(): ERROR! Display '%s' failed to start.\n", display.name);
+		return ret;
 	}
-	
-	SDL_SetRenderDrawColor(video->renderer, 0x00, 0x00, 0x00, 0xff);
-
-	screen.last_blink = SDL_GetTicks();
-	screen.show_cursor = 0;
 
 	input_reg(pia_keyboard, HPROC_KEYBOARD);
 	mmio_reg(hook_write, MMIO_WRITE);
@@ -368,26 +584,20 @@ int pia_init(vm_t *vm) {
 	g_vm = vm;
 
 	pia_reset();
-	return RET_OK;
-
-freerenderer:
-	SDL_DestroyRenderer(video->renderer);
-freewindow:
-	SDL_DestroyWindow(video->window);
-freevid:
-	free(video);
-	video = NULL;
+	if(display.frame)
+		sched_add(vm, next_frame(vm), frame_event, NULL);
 
-	return ret;
+	return RET_OK;
 }
 
 void pia_clean(void) {
-	int i;
+	paste_stop();
 
-	for(i = 0; i < 128; i++)
-		SDL_DestroyTexture(video->char_texture[i]);
+	if(outputs.n_alloced) {
+		free(outputs.proc);
+		free(outputs.data);
+	}
+	outputs.n_registered = outputs.n_alloced = 0;
 
-	SDL_DestroyRenderer(video->renderer);
-	SDL_DestroyWindow(video->window);
-	free(video);
+	display.quit();
 }
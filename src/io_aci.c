@@ -0,0 +1,600 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Apple Cassette Interface. The card has its 256 byte ROM at $C100 and
+ * decodes $C000-$C0FF as I/O: any access there toggles the tape output
+ * flip-flop, and reads in $C080-$C0FF return the ROM byte at the same
+ * offset with A0 cleared while the tape input is high. The ROM samples
+ * the input that way and measures half-periods with timing loops.
+ *
+ * Tapes are kept as lists of half-period lengths in CPU cycles. The input
+ * tape starts playing at the first read of the tape input and advances
+ * with the cycle counter; writing appends the time between two output
+ * toggles. Reads of the tape input don't toggle the output here. On the
+ * card they do, which only puts noise on the output while loading.
+ *
+ * Fast load: when the ROM starts reading the tape, the command line it
+ * is working on is still in the input buffer at $0200. Its R ranges are
+ * decoded from the tape straight into RAM and the CPU continues in the
+ * Woz monitor, where the ACI goes after a command line. Lines that write
+ * after reading, and tapes that don't decode, fall back to the real loop.
+ *
+ * Tape files are WAV (8 or 16 bit PCM, first channel) or raw:
+ *
+ * File:	"A1TP" u16 version, u32 clock
+ * Half:	u32 cycles
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leakcheck.h"
+
+#include "io_aci.h"
+#include "mem.h"
+#include "sched.h"
+#include "serial.h"
+#include "status.h"
+#include "vm.h"
+
+#define ACI_IO			0xc000
+#define ACI_ROM			0xc100
+#define ACI_SIZE		0x100
+#define ACI_TAPE_IN		0x80		/* I/O offsets from here read the tape */
+
+#define IN_BUF			0x0200		/* Woz monitor input line */
+#define IN_BUF_SIZE		0x80
+#define ACI_RETURN		0xff1a		/* Woz monitor ESCAPE */
+
+#define TP_MAGIC		"A1TP"
+#define TP_VERSION		1
+#define TP_HDR_SIZE		10
+
+#define WAV_RATE		44100
+#define WAV_HIGH		0xc0
+#define WAV_LOW			0x40
+#define WAV_BLOCK		4096
+
+#define us(n)			((uint32_t)((uint64_t)(n) * CPU_CLOCK / 1000000))
+
+#define START_MAX		us(375)		/* Shorter half-cycle: start bit */
+#define BIT_THRESHOLD	us(750)		/* Longer full cycle: 1 bit */
+#define HEADER_MIN		64			/* Long half-cycles before a start bit */
+#define OUT_GAP_MAX		CPU_CLOCK	/* Output idle longer carries nothing */
+
+#define STATE_SIZE		36
+
+typedef struct tape_t {
+	uint32_t *half;
+	size_t len, alloced;
+} tape_t;
+
+/* Everything the guest can observe, for save states. */
+typedef struct acistate_t {
+	uint32_t pos;			/* Playing half-period */
+	uint64_t edge;			/* Cycle it ends at */
+	uint8_t level, playing;
+
+	uint8_t out_level;
+	uint64_t out_last;		/* Cycle of the last output toggle */
+	uint32_t out_len;
+
+	uint64_t last_read;		/* Cycle of the last tape input read */
+	uint8_t fast_tried;
+} acistate_t;
+
+static vm_t *g_vm = NULL;
+static tape_t tape_in, tape_out;
+static const char *out_name = NULL;
+static acistate_t state;
+static int fast = 0;
+
+static int tape_append(tape_t *tape, const uint32_t half) {
+	uint32_t *newhalf;
+	size_t newsize;
+
+	if(tape->len == tape->alloced) {
+		newsize = tape->alloced ? tape->alloced * 2 : WAV_BLOCK;
+		if((newhalf = malloc(newsize * sizeof(uint32_t))) == NULL)
+			return RET_ERR_ALLOC;
+
+		if(tape->half) {
+			memcpy(newhalf, tape->half, tape->len * sizeof(uint32_t));
+			free(tape->half);
+		}
+		tape->half = newhalf;
+		tape->alloced = newsize;
+	}
+
+	tape->half[tape->len++] = half;
+	return RET_OK;
+}
+
+static void tape_free(tape_t *tape) {
+	if(tape->half)
+		free(tape->half);
+
+	tape->half = NULL;
+	tape->len = tape->alloced = 0;
+}
+
+/* Moves the input tape to half-period pos at the given cycle. The level
+ * starts low, so it is the parity of pos. */
+static void tape_seek(const size_t pos, const uint64_t cycle) {
+	state.pos = (uint32_t)pos;
+	state.level = pos & 1;
+	state.edge = cycle + ((pos < tape_in.len) ? tape_in.half[pos] : 0);
+	state.playing = 1;
+}
+
+static uint8_t tape_level(const uint64_t cycle) {
+	if(!state.playing)
+		tape_seek(0, cycle);
+
+	while(state.pos < tape_in.len && cycle >= state.edge) {
+		state.level ^= 1;
+		if(++state.pos < tape_in.len)
+			state.edge += tape_in.half[state.pos];
+	}
+
+	return state.level;
+}
+
+static void tape_toggle(const uint64_t cycle) {
+	uint64_t half = cycle - state.out_last;
+
+	state.out_level ^= 1;
+
+	if(out_name && state.out_last) {
+		if(half > OUT_GAP_MAX)
+			half = OUT_GAP_MAX;
+		if(tape_append(&tape_out, (uint32_t)half) == RET_OK)
+			state.out_len++;
+	}
+
+	/* Cycle 0 means no toggle yet; the clock is past it by the first one. */
+	state.out_last = cycle ? cycle : 1;
+}
+
+/* Skips to the first data half-period of the next record: a header of
+ * long half-cycles, then the short start bit. */
+static size_t find_data(size_t pos) {
+	size_t run = 0;
+
+	for(; pos < tape_in.len; pos++) {
+		if(tape_in.half[pos] >= START_MAX)
+			run++;
+		else if(run >= HEADER_MIN)
+			return pos + 2;
+		else
+			run = 0;
+	}
+
+	return tape_in.len;
+}
+
+/* Bits are full cycles, most significant bit first. */
+static int read_byte(size_t *pos, uint8_t *val) {
+	int i;
+
+	*val = 0;
+	for(i = 0; i < 8; i++) {
+		if(*pos + 2 > tape_in.len)
+			return 0;
+
+		*val <<= 1;
+		if(tape_in.half[*pos] + tape_in.half[*pos + 1] > BIT_THRESHOLD)
+			*val |= 1;
+		*pos += 2;
+	}
+
+	return 1;
+}
+
+/* Decodes the record for from..to at pos, into RAM when vm is set.
+ * Returns the position after it, or 0 if the tape ends first. */
+static size_t read_record(vm_t *vm, size_t pos, uint16_t from, const uint16_t to) {
+	uint8_t val;
+
+	pos = find_data(pos);
+
+	for(;;) {
+		if(!read_byte(&pos, &val))
+			return 0;
+
+		if(vm)
+			write_mem(vm, from, val);
+
+		if(from++ == to)
+			return pos;
+	}
+}
+
+/* R ranges of the command line in the input buffer, as the ACI ROM
+ * parses it. An address without a '.' before it is a range of one byte.
+ * Returns the count, 0 if the line can't be fast-loaded. */
+static int parse_line(vm_t *vm, uint16_t *from, uint16_t *to, const int max) {
+	uint16_t hex = 0, start = 0;
+	uint8_t c;
+	int i, n = 0, dot = 0;
+
+	for(i = 0; i < IN_BUF_SIZE; i++) {
+		c = vm->mem[IN_BUF + i] & 0x7f;
+
+		if(c == '\r') {
+			return n;
+		} else if(c == 'R') {
+			if(n == max)
+				return 0;
+			from[n] = dot ? start : hex;
+			to[n++] = hex;
+			start = hex = 0;
+			dot = 0;
+		} else if(c == 'W') {
+			/* Writes ahead of the first read are done by now. */
+			if(n)
+				return 0;
+			start = hex = 0;
+			dot = 0;
+		} else if(c == '.') {
+			start = hex;
+			hex = 0;
+			dot = 1;
+		} else if(c >= '0' && c <= '9') {
+			hex = (hex << 4) | (c - '0');
+		} else if(c >= 'A' && c <= 'F') {
+			hex = (hex << 4) | (c - 'A' + 10);
+		} else if(c != ' ') {
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+static void fastload_event(vm_t *vm, void *data) {
+	uint16_t from[IN_BUF_SIZE / 2], to[IN_BUF_SIZE / 2];
+	size_t start, pos;
+	int i, n;
+
+	if((n = parse_line(vm, from, to, IN_BUF_SIZE / 2)) == 0)
+		return;
+
+	/* Check the whole line before anything goes to RAM. */
+	start = pos = state.playing ? state.pos : 0;
+	for(i = 0; i < n; i++) {
+		if((pos = read_record(NULL, pos, from[i], to[i])) == 0) {
+			fprintf(stderr, "WARNING: Fast load failed, reading the tape in real time.\n");
+			return;
+		}
+	}
+
+	pos = start;
+	for(i = 0; i < n; i++)
+		pos = read_record(vm, pos, from[i], to[i]);
+
+	tape_seek(pos, vm->cycle);
+	vm->cpu_def.set_pc(vm->cpu_state, ACI_RETURN);
+}
+
+static int hook_read(const uint16_t addr, uint8_t *res) {
+	uint16_t offs;
+
+	if((addr & 0xff00) != ACI_IO)
+		return MEM_IGNORED;
+
+	offs = addr & 0xff;
+
+	if(offs < ACI_TAPE_IN) {
+		tape_toggle(g_vm->cycle);
+	} else {
+		/* A new read after a pause is a new command line. */
+		if(g_vm->cycle - state.last_read > FRAME_CYCLES)
+			state.fast_tried = 0;
+		state.last_read = g_vm->cycle;
+
+		if(fast && !state.fast_tried) {
+			state.fast_tried = 1;
+			sched_add(g_vm, g_vm->cycle, fastload_event, NULL);
+		}
+
+		if(tape_level(g_vm->cycle))
+			offs &= ~1;
+	}
+
+	*res = g_vm->rom[ACI_ROM + offs];
+	return MEM_INTERCEPTED;
+}
+
+static int hook_write(const uint16_t addr, const uint8_t val) {
+	if((addr & 0xff00) != ACI_IO)
+		return MEM_IGNORED;
+
+	tape_toggle(g_vm->cycle);
+	return MEM_INTERCEPTED;
+}
+
+static int read_raw(FILE *fp) {
+	uint8_t buf[TP_HDR_SIZE];
+	const uint8_t *p = buf;
+	uint32_t clock;
+	int ret;
+
+	if(fread(buf, TP_HDR_SIZE, 1, fp) != 1) return RET_ERR_FORMAT;
+	if(memcmp(buf, TP_MAGIC, 4) != 0) return RET_ERR_FORMAT;
+	p += 4;
+	if(get_u16(&p) != TP_VERSION) return RET_ERR_FORMAT;
+	if((clock = get_u32(&p)) == 0) return RET_ERR_FORMAT;
+
+	while(fread(buf, 4, 1, fp) == 1) {
+		p = buf;
+		if((ret = tape_append(&tape_in, (uint32_t)((uint64_t)get_u32(&p) * CPU_CLOCK / clock))) != RET_OK)
+			return ret;
+	}
+
+	return RET_OK;
+}
+
+/* Level changes with some hysteresis become edges; the time before the
+ * first one is dropped. */
+static int read_wav(FILE *fp) {
+	uint8_t hdr[16], buf[WAV_BLOCK];
+	const uint8_t *p;
+	uint32_t size, rate = 0;
+	uint16_t format, channels = 0, bits = 0;
+	size_t frame, n, i;
+	uint64_t sample = 0, edge, last = 0;
+	int32_t val, threshold;
+	int level = -1, ret;
+
+	if(fread(hdr, 12, 1, fp) != 1) return RET_ERR_FORMAT;
+	if(memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4)) return RET_ERR_FORMAT;
+
+	for(;;) {
+		if(fread(hdr, 8, 1, fp) != 1) return RET_ERR_FORMAT;
+		p = hdr + 4;
+		size = get_u32(&p);
+
+		if(!memcmp(hdr, "data", 4))
+			break;
+
+		if(!memcmp(hdr, "fmt ", 4)) {
+			if(size < 16 || fread(hdr, 16, 1, fp) != 1) return RET_ERR_FORMAT;
+			p = hdr;
+			format = get_u16(&p);
+			channels = get_u16(&p);
+			rate = get_u32(&p);
+			p += 6;
+			bits = get_u16(&p);
+			if(format != 1) return RET_ERR_FORMAT;
+			size -= 16;
+		}
+
+		if(fseek(fp, (size + 1) & ~1, SEEK_CUR)) return RET_ERR_FORMAT;
+	}
+
+	if(channels == 0 || rate == 0 || (bits != 8 && bits != 16))
+		return RET_ERR_FORMAT;
+
+	frame = channels * (bits / 8);
+	threshold = (bits == 8) ? 8 : 2048;
+
+	while(size >= frame && (n = fread(buf, frame, ((size < sizeof(buf)) ? size : sizeof(buf)) / frame, fp)) > 0) {
+		size -= n * frame;
+
+		for(i = 0; i < n; i++, sample++) {
+			p = buf + i * frame;
+			val = (bits == 8) ? (int32_t)p[0] - 0x80 : (int16_t)get_u16(&p);
+
+			if(level != 1 && val > threshold)
+				level = 1;
+			else if(level != 0 && val < -threshold)
+				level = 0;
+			else
+				continue;
+
+			edge = sample * CPU_CLOCK / rate;
+			if(last && (ret = tape_append(&tape_in, (uint32_t)(edge - last))) != RET_OK)
+				return ret;
+			last = edge ? edge : 1;
+		}
+	}
+
+	return RET_OK;
+}
+
+static int load_tape(const char *filename) {
+	FILE *fp;
+	char magic[4];
+	int ret = RET_ERR_FORMAT;
+
+	if((fp = fopen(filename, "rb")) == NULL)
+		return RET_ERR_OPEN;
+
+	if(fread(magic, 4, 1, fp) == 1 && !fseek(fp, 0, SEEK_SET)) {
+		if(!memcmp(magic, TP_MAGIC, 4))
+			ret = read_raw(fp);
+		else if(!memcmp(magic, "RIFF", 4))
+			ret = read_wav(fp);
+	}
+
+	fclose(fp);
+	return ret;
+}
+
+static int is_wav(const char *filename) {
+	size_t len = strlen(filename);
+	const char *ext = filename + len - 4;
+	int i;
+
+	if(len < 4)
+		return 0;
+
+	for(i = 0; i < 4; i++) {
+		if((ext[i] | 0x20) != ".wav"[i])
+			return 0;
+	}
+
+	return 1;
+}
+
+static int write_raw(FILE *fp) {
+	uint8_t buf[TP_HDR_SIZE], *p = buf;
+	size_t i;
+
+	put_bytes(&p, (const uint8_t*)TP_MAGIC, 4);
+	put_u16(&p, TP_VERSION);
+	put_u32(&p, CPU_CLOCK);
+	if(fwrite(buf, TP_HDR_SIZE, 1, fp) != 1) return RET_ERR_IO;
+
+	for(i = 0; i < tape_out.len; i++) {
+		p = buf;
+		put_u32(&p, tape_out.half[i]);
+		if(fwrite(buf, 4, 1, fp) != 1) return RET_ERR_IO;
+	}
+
+	return RET_OK;
+}
+
+/* 8 bit mono square wave, starting low like the flip-flop. */
+static int write_wav(FILE *fp) {
+	uint8_t buf[WAV_BLOCK], *p = buf;
+	uint64_t cycle = 0, samples = 0, end;
+	uint32_t size;
+	size_t i, n = 0;
+	uint8_t level = WAV_LOW;
+
+	for(i = 0; i < tape_out.len; i++)
+		cycle += tape_out.half[i];
+	size = (uint32_t)(cycle * WAV_RATE / CPU_CLOCK);
+
+	put_bytes(&p, (const uint8_t*)"RIFF", 4);
+	put_u32(&p, 36 + size);
+	put_bytes(&p, (const uint8_t*)"WAVEfmt ", 8);
+	put_u32(&p, 16);
+	put_u16(&p, 1);
+	put_u16(&p, 1);
+	put_u32(&p, WAV_RATE);
+	put_u32(&p, WAV_RATE);
+	put_u16(&p, 1);
+	put_u16(&p, 8);
+	put_bytes(&p, (const uint8_t*)"data", 4);
+	put_u32(&p, size);
+	if(fwrite(buf, p - buf, 1, fp) != 1) return RET_ERR_IO;
+
+	cycle = 0;
+	for(i = 0; i < tape_out.len; i++) {
+		cycle += tape_out.half[i];
+		end = cycle * WAV_RATE / CPU_CLOCK;
+
+		for(; samples < end; samples++) {
+			buf[n++] = level;
+			if(n == sizeof(buf)) {
+				if(fwrite(buf, n, 1, fp) != 1) return RET_ERR_IO;
+				n = 0;
+			}
+		}
+
+		level = (level == WAV_LOW) ? WAV_HIGH : WAV_LOW;
+	}
+
+	if(n && fwrite(buf, n, 1, fp) != 1)
+		return RET_ERR_IO;
+
+	return RET_OK;
+}
+
+static int save_tape(const char *filename) {
+	FILE *fp;
+	int ret;
+
+	if((fp = fopen(filename, "wb")) == NULL)
+		return RET_ERR_OPEN;
+
+	ret = is_wav(filename) ? write_wav(fp) : write_raw(fp);
+
+	if(fclose(fp) != 0 && ret == RET_OK)
+		ret = RET_ERR_IO;
+
+	return ret;
+}
+
+size_t aci_save_state(uint8_t *buf) {
+	if(buf == NULL)
+		return STATE_SIZE;
+
+	put_u32(&buf, state.pos);
+	put_u64(&buf, state.edge);
+	put_u8(&buf, state.level);
+	put_u8(&buf, state.playing);
+	put_u8(&buf, state.out_level);
+	put_u64(&buf, state.out_last);
+	put_u32(&buf, state.out_len);
+	put_u64(&buf, state.last_read);
+	put_u8(&buf, state.fast_tried);
+
+	return STATE_SIZE;
+}
+
+/* Going back in time also takes back what was written since. */
+void aci_load_state(const uint8_t *buf) {
+	state.pos = get_u32(&buf);
+	state.edge = get_u64(&buf);
+	state.level = get_u8(&buf);
+	state.playing = get_u8(&buf);
+	state.out_level = get_u8(&buf);
+	state.out_last = get_u64(&buf);
+	state.out_len = get_u32(&buf);
+	state.last_read = get_u64(&buf);
+	state.fast_tried = get_u8(&buf);
+
+	if(state.out_len < tape_out.len)
+		tape_out.len = state.out_len;
+
+	if(g_vm)
+		sched_cancel(g_vm, fastload_event, NULL);
+}
+
+int aci_init(vm_t *vm, const char *rom, const char *tape_in_name, const char *tape_out_name, const int fastload) {
+	int ret;
+
+	if((ret = load_rom(vm, ACI_ROM, rom)) != RET_OK) {
+		fprintf(stderr, "aci_init(): ERROR! Couldn't load %s.\n", rom);
+		return ret;
+	}
+	mount_rom(vm, ACI_ROM, ACI_SIZE);
+
+	if(tape_in_name && (ret = load_tape(tape_in_name)) != RET_OK) {
+		fprintf(stderr, "aci_init(): ERROR! Couldn't read the tape %s.\n", tape_in_name);
+		tape_free(&tape_in);
+		return ret;
+	}
+
+	if((ret = mmio_reg(hook_write, MMIO_WRITE)) != RET_OK) return ret;
+	if((ret = mmio_reg(hook_read, MMIO_READ)) != RET_OK) return ret;
+
+	g_vm = vm;
+	out_name = tape_out_name;
+	fast = fastload;
+	memset(&state, 0, sizeof(state));
+
+	return RET_OK;
+}
+
+/* Writes the output tape, if there is one. */
+int aci_clean(void) {
+	int ret = RET_OK;
+
+	if(out_name && tape_out.len)
+		ret = save_tape(out_name);
+
+	tape_free(&tape_in);
+	tape_free(&tape_out);
+	out_name = NULL;
+
+	return ret;
+}
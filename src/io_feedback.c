@@ -0,0 +1,79 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Interrupt feedback register for Klaus Dormann's interrupt test, set
+ * up as the test's default: one open collector port without DDR. A set
+ * bit 0 holds IRQ low for as long as it stays set, setting bit 1 gives
+ * an NMI edge. Bit 7 is the diagnostic stop, which ends the run like a
+ * watchpoint. The port reads back what was written.
+ *
+ * Nothing on an Apple 1 sits there, so the register isn't part of save
+ * states.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "leakcheck.h"
+
+#include "io_feedback.h"
+#include "mem.h"
+#include "status.h"
+#include "vm.h"
+
+static vm_t *g_vm = NULL;
+static uint16_t port;
+static uint8_t latch;
+
+static int hook_read(const uint16_t addr, uint8_t *res) {
+	if(g_vm == NULL || addr != port)
+		return MEM_IGNORED;
+
+	*res = latch;
+	return MEM_INTERCEPTED;
+}
+
+static int hook_write(const uint16_t addr, const uint8_t val) {
+	if(g_vm == NULL || addr != port)
+		return MEM_IGNORED;
+
+	if((val & FEEDBACK_NMI) && !(latch & FEEDBACK_NMI))
+		g_vm->nmi = 1;
+
+	if(val & FEEDBACK_IRQ)
+		g_vm->irq |= IRQ_FEEDBACK;
+	else
+		g_vm->irq &= ~IRQ_FEEDBACK;
+
+	if(val & FEEDBACK_STOP) {
+		printf("STOP: $%02x written to $%04x.\n", val, addr);
+		g_vm->watch_hit = 1;
+		g_vm->deadline = g_vm->cycle;
+	}
+
+	latch = val;
+	return MEM_INTERCEPTED;
+}
+
+int feedback_init(vm_t *vm, const uint16_t addr) {
+	int ret;
+
+	if((ret = mmio_reg(hook_write, MMIO_WRITE)) != RET_OK) return ret;
+	if((ret = mmio_reg(hook_read, MMIO_READ)) != RET_OK) return ret;
+
+	g_vm = vm;
+	port = addr;
+	latch = 0;
+	vm->irq &= ~IRQ_FEEDBACK;
+
+	return RET_OK;
+}
+
+void feedback_clean(void) {
+	if(g_vm)
+		g_vm->irq &= ~IRQ_FEEDBACK;
+
+	g_vm = NULL;
+}
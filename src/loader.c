@@ -0,0 +1,272 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Program loaders. Unlike load_rom, these write straight to RAM.
+ *
+ * file@addr	Raw binary at addr.
+ * file		Intel HEX if the first line is a record, otherwise a Woz
+ *		monitor dump ("0300: A9 00 ...", ": 8D 12" continues).
+ *
+ * Intel HEX start records (03, 05) and a dump's "XXXXR" give a start
+ * address.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leakcheck.h"
+
+#include "loader.h"
+#include "status.h"
+#include "vm.h"
+
+#define IHEX_DATA		0x00
+#define IHEX_EOF		0x01
+#define IHEX_SEGMENT	0x02
+#define IHEX_START_SEG	0x03
+#define IHEX_LINEAR		0x04
+#define IHEX_START_LIN	0x05
+
+#define WOZ_XAM			0
+#define WOZ_BLOCK		1
+#define WOZ_STORE		2
+
+static void poke(vm_t *vm, const uint16_t addr, const uint8_t val) {
+	vm->ram[addr] = val;
+	vm->mem[addr] = val;
+}
+
+static int hexdigit(const char c) {
+	if(c >= '0' && c <= '9') return c - '0';
+	if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+/* Hex, optionally with a '$' or "0x" prefix. */
+int parse_address(const char *str, uint16_t *addr) {
+	uint32_t val = 0;
+	int d;
+
+	if(*str == '$')
+		str++;
+	else if(str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+		str += 2;
+
+	if(*str == '\0')
+		return RET_ERR_INVAL;
+
+	for(; *str; str++) {
+		if((d = hexdigit(*str)) < 0 || (val = (val << 4) | d) > 0xffff)
+			return RET_ERR_INVAL;
+	}
+
+	*addr = (uint16_t)val;
+	return RET_OK;
+}
+
+static int read_file(const char *filename, char **data, size_t *len) {
+	FILE *fp;
+	long size;
+	int ret = RET_ERR_IO;
+
+	if((fp = fopen(filename, "rb")) == NULL)
+		return RET_ERR_OPEN;
+
+	if(fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET))
+		goto closefile;
+
+	/* One more for a terminating zero, the text parsers rely on it. */
+	if((*data = malloc(size + 1)) == NULL) {
+		ret = RET_ERR_ALLOC;
+		goto closefile;
+	}
+
+	if(fread(*data, 1, size, fp) != (size_t)size) {
+		free(*data);
+		goto closefile;
+	}
+
+	(*data)[size] = '\0';
+	*len = size;
+	ret = RET_OK;
+
+closefile:
+	fclose(fp);
+	return ret;
+}
+
+static int load_raw(vm_t *vm, const char *filename, const uint16_t addr) {
+	char *data;
+	size_t len, i;
+	int ret;
+
+	if((ret = read_file(filename, &data, &len)) != RET_OK)
+		return ret;
+
+	if(addr + len > 0x10000) {
+		ret = RET_ERR_INVAL;
+	} else {
+		for(i = 0; i < len; i++)
+			poke(vm, (uint16_t)(addr + i), (uint8_t)data[i]);
+	}
+
+	free(data);
+	return ret;
+}
+
+static int hexbyte(const char *p) {
+	int hi = hexdigit(p[0]), lo;
+
+	if(hi < 0 || (lo = hexdigit(p[1])) < 0)
+		return -1;
+
+	return (hi << 4) | lo;
+}
+
+/* Only the 64K below any extended address are accepted. */
+static int load_ihex(vm_t *vm, const char *text, uint32_t *start) {
+	uint8_t rec[260];
+	uint32_t addr;
+	uint8_t sum;
+	int n, i, val;
+
+	while(*text) {
+		if(*text != ':') {
+			text++;
+			continue;
+		}
+		text++;
+
+		for(n = 0; (val = hexbyte(text)) >= 0 && n < (int)sizeof(rec); n++, text += 2)
+			rec[n] = val;
+
+		if(n < 5 || n != rec[0] + 5)
+			return RET_ERR_FORMAT;
+
+		for(sum = 0, i = 0; i < n; i++)
+			sum += rec[i];
+		if(sum != 0)
+			return RET_ERR_FORMAT;
+
+		addr = (rec[1] << 8) | rec[2];
+
+		switch(rec[3]) {
+			case IHEX_DATA:
+				if(addr + rec[0] > 0x10000)
+					return RET_ERR_INVAL;
+				for(i = 0; i < rec[0]; i++)
+					poke(vm, (uint16_t)(addr + i), rec[4 + i]);
+				break;
+
+			case IHEX_EOF:
+				return RET_OK;
+
+			case IHEX_SEGMENT:
+			case IHEX_LINEAR:
+				if(rec[0] != 2 || rec[4] || rec[5])
+					return RET_ERR_INVAL;
+				break;
+
+			case IHEX_START_SEG:
+			case IHEX_START_LIN:
+				if(rec[0] != 4)
+					return RET_ERR_FORMAT;
+				*start = (rec[6] << 8) | rec[7];
+				break;
+
+			default:
+				return RET_ERR_FORMAT;
+		}
+	}
+
+	return RET_OK;
+}
+
+/* Reads the dump the way the Woz monitor reads a line: a number sets the
+ * address, after ':' numbers are stored, after '.' they end a range to
+ * examine, 'R' runs. The store address carries over to the next line. */
+static int load_woz(vm_t *vm, const char *text, uint32_t *start) {
+	uint16_t addr = 0, store = 0;
+	uint32_t val;
+	int mode = WOZ_XAM, stored = 0, digits, d;
+
+	while(*text) {
+		for(val = 0, digits = 0; (d = hexdigit(*text)) >= 0; text++, digits++)
+			val = (val << 4) | d;
+
+		if(digits) {
+			if(mode == WOZ_STORE) {
+				poke(vm, store++, (uint8_t)val);
+				stored = 1;
+			} else if(mode == WOZ_XAM) {
+				addr = store = (uint16_t)val;
+			}
+			continue;
+		}
+
+		switch(*text++) {
+			case ':':	mode = WOZ_STORE; break;
+			case '.':	mode = WOZ_BLOCK; break;
+			case 'R':	*start = addr; break;
+			case '\n':
+			case '\r':	mode = WOZ_XAM; break;
+		}
+	}
+
+	return stored ? RET_OK : RET_ERR_FORMAT;
+}
+
+static int is_ihex(const char *text) {
+	while(*text == ' ' || *text == '\t' || *text == '\r' || *text == '\n')
+		text++;
+
+	if(*text++ != ':')
+		return 0;
+
+	while(hexdigit(*text) >= 0)
+		text++;
+
+	return *text == '\0' || *text == '\r' || *text == '\n';
+}
+
+/* Loads spec into RAM. *start is set if the file names a start
+ * address and left alone otherwise. */
+int load_program(vm_t *vm, const char *spec, uint32_t *start) {
+	const char *at = strrchr(spec, '@');
+	char *filename, *text;
+	uint16_t addr;
+	size_t len;
+	int ret;
+
+	if(at) {
+		if(parse_address(at + 1, &addr) != RET_OK)
+			return RET_ERR_INVAL;
+
+		if((filename = malloc(at - spec + 1)) == NULL)
+			return RET_ERR_ALLOC;
+
+		memcpy(filename, spec, at - spec);
+		filename[at - spec] = '\0';
+
+		ret = load_raw(vm, filename, addr);
+
+		free(filename);
+		return ret;
+	}
+
+	if((ret = read_file(spec, &text, &len)) != RET_OK)
+		return ret;
+
+	if(is_ihex(text))
+		ret = load_ihex(vm, text, start);
+	else
+		ret = load_woz(vm, text, start);
+
+	free(text);
+	return ret;
+}
@@ -13,14 +13,83 @@
 
 #include "leakcheck.h"
 
+#include "basic.h"
+#include "callgraph.h"
+#include "checkpoint.h"
+#include "console.h"
+#include "coverage.h"
+#include "heatmap.h"
 #include "input.h"
 #include "cpu_6502.h"
+#include "display.h"
+#include "io_6820.h"
+#include "io_aci.h"
+#include "loader.h"
 #include "mem.h"
+#include "pace.h"
+#include "profile.h"
+#include "replay.h"
+#include "rewind.h"
+#include "sched.h"
 #include "status.h"
+#include "symbols.h"
+#include "trace.h"
 #include "vm.h"
+#include "watch.h"
 
 #define ENTRY_POINT	0
 
+#define MAX_LOADS	16
+#define MAX_SYMBOLS	8
+#define MAX_WATCHES	16
+
+#define CHECKPOINT_INTERVAL	10000000
+
+#define REWIND_KEY_CYCLES	1000000		/* F5 */
+#define REWIND_KEY_STEPS	1			/* F6 */
+
+typedef struct options_t {
+	int show;
+	const char *checkpoint;
+	uint32_t checkpoint_interval;
+	const char *resume;
+	const char *inspect;
+	const char *record;
+	const char *replay;
+	size_t rewind_budget;
+	uint32_t rewind_interval;
+	double speed;
+	int turbo;
+	dispdef_t *display;
+	const char *paste;
+	const char *console;
+	const char *tape_in;
+	const char *tape_out;
+	int fast_load;
+	const char *load[MAX_LOADS];
+	int n_loads;
+	int set_pc;
+	uint16_t pc;
+	const char *basic_load;
+	const char *basic_save;
+	const char *trace;
+	const char *coverage;
+	int coverage_rw;
+	const char *heatmap;
+	int heatmap_interval;
+	const char *watch[MAX_WATCHES];
+	int watch_type[MAX_WATCHES];
+	int n_watches;
+	const char *profile_csv;
+	const char *folded;
+	const char *symbols[MAX_SYMBOLS];
+	int n_symbols;
+} options_t;
+
+static vm_t *g_vm = NULL;
+static checkpoint_t *g_cp = NULL;
+static uint32_t g_checkpoint_interval;
+
 static void memdump(vm_t *vm) {
 	FILE *ram = fopen("ram.bin", "wb");
 	FILE *mem = fopen("mem.bin", "wb");
@@ -48,6 +117,327 @@ static int load_and_mount(vm_t *vm, const char *filename, const uint16_t base, c
 	return ret;
 }
 
+/* Without --load this is a free thing to test the 6502 Emulator. */
+static int load_programs(vm_t *vm, const options_t *opt) {
+	uint32_t start = LOAD_NO_START;
+	int i, ret;
+
+	if(opt->n_loads == 0) {
+		if((ret = load_and_mount(vm, "rom/test.bin", 0x0000, 0x10000)) != RET_OK)
+			return ret;
+		start = 0x400;
+	}
+
+	for(i = 0; i < opt->n_loads; i++) {
+		if((ret = load_program(vm, opt->load[i], &start)) != RET_OK) {
+			fprintf(stderr, "ERROR: Couldn't load %s.\n", opt->load[i]);
+			return ret;
+		}
+	}
+
+	vm->cpu_def.reset(vm->cpu_state);
+
+	if(opt->set_pc)
+		start = opt->pc;
+	if(start != LOAD_NO_START)
+		vm->cpu_def.set_pc(vm->cpu_state, (uint16_t)start);
+
+	return RET_OK;
+}
+
+#ifdef CPU_PROFILE
+static symbols_t *start_callgraph(const options_t *opt) {
+	symbols_t *syms;
+	int i;
+
+	if((syms = symbols_init()) == NULL)
+		return NULL;
+
+	for(i = 0; i < opt->n_symbols; i++) {
+		if(symbols_load(syms, opt->symbols[i]) != RET_OK) {
+			fprintf(stderr, "ERROR: Couldn't read the symbols from %s.\n", opt->symbols[i]);
+			goto freesyms;
+		}
+	}
+
+	if(callgraph_start(opt->folded, syms) != RET_OK) {
+		fprintf(stderr, "ERROR: callgraph_start() failed.\n");
+		goto freesyms;
+	}
+
+	return syms;
+
+freesyms:
+	symbols_free(syms);
+	return NULL;
+}
+#endif
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [options]\n", name);
+	fprintf(stderr, "  -q                         Don't print the CPU state after every step.\n");
+	fprintf(stderr, "  --checkpoint <file>        Write periodic checkpoints to <file>.\n");
+	fprintf(stderr, "  --checkpoint-interval <n>  Cycles between checkpoints (default %d).\n", CHECKPOINT_INTERVAL);
+	fprintf(stderr, "  --resume <file>            Resume from the last checkpoint in <file>.\n");
+	fprintf(stderr, "  --inspect <file>           List the checkpoints in <file> and exit.\n");
+	fprintf(stderr, "  --record <file>            Record all input to <file>.\n");
+	fprintf(stderr, "  --replay <file>            Replay the input from <file> instead of SDL.\n");
+	fprintf(stderr, "  --rewind-budget <MiB>      Memory for rewind snapshots, 0 disables (default %d).\n", REWIND_BUDGET >> 20);
+	fprintf(stderr, "  --rewind-interval <n>      Cycles between rewind snapshots (default %d).\n", REWIND_INTERVAL);
+	fprintf(stderr, "  --speed <x>                Run at <x> times the Apple 1 clock (default 1).\n");
+	fprintf(stderr, "  --turbo                    Start unthrottled, F7 toggles.\n");
+	fprintf(stderr, "  --display <sdl|ansi|null>  Where the screen goes (default sdl).\n");
+	fprintf(stderr, "  --paste <file>             Type <file> into the keyboard (F2 pastes the clipboard).\n");
+	fprintf(stderr, "  --console <path>           Serve the keyboard and screen on a local socket.\n");
+	fprintf(stderr, "  --tape-in <file>           Put the WAV or raw tape <file> into the ACI.\n");
+	fprintf(stderr, "  --tape-out <file>          Record the ACI output to <file> (.wav or raw).\n");
+	fprintf(stderr, "  --fast-load                Load tape records into RAM at once.\n");
+	fprintf(stderr, "  --load <file>[@addr]       Put a program into RAM: raw at addr, else Intel HEX\n");
+	fprintf(stderr, "                             or a Woz monitor dump. Repeatable.\n");
+	fprintf(stderr, "  --pc <addr>                Start at addr instead of the reset vector.\n");
+	fprintf(stderr, "  --basic-load <file>        Put a saved BASIC program into RAM, enter with E2B3R.\n");
+	fprintf(stderr, "  --basic-save <file>        Save the BASIC program in RAM on exit.\n");
+	fprintf(stderr, "  --trace <file>             Write a binary execution trace instead of printing\n");
+	fprintf(stderr, "                             the CPU state (read it with a1trace, compare\n");
+	fprintf(stderr, "                             with a1tracediff).\n");
+	fprintf(stderr, "  --coverage <file>          Add the executed addresses to <file> (see a1cov).\n");
+	fprintf(stderr, "  --coverage-rw              Also record the addresses read and written.\n");
+	fprintf(stderr, "  --heatmap <file>           Count the accesses to every address and write them\n");
+	fprintf(stderr, "                             to <file> on exit (.png renders them).\n");
+	fprintf(stderr, "  --heatmap-interval <ms>    Also rewrite the heatmap while running.\n");
+	fprintf(stderr, "  --break <spec>             Stop before executing an address in <spec>.\n");
+	fprintf(stderr, "  --watch-read <spec>        Stop after reading from an address in <spec>.\n");
+	fprintf(stderr, "  --watch-write <spec>       Stop after writing to an address in <spec>.\n");
+	fprintf(stderr, "                             <spec> is <from>[-<to>][:<condition>], e.g.\n");
+	fprintf(stderr, "                             \"d012:A == $8d\" or \"0200-027f:V != OLD\".\n");
+	fprintf(stderr, "                             Repeatable.\n");
+#ifdef CPU_PROFILE
+	fprintf(stderr, "  --profile-csv <file>       Write the instruction counts to <file> on exit.\n");
+	fprintf(stderr, "  --folded <file>            Write the cycles per guest call stack to <file>\n");
+	fprintf(stderr, "                             for flamegraph.pl.\n");
+	fprintf(stderr, "  --symbols <file>           Name subroutines after the labels in an assembler\n");
+	fprintf(stderr, "                             listing or label file. Repeatable.\n");
+#endif
+}
+
+static dispdef_t *find_display(const char *name) {
+	static dispdef_t *displays[] = { &display_sdl, &display_ansi, &display_null };
+	size_t i;
+
+	for(i = 0; i < sizeof(displays) / sizeof(displays[0]); i++) {
+		if(!strcmp(displays[i]->name, name))
+			return displays[i];
+	}
+
+	return NULL;
+}
+
+static int parse_args(int argc, char **argv, options_t *opt) {
+	int i;
+
+	opt->show = 1;
+	opt->checkpoint = NULL;
+	opt->checkpoint_interval = CHECKPOINT_INTERVAL;
+	opt->resume = NULL;
+	opt->inspect = NULL;
+	opt->record = NULL;
+	opt->replay = NULL;
+	opt->rewind_budget = REWIND_BUDGET;
+	opt->rewind_interval = REWIND_INTERVAL;
+	opt->speed = 1.0;
+	opt->turbo = 0;
+	opt->display = &display_sdl;
+	opt->paste = NULL;
+	opt->console = NULL;
+	opt->tape_in = NULL;
+	opt->tape_out = NULL;
+	opt->fast_load = 0;
+	opt->n_loads = 0;
+	opt->set_pc = 0;
+	opt->basic_load = NULL;
+	opt->basic_save = NULL;
+	opt->trace = NULL;
+	opt->coverage = NULL;
+	opt->coverage_rw = 0;
+	opt->heatmap = NULL;
+	opt->heatmap_interval = 0;
+	opt->n_watches = 0;
+	opt->profile_csv = NULL;
+	opt->folded = NULL;
+	opt->n_symbols = 0;
+
+	for(i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-q")) {
+			opt->show = 0;
+		} else if(!strcmp(argv[i], "--turbo")) {
+			opt->turbo = 1;
+		} else if(!strcmp(argv[i], "--fast-load")) {
+			opt->fast_load = 1;
+		} else if(!strcmp(argv[i], "--coverage-rw")) {
+			opt->coverage_rw = 1;
+		} else if(i + 1 == argc) {
+			return RET_ERR_INVAL;
+		} else if(!strcmp(argv[i], "--checkpoint")) {
+			opt->checkpoint = argv[++i];
+		} else if(!strcmp(argv[i], "--checkpoint-interval")) {
+			if((opt->checkpoint_interval = strtoul(argv[++i], NULL, 0)) == 0)
+				return RET_ERR_INVAL;
+		} else if(!strcmp(argv[i], "--resume")) {
+			opt->resume = argv[++i];
+		} else if(!strcmp(argv[i], "--inspect")) {
+			opt->inspect = argv[++i];
+		} else if(!strcmp(argv[i], "--record")) {
+			opt->record = argv[++i];
+		} else if(!strcmp(argv[i], "--replay")) {
+			opt->replay = argv[++i];
+		} else if(!strcmp(argv[i], "--rewind-budget")) {
+			opt->rewind_budget = (size_t)strtoul(argv[++i], NULL, 0) << 20;
+		} else if(!strcmp(argv[i], "--rewind-interval")) {
+			if((opt->rewind_interval = strtoul(argv[++i], NULL, 0)) == 0)
+				return RET_ERR_INVAL;
+		} else if(!strcmp(argv[i], "--display")) {
+			if((opt->display = find_display(argv[++i])) == NULL)
+				return RET_ERR_INVAL;
+		} else if(!strcmp(argv[i], "--paste")) {
+			opt->paste = argv[++i];
+		} else if(!strcmp(argv[i], "--console")) {
+			opt->console = argv[++i];
+		} else if(!strcmp(argv[i], "--tape-in")) {
+			opt->tape_in = argv[++i];
+		} else if(!strcmp(argv[i], "--tape-out")) {
+			opt->tape_out = argv[++i];
+		} else if(!strcmp(argv[i], "--load")) {
+			if(opt->n_loads == MAX_LOADS)
+				return RET_ERR_INVAL;
+			opt->load[opt->n_loads++] = argv[++i];
+		} else if(!strcmp(argv[i], "--pc")) {
+			if(parse_address(argv[++i], &opt->pc) != RET_OK)
+				return RET_ERR_INVAL;
+			opt->set_pc = 1;
+		} else if(!strcmp(argv[i], "--basic-load")) {
+			opt->basic_load = argv[++i];
+		} else if(!strcmp(argv[i], "--basic-save")) {
+			opt->basic_save = argv[++i];
+		} else if(!strcmp(argv[i], "--trace")) {
+			opt->trace = argv[++i];
+			opt->show = 0;
+		} else if(!strcmp(argv[i], "--coverage")) {
+			opt->coverage = argv[++i];
+		} else if(!strcmp(argv[i], "--heatmap")) {
+			opt->heatmap = argv[++i];
+		} else if(!strcmp(argv[i], "--heatmap-interval")) {
+			if((opt->heatmap_interval = (int)strtoul(argv[++i], NULL, 0)) == 0)
+				return RET_ERR_INVAL;
+		} else if(!strcmp(argv[i], "--break") || !strcmp(argv[i], "--watch-read") || !strcmp(argv[i], "--watch-write")) {
+			if(opt->n_watches == MAX_WATCHES)
+				return RET_ERR_INVAL;
+			opt->watch_type[opt->n_watches] = !strcmp(argv[i], "--break") ? TRAP_EXEC :
+				!strcmp(argv[i], "--watch-read") ? TRAP_READ : TRAP_WRITE;
+			opt->watch[opt->n_watches++] = argv[++i];
+#ifdef CPU_PROFILE
+		} else if(!strcmp(argv[i], "--profile-csv")) {
+			opt->profile_csv = argv[++i];
+		} else if(!strcmp(argv[i], "--folded")) {
+			opt->folded = argv[++i];
+		} else if(!strcmp(argv[i], "--symbols")) {
+			if(opt->n_symbols == MAX_SYMBOLS)
+				return RET_ERR_INVAL;
+			opt->symbols[opt->n_symbols++] = argv[++i];
+#endif
+		} else if(!strcmp(argv[i], "--speed")) {
+			if((opt->speed = strtod(argv[++i], NULL)) <= 0)
+				return RET_ERR_INVAL;
+		} else {
+			return RET_ERR_INVAL;
+		}
+	}
+
+	if(opt->record && opt->replay)
+		return RET_ERR_INVAL;
+
+	if(opt->replay && opt->paste)
+		return RET_ERR_INVAL;
+
+	if(opt->fast_load && !opt->tape_in)
+		return RET_ERR_INVAL;
+
+	if(opt->coverage_rw && !opt->coverage)
+		return RET_ERR_INVAL;
+
+	if(opt->heatmap_interval && !opt->heatmap)
+		return RET_ERR_INVAL;
+
+	return RET_OK;
+}
+
+static int inspect(const char *filename) {
+	checkpoint_reader_t *cr;
+	int ret, n = 0;
+
+	if((cr = checkpoint_open(filename, &ret)) == NULL) {
+		fprintf(stderr, "ERROR: checkpoint_open() failed.\n");
+		return ret;
+	}
+
+	while((ret = checkpoint_next(cr)) == RET_OK) {
+		printf("%6d %c cycle %12llu  %8lu bytes\n", n++, checkpoint_type(cr),
+			(unsigned long long)checkpoint_cycle(cr), (unsigned long)checkpoint_packed_size(cr));
+	}
+
+	checkpoint_close_reader(cr);
+	return (ret == RET_EOF) ? RET_OK : ret;
+}
+
+static int resume(vm_t *vm, const char *filename) {
+	checkpoint_reader_t *cr;
+	int ret;
+
+	if((cr = checkpoint_open(filename, &ret)) == NULL) {
+		fprintf(stderr, "ERROR: checkpoint_open() failed.\n");
+		return ret;
+	}
+
+	while((ret = checkpoint_next(cr)) == RET_OK);
+
+	if(ret == RET_EOF)
+		ret = checkpoint_restore(cr, vm);
+	if(ret != RET_OK)
+		fprintf(stderr, "ERROR: No usable checkpoint in %s.\n", filename);
+
+	checkpoint_close_reader(cr);
+	return ret;
+}
+
+static void checkpoint_event(vm_t *vm, void *data) {
+	checkpoint_write(g_cp, vm, 0);
+	sched_add(vm, vm->cycle + g_checkpoint_interval, checkpoint_event, NULL);
+}
+
+static int hotkeys(key_input_t *key_input) {
+	int ret;
+
+	if(key_input->type != DOWN)
+		return INPUT_IGNORED;
+
+	switch(key_input->Keysym.sym) {
+		case SDLK_F5:
+			ret = rewind_to_cycle(g_vm, (g_vm->cycle > REWIND_KEY_CYCLES) ? g_vm->cycle - REWIND_KEY_CYCLES : 0);
+			break;
+
+		case SDLK_F6:
+			ret = rewind_steps(g_vm, REWIND_KEY_STEPS);
+			break;
+
+		default:
+			return INPUT_IGNORED;
+	}
+
+	if(ret == RET_OK)
+		g_vm->cpu_def.print_state(g_vm->cpu_state, g_vm->step);
+
+	return INPUT_CONSUMED;
+}
+
 int global_setup(void) {
 	int ret;
 
@@ -58,20 +448,35 @@ int global_setup(void) {
 }
 
 void global_clean(void) {
+	rewind_clean();
+	replay_clean();
 	input_clean();
 	mmio_clean();
 }
 
-int main(void) {
-	int status, show = 1;
+int main(int argc, char **argv) {
+	int status = RET_OK, i;
+	options_t opt;
+	console_t *con = NULL;
 	vm_t *vm;
+#ifdef CPU_PROFILE
+	symbols_t *syms = NULL;
+#endif
+
+	if(parse_args(argc, argv, &opt) != RET_OK) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if(opt.inspect)
+		return (inspect(opt.inspect) == RET_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
 
 	if(global_setup() != RET_OK) {
 		fprintf(stderr, "ERROR: global_setup() failed.\n");
 		return EXIT_FAILURE;
 	}
 
-	vm = vm_init(cpu_6502, &status);
+	vm = vm_init(cpu_6502, *opt.display, &status);
 	if(status != RET_OK) {
 		fprintf(stderr, "ERROR: vm_init() failed.\n");
 		return EXIT_FAILURE;
@@ -91,26 +496,159 @@ int main(void) {
 	vm->cpu_def.reset(vm->cpu_state);
 */
 
-	/* This is a free thing to test the 6502 Emulator.  */
-	if(load_and_mount(vm, "rom/test.bin", 0x0000, 0x10000) != RET_OK) return EXIT_FAILURE;
-	vm->cpu_def.reset(vm->cpu_state);
-	vm->cpu_def.set_pc(vm->cpu_state, 0x400);
+	if(load_programs(vm, &opt) != RET_OK) return EXIT_FAILURE;
 
+	if(opt.basic_load && basic_load(vm, opt.basic_load) != RET_OK) {
+		fprintf(stderr, "ERROR: Couldn't load the BASIC program %s.\n", opt.basic_load);
+		return EXIT_FAILURE;
+	}
+
+	if((opt.tape_in || opt.tape_out) && aci_init(vm, ACI_ROM_FILE, opt.tape_in, opt.tape_out, opt.fast_load) != RET_OK) {
+		fprintf(stderr, "ERROR: aci_init() failed.\n");
+		return EXIT_FAILURE;
+	}
+
+	if(opt.resume && resume(vm, opt.resume) != RET_OK) return EXIT_FAILURE;
+
+	if(opt.record && replay_record(opt.record) != RET_OK) {
+		fprintf(stderr, "ERROR: replay_record() failed.\n");
+		return EXIT_FAILURE;
+	}
+
+	if(opt.replay && replay_load(vm, opt.replay) != RET_OK) {
+		fprintf(stderr, "ERROR: replay_load() failed.\n");
+		return EXIT_FAILURE;
+	}
+
+	if(opt.rewind_budget) {
+		if(rewind_init(vm, opt.rewind_budget, opt.rewind_interval) != RET_OK) {
+			fprintf(stderr, "ERROR: rewind_init() failed.\n");
+			return EXIT_FAILURE;
+		}
+		g_vm = vm;
+		input_reg(hotkeys, HPROC_KEYBOARD);
+	}
+
+	if(opt.checkpoint) {
+		if((g_cp = checkpoint_create(vm, opt.checkpoint, &status)) == NULL) {
+			fprintf(stderr, "ERROR: checkpoint_create() failed.\n");
+			return EXIT_FAILURE;
+		}
+		g_checkpoint_interval = opt.checkpoint_interval;
+		sched_add(vm, vm->cycle + g_checkpoint_interval, checkpoint_event, NULL);
+	}
+
+	if(opt.paste && pia_paste_file(opt.paste) != RET_OK) {
+		fprintf(stderr, "ERROR: Couldn't paste %s.\n", opt.paste);
+		return EXIT_FAILURE;
+	}
+
+	if(opt.console && (con = console_create(vm, opt.console, &status)) == NULL) {
+		fprintf(stderr, "ERROR: Couldn't open the console at %s.\n", opt.console);
+		return EXIT_FAILURE;
+	}
+
+	if(opt.trace && trace_start(vm, opt.trace) != RET_OK) {
+		fprintf(stderr, "ERROR: Couldn't start the trace %s.\n", opt.trace);
+		return EXIT_FAILURE;
+	}
+
+	if(opt.heatmap && heatmap_start(vm, opt.heatmap, opt.heatmap_interval) != RET_OK) {
+		fprintf(stderr, "ERROR: heatmap_start() failed.\n");
+		return EXIT_FAILURE;
+	}
+
+	for(i = 0; i < opt.n_watches; i++) {
+		if(watch_add(vm, opt.watch_type[i], opt.watch[i]) != RET_OK) {
+			fprintf(stderr, "ERROR: Invalid breakpoint or watchpoint %s.\n", opt.watch[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(opt.coverage && coverage_start(vm, opt.coverage, opt.coverage_rw) != RET_OK) {
+		fprintf(stderr, "ERROR: Couldn't read the coverage %s.\n", opt.coverage);
+		return EXIT_FAILURE;
+	}
+
+#ifdef CPU_PROFILE
+	if(opt.folded && (syms = start_callgraph(&opt)) == NULL)
+		return EXIT_FAILURE;
+#endif
+
+	if(pace_init(vm, opt.speed, opt.turbo) != RET_OK) {
+		fprintf(stderr, "ERROR: pace_init() failed.\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Slices end on frame boundaries, so every slice is followed by
+	 * exactly one frame and the pacing wait. */
 	while(vm->quit == 0) {
-		input_get();
-		input_dispatch();
+		if(!replay_playing()) {
+			input_get();
+			input_dispatch();
+		}
+
+		if(con)
+			console_poll(con);
 
-		vm_step(vm, &status);
+		if(opt.show) {
+			vm_step(vm, &status);
+			vm->cpu_def.print_state(vm->cpu_state, vm->step);
+		} else {
+			vm_run(vm, (vm->cycle / FRAME_CYCLES + 1) * FRAME_CYCLES, &status);
+		}
 
-		if(show) vm->cpu_def.print_state(vm->cpu_state, vm->step);
+		pace_sync(vm);
 
 		if(status == RET_LOOP)
 			vm->quit = 1;
+
+		if(status == RET_BREAK) {
+			if(!opt.show)
+				vm->cpu_def.print_state(vm->cpu_state, vm->step);
+			vm->quit = 1;
+		}
 	}
 
+	if(g_cp) {
+		checkpoint_write(g_cp, vm, 1);
+		if(checkpoint_close(g_cp) != RET_OK)
+			fprintf(stderr, "ERROR: Couldn't write the checkpoint file %s.\n", opt.checkpoint);
+	}
+
+	if(trace_stop(vm) != RET_OK)
+		fprintf(stderr, "ERROR: Couldn't write the trace %s.\n", opt.trace);
+
+	if(coverage_stop(vm) != RET_OK)
+		fprintf(stderr, "ERROR: Couldn't write the coverage %s.\n", opt.coverage);
+
+	if(heatmap_stop(vm) != RET_OK)
+		fprintf(stderr, "ERROR: Couldn't write the heatmap %s.\n", opt.heatmap);
+
+	if(opt.basic_save && basic_save(vm, opt.basic_save) != RET_OK)
+		fprintf(stderr, "ERROR: Couldn't save the BASIC program to %s.\n", opt.basic_save);
+
+	if(aci_clean() != RET_OK)
+		fprintf(stderr, "ERROR: Couldn't write the tape %s.\n", opt.tape_out);
+
 	vm_clean(vm);
+
+	if(con)
+		console_close(con);
+
 	global_clean();
 
+#ifdef CPU_PROFILE
+	profile_print(stdout);
+	if(opt.profile_csv && profile_write_csv(opt.profile_csv) != RET_OK)
+		fprintf(stderr, "ERROR: Couldn't write the profile to %s.\n", opt.profile_csv);
+
+	if(callgraph_stop() != RET_OK)
+		fprintf(stderr, "ERROR: Couldn't write the call graph to %s.\n", opt.folded);
+	if(syms)
+		symbols_free(syms);
+#endif
+
 #ifdef _DEBUG
 	mem_stats(stdout);
 #endif
@@ -13,9 +13,13 @@
 
 #include "leakcheck.h"
 
+#include "covfile.h"
+#include "heatmap.h"
 #include "mem.h"
 #include "status.h"
+#include "tracefile.h"
 #include "vm.h"
+#include "watch.h"
 
 typedef struct mmioproc_list_t {
 	size_t n_read_reg, n_read_alloced;
@@ -28,13 +32,21 @@ typedef struct mmioproc_list_t {
 //readproc_list_t *readproc_list = NULL;
 mmioproc_list_t *mmioproc_list = NULL;
 
-void *get_pointer(vm_t *vm, const size_t offset) {
-	return vm->mem + offset;
-}
-
 void write_mem(vm_t *vm, const uint16_t addr, const uint8_t val) {
 	int i;
 
+	if(vm->n_writes < TRACE_MAX_WRITES)
+		vm->writes[vm->n_writes++] = ((uint32_t)addr << 8) | val;
+
+	if(vm->cov_write)
+		COV_MARK(vm->cov_write, addr);
+
+	if(vm->heat_write)
+		HEAT_COUNT(vm->heat_write, addr);
+
+	if(vm->trap[addr >> 8] & TRAP_WRITE)
+		watch_access(vm, TRAP_WRITE, addr, vm->mem[addr], val);
+
 	for(i = 0; i < mmioproc_list->n_write_reg; i++)
 		if(mmioproc_list->write_proc[i](addr, val) == MEM_INTERCEPTED)
 			return;
@@ -44,7 +56,7 @@ void write_mem(vm_t *vm, const uint16_t addr, const uint8_t val) {
 		vm->mem[addr] = val;
 }
 
-uint8_t read_mem(vm_t *vm, const uint16_t addr) {
+static uint8_t read_bus(vm_t *vm, const uint16_t addr) {
 	int i;
 	uint8_t res;
 
@@ -55,6 +67,23 @@ uint8_t read_mem(vm_t *vm, const uint16_t addr) {
 	return vm->mem[addr];
 }
 
+uint8_t read_mem(vm_t *vm, const uint16_t addr) {
+	uint8_t res;
+
+	if(vm->cov_read)
+		COV_MARK(vm->cov_read, addr);
+
+	if(vm->heat_read)
+		HEAT_COUNT(vm->heat_read, addr);
+
+	if(!(vm->trap[addr >> 8] & TRAP_READ))
+		return read_bus(vm, addr);
+
+	res = read_bus(vm, addr);
+	watch_access(vm, TRAP_READ, addr, res, res);
+	return res;
+}
+
 uint16_t read_ptr(vm_t *vm, const uint16_t addr) {
 	return read_mem(vm, addr) | (read_mem(vm, addr + 1) << 8);
 }
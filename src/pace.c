@@ -0,0 +1,93 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Real-time pacing. The emulated clock is tied to the host's monotonic
+ * performance counter: each slice has an absolute host deadline derived
+ * from the cycle count, so oversleeping in one slice is paid back in the
+ * next one instead of accumulating. If the host falls too far behind,
+ * the reference point is moved rather than running a catch-up burst.
+ */
+
+#include <stdint.h>
+
+#include <SDL.h>
+
+#include "leakcheck.h"
+
+#include "input.h"
+#include "pace.h"
+#include "status.h"
+#include "vm.h"
+
+#define SPIN_MS		2		/* Busy-wait the last few ms of a sleep */
+
+typedef struct pace_t {
+	int turbo;
+	double ticks_per_cycle;
+	uint64_t freq;
+	uint64_t host_base, cycle_base;
+	vm_t *vm;
+} pace_t;
+
+static pace_t pace;
+
+static void resync(vm_t *vm) {
+	pace.host_base = SDL_GetPerformanceCounter();
+	pace.cycle_base = vm->cycle;
+}
+
+static int pace_keyboard(key_input_t *key_input) {
+	if(key_input->Keysym.sym != SDLK_F7)
+		return INPUT_IGNORED;
+
+	if(key_input->type == DOWN) {
+		pace.turbo = !pace.turbo;
+		resync(pace.vm);
+	}
+
+	return INPUT_CONSUMED;
+}
+
+int pace_init(vm_t *vm, const double speed, const int turbo) {
+	if(speed <= 0)
+		return RET_ERR_INVAL;
+
+	pace.vm = vm;
+	pace.turbo = turbo;
+	pace.freq = SDL_GetPerformanceFrequency();
+	pace.ticks_per_cycle = (double)pace.freq / (CPU_CLOCK * speed);
+	resync(vm);
+
+	return input_reg(pace_keyboard, HPROC_KEYBOARD);
+}
+
+/* Waits until the host clock has caught up with the emulated one. */
+void pace_sync(vm_t *vm) {
+	uint64_t now, target, ms;
+
+	if(pace.turbo)
+		return;
+
+	/* The clock went backwards, e.g. after a rewind. */
+	if(vm->cycle < pace.cycle_base) {
+		resync(vm);
+		return;
+	}
+
+	target = pace.host_base + (uint64_t)((double)(vm->cycle - pace.cycle_base) * pace.ticks_per_cycle);
+	now = SDL_GetPerformanceCounter();
+
+	if(now >= target) {
+		if(now - target > pace.freq / PACE_MAX_LAG)
+			resync(vm);
+		return;
+	}
+
+	ms = (target - now) * 1000 / pace.freq;
+	if(ms > SPIN_MS)
+		SDL_Delay((Uint32)(ms - SPIN_MS));
+
+	while(SDL_GetPerformanceCounter() < target);
+}
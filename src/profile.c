@@ -0,0 +1,200 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Execution counters per opcode and per page of the instruction address,
+ * fed by the CPU core when it is built with CPU_PROFILE. Addressing modes
+ * are summed up from the opcodes when printing, using the operand in the
+ * instruction's label.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leakcheck.h"
+
+#include "cpu_6502_labels.h"
+#include "profile.h"
+#include "status.h"
+
+#define TOP_PAGES	16
+
+typedef struct counter_t {
+	uint64_t count, cycles;
+} counter_t;
+
+static const struct {
+	const char *operand, *name;
+} modes[] = {
+	{ "",			"implied" },
+	{ NULL,			"relative" },
+	{ "A",			"accumulator" },
+	{ "#$xx",		"immediate" },
+	{ "$xx",		"zero page" },
+	{ "$xx, X",		"zero page,X" },
+	{ "$xx, Y",		"zero page,Y" },
+	{ "$xxxx",		"absolute" },
+	{ "$xxxx, X",	"absolute,X" },
+	{ "$xxxx, Y",	"absolute,Y" },
+	{ "($xxxx)",	"indirect" },
+	{ "($xx, X)",	"(indirect,X)" },
+	{ "($xx), Y",	"(indirect),Y" }
+};
+
+#define N_MODES		(sizeof(modes) / sizeof(modes[0]))
+#define MODE_REL	1
+
+static counter_t ops[256];
+static counter_t pages[256];
+
+void profile_instr(const uint8_t op, const uint16_t pc, const int cycles) {
+	ops[op].count++;
+	ops[op].cycles += cycles;
+	pages[pc >> 8].count++;
+	pages[pc >> 8].cycles += cycles;
+}
+
+/* Branches are labelled without an operand. */
+static size_t mode_of(const int op) {
+	const char *label = op_labels[op], *operand;
+	size_t i;
+
+	if((operand = strchr(label, ' ')) == NULL) {
+		if(label[0] == 'B' && strcmp(label, "BRK") != 0)
+			return MODE_REL;
+		operand = "";
+	} else {
+		operand++;
+	}
+
+	for(i = 0; i < N_MODES; i++) {
+		if(modes[i].operand && !strcmp(modes[i].operand, operand))
+			return i;
+	}
+
+	return 0;
+}
+
+static void sum_modes(counter_t *out) {
+	int op;
+
+	memset(out, 0, N_MODES * sizeof(counter_t));
+
+	for(op = 0; op < 256; op++) {
+		if(op_labels[op] == NULL)
+			continue;
+		out[mode_of(op)].count += ops[op].count;
+		out[mode_of(op)].cycles += ops[op].cycles;
+	}
+}
+
+static const counter_t *sort_base;
+
+static int by_cycles(const void *a, const void *b) {
+	const counter_t *ca = &sort_base[*(const int*)a], *cb = &sort_base[*(const int*)b];
+
+	if(ca->cycles != cb->cycles)
+		return (ca->cycles < cb->cycles) ? 1 : -1;
+	return *(const int*)a - *(const int*)b;
+}
+
+static void sort_by_cycles(const counter_t *counters, int *order, const int n) {
+	int i;
+
+	for(i = 0; i < n; i++)
+		order[i] = i;
+
+	sort_base = counters;
+	qsort(order, n, sizeof(int), by_cycles);
+}
+
+static double percent(const uint64_t part, const uint64_t total) {
+	return total ? 100.0 * (double)part / (double)total : 0.0;
+}
+
+static void print_row(FILE *fp, const char *label, const counter_t *c, const counter_t *total) {
+	fprintf(fp, "%-16s %12llu %6.2f%% %13llu %6.2f%% %6.2f\n", label,
+		(unsigned long long)c->count, percent(c->count, total->count),
+		(unsigned long long)c->cycles, percent(c->cycles, total->cycles),
+		c->count ? (double)c->cycles / (double)c->count : 0.0);
+}
+
+void profile_print(FILE *fp) {
+	counter_t total, by_mode[N_MODES];
+	int order[256], i;
+	char label[24];
+
+	total.count = total.cycles = 0;
+	for(i = 0; i < 256; i++) {
+		total.count += ops[i].count;
+		total.cycles += ops[i].cycles;
+	}
+
+	fprintf(fp, "\n%llu instructions, %llu cycles.\n",
+		(unsigned long long)total.count, (unsigned long long)total.cycles);
+
+	fprintf(fp, "\nOpcode               Count             Cycles          Cyc/op\n");
+	sort_by_cycles(ops, order, 256);
+	for(i = 0; i < 256 && ops[order[i]].count; i++) {
+		sprintf(label, "%02x %s", order[i], op_labels[order[i]] ? op_labels[order[i]] : "???");
+		print_row(fp, label, &ops[order[i]], &total);
+	}
+
+	fprintf(fp, "\nMode                 Count             Cycles          Cyc/op\n");
+	sum_modes(by_mode);
+	sort_by_cycles(by_mode, order, N_MODES);
+	for(i = 0; i < (int)N_MODES && by_mode[order[i]].count; i++)
+		print_row(fp, modes[order[i]].name, &by_mode[order[i]], &total);
+
+	fprintf(fp, "\nPage                 Count             Cycles          Cyc/op\n");
+	sort_by_cycles(pages, order, 256);
+	for(i = 0; i < TOP_PAGES && pages[order[i]].count; i++) {
+		sprintf(label, "$%02x00-$%02xff", order[i], order[i]);
+		print_row(fp, label, &pages[order[i]], &total);
+	}
+}
+
+/* One row per opcode, mode and page: kind,key,label,count,cycles */
+int profile_write_csv(const char *filename) {
+	counter_t by_mode[N_MODES];
+	FILE *fp;
+	size_t i;
+	int ret = RET_OK;
+
+	if((fp = fopen(filename, "w")) == NULL)
+		return RET_ERR_OPEN;
+
+	fprintf(fp, "kind,key,label,count,cycles\n");
+
+	for(i = 0; i < 256; i++) {
+		if(op_labels[i] == NULL && ops[i].count == 0)
+			continue;
+		fprintf(fp, "opcode,0x%02x,\"%s\",%llu,%llu\n", (unsigned int)i,
+			op_labels[i] ? op_labels[i] : "???",
+			(unsigned long long)ops[i].count, (unsigned long long)ops[i].cycles);
+	}
+
+	sum_modes(by_mode);
+	for(i = 0; i < N_MODES; i++) {
+		fprintf(fp, "mode,%u,\"%s\",%llu,%llu\n", (unsigned int)i, modes[i].name,
+			(unsigned long long)by_mode[i].count, (unsigned long long)by_mode[i].cycles);
+	}
+
+	for(i = 0; i < 256; i++) {
+		if(pages[i].count == 0)
+			continue;
+		fprintf(fp, "page,0x%02x00,\"$%02x00-$%02xff\",%llu,%llu\n",
+			(unsigned int)i, (unsigned int)i, (unsigned int)i,
+			(unsigned long long)pages[i].count, (unsigned long long)pages[i].cycles);
+	}
+
+	if(ferror(fp))
+		ret = RET_ERR_IO;
+	if(fclose(fp) != 0)
+		ret = RET_ERR_IO;
+
+	return ret;
+}
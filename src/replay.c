@@ -0,0 +1,235 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Input record/replay. Every input the PIA delivers to the guest is logged
+ * with the cycle count at which it arrived. Playback injects the logged
+ * events at exactly those cycles instead of polling SDL, so a session
+ * re-runs bit-identically.
+ *
+ * File:	"A1IR" u16 version
+ * Event:	u64 cycle, u8 type, u8 data
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leakcheck.h"
+
+#include "io_6820.h"
+#include "replay.h"
+#include "sched.h"
+#include "serial.h"
+#include "status.h"
+#include "vm.h"
+
+#define IR_MAGIC		"A1IR"
+#define IR_VERSION		1
+
+#define FILE_HDR_SIZE	6
+#define EVENT_SIZE		10
+
+typedef struct input_log_t {
+	size_t n_events, n_alloced, pos;
+	input_event_t *event;
+} input_log_t;
+
+static input_log_t input_log = { 0, 0, 0, NULL };
+static FILE *record_fp = NULL;
+static const char *record_name = NULL;
+static int playing = 0, rewinding = 0, truncated = 0;
+
+/* The log doubles when full, long recordings would copy it over and
+ * over otherwise. */
+static int log_append(const input_event_t *ev) {
+	input_event_t *newevents;
+	size_t n_alloced;
+
+	if(input_log.n_events == input_log.n_alloced) {
+		n_alloced = input_log.n_alloced ? input_log.n_alloced * 2 : PREALLOC_LIST;
+		if((newevents = malloc(n_alloced * sizeof(input_event_t))) == NULL)
+			return RET_ERR_ALLOC;
+
+		if(input_log.event) {
+			memcpy(newevents, input_log.event, input_log.n_events * sizeof(input_event_t));
+			free(input_log.event);
+		}
+		input_log.event = newevents;
+		input_log.n_alloced = n_alloced;
+	}
+
+	input_log.event[input_log.n_events++] = *ev;
+	return RET_OK;
+}
+
+static void write_event(const input_event_t *ev) {
+	uint8_t buf[EVENT_SIZE], *p = buf;
+
+	put_u64(&p, ev->cycle);
+	put_u8(&p, ev->type);
+	put_u8(&p, ev->data);
+
+	fwrite(buf, EVENT_SIZE, 1, record_fp);
+}
+
+static int open_record(void) {
+	uint8_t hdr[FILE_HDR_SIZE], *p = hdr;
+
+	if((record_fp = fopen(record_name, "wb")) == NULL)
+		return RET_ERR_OPEN;
+
+	put_bytes(&p, (const uint8_t*)IR_MAGIC, 4);
+	put_u16(&p, IR_VERSION);
+
+	if(fwrite(hdr, FILE_HDR_SIZE, 1, record_fp) != 1) {
+		fclose(record_fp);
+		record_fp = NULL;
+		return RET_ERR_IO;
+	}
+
+	return RET_OK;
+}
+
+int replay_record(const char *filename) {
+	record_name = filename;
+	return open_record();
+}
+
+/* Delivers all events that are due and posts the next one. */
+static void replay_event(vm_t *vm, void *data) {
+	input_event_t *ev;
+
+	while(input_log.pos < input_log.n_events) {
+		ev = &input_log.event[input_log.pos];
+		if(ev->cycle > vm->cycle) {
+			sched_add(vm, ev->cycle, replay_event, NULL);
+			return;
+		}
+
+		input_log.pos++;
+		pia_event(vm, ev->type, ev->data);
+	}
+}
+
+int replay_load(vm_t *vm, const char *filename) {
+	FILE *fp;
+	uint8_t buf[EVENT_SIZE];
+	const uint8_t *p = buf;
+	input_event_t ev;
+	int ret = RET_ERR_FORMAT;
+
+	if((fp = fopen(filename, "rb")) == NULL)
+		return RET_ERR_OPEN;
+
+	if(fread(buf, FILE_HDR_SIZE, 1, fp) != 1) goto close;
+	if(memcmp(buf, IR_MAGIC, 4) != 0) goto close;
+	p += 4;
+	if(get_u16(&p) != IR_VERSION) goto close;
+
+	while(fread(buf, EVENT_SIZE, 1, fp) == 1) {
+		p = buf;
+		ev.cycle = get_u64(&p);
+		ev.type = get_u8(&p);
+		ev.data = get_u8(&p);
+
+		if((ret = log_append(&ev)) != RET_OK) goto close;
+	}
+
+	input_log.pos = 0;
+	playing = 1;
+	if(input_log.n_events)
+		sched_add(vm, input_log.event[0].cycle, replay_event, NULL);
+	ret = RET_OK;
+
+close:
+	fclose(fp);
+	return ret;
+}
+
+int replay_playing(void) {
+	return playing;
+}
+
+/* Re-executing logged input after a rewind. */
+int replay_rewinding(void) {
+	return rewinding;
+}
+
+void replay_log(vm_t *vm, const uint8_t type, const uint8_t data) {
+	input_event_t ev;
+
+	if(playing || rewinding)
+		return;
+
+	ev.cycle = vm->cycle;
+	ev.type = type;
+	ev.data = data;
+
+	log_append(&ev);
+	if(record_fp)
+		write_event(&ev);
+}
+
+/* Number of events delivered so far. */
+size_t replay_tell(void) {
+	return (playing || rewinding) ? input_log.pos : input_log.n_events;
+}
+
+/* Positions playback at the event replay_tell() returned. A cycle is not
+ * enough, events and snapshots can fall on the same one. In a live
+ * session the log is replayed from memory until replay_branch(). */
+void replay_seek(vm_t *vm, const size_t pos) {
+	input_log.pos = pos;
+	if(!playing)
+		rewinding = 1;
+
+	sched_cancel(vm, replay_event, NULL);
+	if(pos < input_log.n_events)
+		sched_add(vm, input_log.event[pos].cycle, replay_event, NULL);
+}
+
+/* Live input resumes here; events that were logged after this point
+ * belong to the discarded future. A paste types its share of them again. */
+void replay_branch(vm_t *vm) {
+	size_t i, n_pasted = 0;
+
+	if(!rewinding)
+		return;
+
+	sched_cancel(vm, replay_event, NULL);
+	for(i = input_log.pos; i < input_log.n_events; i++) {
+		if(input_log.event[i].type == REPLAY_PASTE)
+			n_pasted++;
+	}
+
+	input_log.n_events = input_log.pos;
+	rewinding = 0;
+	truncated = 1;
+
+	pia_paste_branch(n_pasted);
+}
+
+void replay_clean(void) {
+	size_t i;
+
+	if(record_fp) {
+		fclose(record_fp);
+		record_fp = NULL;
+
+		if(truncated && open_record() == RET_OK) {
+			for(i = 0; i < input_log.n_events; i++)
+				write_event(&input_log.event[i]);
+			fclose(record_fp);
+			record_fp = NULL;
+		}
+	}
+
+	if(input_log.event)
+		free(input_log.event);
+	input_log.event = NULL;
+	input_log.n_events = input_log.n_alloced = input_log.pos = 0;
+	playing = rewinding = truncated = 0;
+}
@@ -0,0 +1,192 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Rewind buffer. A ring of machine images is captured every interval
+ * (REWIND_INTERVAL, a million cycles, unless set otherwise), as many as
+ * fit into the memory budget. The images leave out ROM and memory map,
+ * which don't change during a session. Going back restores the newest
+ * snapshot before the target and re-executes forward with the logged
+ * input until the target is reached.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leakcheck.h"
+
+#include "replay.h"
+#include "rewind.h"
+#include "sched.h"
+#include "status.h"
+#include "vm.h"
+
+typedef struct snapshot_t {
+	uint64_t cycle, step;
+	size_t log_pos;			/* Input events before the snapshot */
+	uint8_t *image;
+} snapshot_t;
+
+typedef struct rewind_t {
+	size_t size, n_slots, n_used, head;
+	uint32_t interval;
+	snapshot_t *slot;
+	uint8_t *images;
+} rewind_t;
+
+static rewind_t *rw = NULL;
+
+static void take_snapshot(vm_t *vm) {
+	snapshot_t *snap = &rw->slot[rw->head];
+
+	snap->cycle = vm->cycle;
+	snap->step = vm->step;
+	snap->log_pos = replay_tell();
+	vm_save_state(vm, snap->image, 0);
+
+	rw->head = (rw->head + 1) % rw->n_slots;
+	if(rw->n_used < rw->n_slots)
+		rw->n_used++;
+}
+
+static void capture_event(vm_t *vm, void *data) {
+	take_snapshot(vm);
+	sched_add(vm, vm->cycle + rw->interval, capture_event, NULL);
+}
+
+int rewind_init(vm_t *vm, const size_t budget, const uint32_t interval) {
+	size_t i;
+
+	if((rw = malloc(sizeof(rewind_t))) == NULL)
+		return RET_ERR_ALLOC;
+
+	rw->size = vm_state_size(vm, 0);
+	rw->n_slots = budget / rw->size;
+	if(rw->n_slots < 2)
+		rw->n_slots = 2;
+
+	if((rw->slot = malloc(rw->n_slots * sizeof(snapshot_t))) == NULL) goto freerw;
+	if((rw->images = malloc(rw->n_slots * rw->size)) == NULL) goto freeslot;
+
+	for(i = 0; i < rw->n_slots; i++)
+		rw->slot[i].image = rw->images + i * rw->size;
+
+	rw->interval = interval;
+	rw->n_used = 0;
+	rw->head = 0;
+
+	capture_event(vm, NULL);
+	return RET_OK;
+
+freeslot:
+	free(rw->slot);
+freerw:
+	free(rw);
+	rw = NULL;
+	return RET_ERR_ALLOC;
+}
+
+static snapshot_t *oldest_snapshot(void) {
+	return &rw->slot[(rw->head + rw->n_slots - rw->n_used) % rw->n_slots];
+}
+
+/* Newest snapshot that is not past the target, given as either a step or
+ * a cycle count. Newer snapshots are dropped, they belong to the future
+ * that is about to be discarded. */
+static snapshot_t *find_snapshot(const uint64_t step, const uint64_t cycle, const int by_step) {
+	snapshot_t *snap;
+	size_t idx;
+
+	while(rw->n_used) {
+		idx = (rw->head + rw->n_slots - 1) % rw->n_slots;
+		snap = &rw->slot[idx];
+
+		if(by_step ? (snap->step <= step) : (snap->cycle <= cycle))
+			return snap;
+
+		rw->head = idx;
+		rw->n_used--;
+	}
+
+	return NULL;
+}
+
+/* The capture event is re-posted relative to the restored clock, so the
+ * snapshot grid stays aligned with the kept snapshots. */
+static void restore(vm_t *vm, snapshot_t *snap) {
+	vm_load_state(vm, snap->image, 0);
+	replay_seek(vm, snap->log_pos);
+
+	sched_cancel(vm, capture_event, NULL);
+	sched_add(vm, vm->cycle + rw->interval, capture_event, NULL);
+}
+
+/* Breakpoints stay quiet while the machine retraces its steps. */
+static void run_forward(vm_t *vm, const uint64_t step, const uint64_t cycle, const int by_step) {
+	uint8_t trap[sizeof(vm->trap)];
+	int status = RET_OK;
+
+	memcpy(trap, vm->trap, sizeof(trap));
+	memset(vm->trap, 0, sizeof(vm->trap));
+
+	if(by_step) {
+		while(!vm->quit && status != RET_LOOP && vm->step < step)
+			vm_step(vm, &status);
+	} else {
+		vm_run(vm, cycle, &status);
+	}
+
+	memcpy(vm->trap, trap, sizeof(trap));
+	replay_branch(vm);
+}
+
+int rewind_steps(vm_t *vm, const uint64_t n) {
+	snapshot_t *snap;
+	uint64_t target;
+
+	if(rw == NULL)
+		return RET_ERR_INVAL;
+
+	target = (n > vm->step) ? 0 : vm->step - n;
+	if(rw->n_used && oldest_snapshot()->step > target)
+		target = oldest_snapshot()->step;
+
+	if((snap = find_snapshot(target, 0, 1)) == NULL)
+		return RET_ERR_INVAL;
+
+	restore(vm, snap);
+	run_forward(vm, target, 0, 1);
+
+	return RET_OK;
+}
+
+int rewind_to_cycle(vm_t *vm, const uint64_t cycle) {
+	snapshot_t *snap;
+	uint64_t target = cycle;
+
+	if(rw == NULL || cycle > vm->cycle)
+		return RET_ERR_INVAL;
+
+	if(rw->n_used && oldest_snapshot()->cycle > target)
+		target = oldest_snapshot()->cycle;
+
+	if((snap = find_snapshot(0, target, 0)) == NULL)
+		return RET_ERR_INVAL;
+
+	restore(vm, snap);
+	run_forward(vm, 0, target, 0);
+
+	return RET_OK;
+}
+
+void rewind_clean(void) {
+	if(rw == NULL)
+		return;
+
+	free(rw->images);
+	free(rw->slot);
+	free(rw);
+	rw = NULL;
+}
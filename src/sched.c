@@ -0,0 +1,157 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Device event scheduler. Devices post callbacks at future cycle counts
+ * into a binary min-heap, and the run loop executes instructions straight
+ * through to the earliest deadline. Events due at the same cycle fire in
+ * the order they were posted, which keeps replays deterministic.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leakcheck.h"
+
+#include "sched.h"
+#include "status.h"
+#include "vm.h"
+
+#define before(a, b) (((a)->when < (b)->when) || (((a)->when == (b)->when) && ((a)->seq < (b)->seq)))
+
+static void swap(sched_event_t *a, sched_event_t *b) {
+	sched_event_t tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+static void sift_up(sched_t *sched, size_t pos) {
+	size_t parent;
+
+	while(pos > 0) {
+		parent = (pos - 1) / 2;
+		if(!before(&sched->event[pos], &sched->event[parent]))
+			break;
+
+		swap(&sched->event[pos], &sched->event[parent]);
+		pos = parent;
+	}
+}
+
+static void sift_down(sched_t *sched, size_t pos) {
+	size_t child;
+
+	for(;;) {
+		child = pos * 2 + 1;
+		if(child >= sched->n_events)
+			break;
+
+		if(child + 1 < sched->n_events && before(&sched->event[child + 1], &sched->event[child]))
+			child++;
+
+		if(!before(&sched->event[child], &sched->event[pos]))
+			break;
+
+		swap(&sched->event[pos], &sched->event[child]);
+		pos = child;
+	}
+}
+
+static void update_deadline(vm_t *vm) {
+	vm->deadline = vm->sched.n_events ? vm->sched.event[0].when : SCHED_NEVER;
+}
+
+int sched_init(sched_t *sched) {
+	if((sched->event = malloc(PREALLOC_LIST * sizeof(sched_event_t))) == NULL)
+		return RET_ERR_ALLOC;
+
+	sched->n_events = 0;
+	sched->n_alloced = PREALLOC_LIST;
+	sched->seq = 0;
+
+	return RET_OK;
+}
+
+void sched_clean(sched_t *sched) {
+	free(sched->event);
+	sched->event = NULL;
+	sched->n_events = sched->n_alloced = 0;
+}
+
+int sched_add(vm_t *vm, const uint64_t when, sched_proc_t proc, void *data) {
+	sched_t *sched = &vm->sched;
+	sched_event_t *newevents;
+
+	if(sched->n_events == sched->n_alloced) {
+		if((newevents = malloc((sched->n_alloced + PREALLOC_LIST) * sizeof(sched_event_t))) == NULL)
+			return RET_ERR_ALLOC;
+
+		memcpy(newevents, sched->event, sched->n_events * sizeof(sched_event_t));
+		free(sched->event);
+		sched->event = newevents;
+		sched->n_alloced += PREALLOC_LIST;
+	}
+
+	sched->event[sched->n_events].when = when;
+	sched->event[sched->n_events].seq = sched->seq++;
+	sched->event[sched->n_events].proc = proc;
+	sched->event[sched->n_events].data = data;
+	sift_up(sched, sched->n_events++);
+
+	/* Cuts a running slice short if the new event is due earlier. */
+	if(when < vm->deadline)
+		vm->deadline = when;
+
+	return RET_OK;
+}
+
+void sched_cancel(vm_t *vm, sched_proc_t proc, void *data) {
+	sched_t *sched = &vm->sched;
+	size_t i = 0;
+
+	while(i < sched->n_events) {
+		if(sched->event[i].proc == proc && sched->event[i].data == data)
+			sched->event[i] = sched->event[--sched->n_events];
+		else
+			i++;
+	}
+
+	for(i = sched->n_events / 2; i-- > 0;)
+		sift_down(sched, i);
+
+	update_deadline(vm);
+}
+
+/* Keeps pending events at the same distance from the clock after it was
+ * set to a different value, e.g. by loading a machine image. */
+void sched_rebase(vm_t *vm, const uint64_t old_cycle) {
+	sched_t *sched = &vm->sched;
+	size_t i;
+
+	for(i = 0; i < sched->n_events; i++) {
+		if(sched->event[i].when > old_cycle)
+			sched->event[i].when = vm->cycle + (sched->event[i].when - old_cycle);
+		else
+			sched->event[i].when = vm->cycle;
+	}
+
+	update_deadline(vm);
+}
+
+/* Fires every event that is due. Callbacks may post new events. */
+void sched_dispatch(vm_t *vm) {
+	sched_t *sched = &vm->sched;
+	sched_event_t ev;
+
+	while(sched->n_events && sched->event[0].when <= vm->cycle) {
+		ev = sched->event[0];
+		sched->event[0] = sched->event[--sched->n_events];
+		sift_down(sched, 0);
+
+		ev.proc(vm, ev.data);
+	}
+
+	update_deadline(vm);
+}
@@ -0,0 +1,57 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "serial.h"
+
+void put_u8(uint8_t **p, const uint8_t val) {
+	*(*p)++ = val;
+}
+
+void put_u16(uint8_t **p, const uint16_t val) {
+	put_u8(p, val & 0xff);
+	put_u8(p, val >> 8);
+}
+
+void put_u32(uint8_t **p, const uint32_t val) {
+	put_u16(p, val & 0xffff);
+	put_u16(p, val >> 16);
+}
+
+void put_u64(uint8_t **p, const uint64_t val) {
+	put_u32(p, val & 0xffffffff);
+	put_u32(p, val >> 32);
+}
+
+void put_bytes(uint8_t **p, const uint8_t *data, const size_t size) {
+	memcpy(*p, data, size);
+	*p += size;
+}
+
+uint8_t get_u8(const uint8_t **p) {
+	return *(*p)++;
+}
+
+uint16_t get_u16(const uint8_t **p) {
+	uint16_t lo = get_u8(p);
+	return lo | (get_u8(p) << 8);
+}
+
+uint32_t get_u32(const uint8_t **p) {
+	uint32_t lo = get_u16(p);
+	return lo | ((uint32_t)get_u16(p) << 16);
+}
+
+uint64_t get_u64(const uint8_t **p) {
+	uint64_t lo = get_u32(p);
+	return lo | ((uint64_t)get_u32(p) << 32);
+}
+
+void get_bytes(const uint8_t **p, uint8_t *data, const size_t size) {
+	memcpy(data, *p, size);
+	*p += size;
+}
@@ -0,0 +1,309 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Guest symbols from assembler listings or label files. Understood lines:
+ *
+ *	0998 : 205d37           test_jsr  ...	(AS65 listing)
+ *	FF0F C9 DF		NOTCR	CMP #$DF		(listing like wozmon.a65)
+ *	FF0F NOTCR								(plain address and name)
+ *	al C:ff0f .NOTCR						(VICE label file)
+ *
+ * The first word after the address and the object code is the label,
+ * unless it is an instruction or a directive. "addr = value" lines are
+ * constants and are skipped.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leakcheck.h"
+
+#include "status.h"
+#include "symbols.h"
+
+#define LINE_MAX_LEN	1024
+#define NAME_MAX_LEN	(SYMBOL_MAX_LEN - 8)
+
+typedef struct symbol_t {
+	uint16_t addr;
+	int seq;			/* Order of definition */
+	char *name;
+} symbol_t;
+
+struct symbols_t {
+	symbol_t *sym;
+	int n_syms, n_alloced;
+};
+
+static const char *keywords[] = {
+	"adc", "and", "asl", "bcc", "bcs", "beq", "bit", "bmi", "bne", "bpl",
+	"brk", "bvc", "bvs", "clc", "cld", "cli", "clv", "cmp", "cpx", "cpy",
+	"dec", "dex", "dey", "eor", "inc", "inx", "iny", "jmp", "jsr", "lda",
+	"ldx", "ldy", "lsr", "nop", "ora", "pha", "php", "pla", "plp", "rol",
+	"ror", "rti", "rts", "sbc", "sec", "sed", "sei", "sta", "stx", "sty",
+	"tax", "tay", "tsx", "txa", "txs", "tya",
+	"asc", "byte", "db", "dfb", "ds", "dw", "else", "end", "endif", "endm",
+	"equ", "fill", "hex", "if", "macro", "org", "text", "word",
+	NULL
+};
+
+symbols_t *symbols_init(void) {
+	symbols_t *syms;
+
+	if((syms = malloc(sizeof(symbols_t))) == NULL)
+		return NULL;
+
+	syms->sym = NULL;
+	syms->n_syms = syms->n_alloced = 0;
+
+	return syms;
+}
+
+void symbols_free(symbols_t *syms) {
+	int i;
+
+	for(i = 0; i < syms->n_syms; i++)
+		free(syms->sym[i].name);
+	free(syms->sym);
+	free(syms);
+}
+
+int symbols_count(const symbols_t *syms) {
+	return syms->n_syms;
+}
+
+static int add(symbols_t *syms, const uint16_t addr, const char *name) {
+	symbol_t *newsym;
+	size_t len = strlen(name);
+
+	if(syms->n_syms == syms->n_alloced) {
+		if((newsym = malloc((syms->n_alloced * 2 + PREALLOC_LIST) * sizeof(symbol_t))) == NULL)
+			return RET_ERR_ALLOC;
+
+		if(syms->sym) {
+			memcpy(newsym, syms->sym, syms->n_syms * sizeof(symbol_t));
+			free(syms->sym);
+		}
+		syms->sym = newsym;
+		syms->n_alloced = syms->n_alloced * 2 + PREALLOC_LIST;
+	}
+
+	if(len > NAME_MAX_LEN)
+		len = NAME_MAX_LEN;
+	if((syms->sym[syms->n_syms].name = malloc(len + 1)) == NULL)
+		return RET_ERR_ALLOC;
+
+	memcpy(syms->sym[syms->n_syms].name, name, len);
+	syms->sym[syms->n_syms].name[len] = '\0';
+	syms->sym[syms->n_syms].addr = addr;
+	syms->sym[syms->n_syms].seq = syms->n_syms;
+	syms->n_syms++;
+
+	return RET_OK;
+}
+
+static int is_hex(const char *s, const size_t len) {
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		if(!isxdigit((unsigned char)s[i]))
+			return 0;
+	}
+
+	return len > 0;
+}
+
+static int is_keyword(const char *word) {
+	char lower[8];
+	int i;
+
+	if(strlen(word) >= sizeof(lower))
+		return 0;
+
+	for(i = 0; word[i]; i++)
+		lower[i] = (char)tolower((unsigned char)word[i]);
+	lower[i] = '\0';
+
+	for(i = 0; keywords[i]; i++) {
+		if(!strcmp(keywords[i], lower))
+			return 1;
+	}
+
+	return 0;
+}
+
+static char *next_word(char **p) {
+	char *word;
+
+	while(**p == ' ' || **p == '\t')
+		(*p)++;
+	if(**p == '\0' || **p == '\r' || **p == '\n')
+		return NULL;
+
+	word = *p;
+	while(**p && !isspace((unsigned char)**p))
+		(*p)++;
+	if(**p)
+		*(*p)++ = '\0';
+
+	return word;
+}
+
+/* Returns 1 and the label if the line defines one. */
+static int parse_line(char *line, uint16_t *addr, char **name) {
+	char *p = line, *word;
+	size_t len;
+	int i;
+
+	if(!strncmp(line, "al ", 3)) {
+		if((word = next_word(&p)) == NULL || (word = next_word(&p)) == NULL)
+			return 0;
+		if(word[0] && word[1] == ':')
+			word += 2;
+		*addr = (uint16_t)strtoul(word, NULL, 16);
+		if((word = next_word(&p)) == NULL)
+			return 0;
+		*name = (word[0] == '.') ? word + 1 : word;
+		return 1;
+	}
+
+	if(!is_hex(line, 4) || isalnum((unsigned char)line[4]) || line[4] == '_')
+		return 0;
+	*addr = (uint16_t)strtoul(line, NULL, 16);
+	p = line + 4;
+
+	while((word = next_word(&p)) != NULL) {
+		len = strlen(word);
+		if(!strcmp(word, ":") || !strcmp(word, ">"))
+			continue;
+		if(is_hex(word, len) && len % 2 == 0)
+			continue;
+		break;
+	}
+
+	if(word == NULL || word[0] == '=' || is_keyword(word))
+		return 0;
+
+	len = strlen(word);
+	if(word[len - 1] == ':')
+		word[--len] = '\0';
+
+	if(len == 0 || !(isalpha((unsigned char)word[0]) || word[0] == '_'))
+		return 0;
+	for(i = 1; word[i]; i++) {
+		if(!isalnum((unsigned char)word[i]) && word[i] != '_')
+			return 0;
+	}
+
+	*name = word;
+	return 1;
+}
+
+static int by_addr(const void *a, const void *b) {
+	const symbol_t *sa = a, *sb = b;
+
+	if(sa->addr != sb->addr)
+		return sa->addr - sb->addr;
+
+	return sa->seq - sb->seq;
+}
+
+int symbols_load(symbols_t *syms, const char *filename) {
+	FILE *fp;
+	char line[LINE_MAX_LEN], *name;
+	uint16_t addr;
+	int ret = RET_OK;
+
+	if((fp = fopen(filename, "r")) == NULL)
+		return RET_ERR_OPEN;
+
+	while(ret == RET_OK && fgets(line, LINE_MAX_LEN, fp)) {
+		if(parse_line(line, &addr, &name))
+			ret = add(syms, addr, name);
+	}
+
+	if(ret == RET_OK && ferror(fp))
+		ret = RET_ERR_IO;
+	fclose(fp);
+
+	qsort(syms->sym, syms->n_syms, sizeof(symbol_t), by_addr);
+
+	return ret;
+}
+
+/* Index of the first symbol at addr or above. */
+static int lower_bound(const symbols_t *syms, const uint16_t addr) {
+	int lo = 0, hi = syms->n_syms, mid;
+
+	while(lo < hi) {
+		mid = (lo + hi) / 2;
+		if(syms->sym[mid].addr < addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* The address of the first definition of name. */
+int symbols_lookup(const symbols_t *syms, const char *name, uint16_t *addr) {
+	int i, best = -1;
+
+	for(i = 0; i < syms->n_syms; i++) {
+		if(!strcmp(syms->sym[i].name, name) && (best < 0 || syms->sym[i].seq < syms->sym[best].seq))
+			best = i;
+	}
+
+	if(best < 0)
+		return RET_ERR_INVAL;
+
+	*addr = syms->sym[best].addr;
+	return RET_OK;
+}
+
+const char *symbols_exact(const symbols_t *syms, const uint16_t addr) {
+	int i = lower_bound(syms, addr);
+
+	if(i < syms->n_syms && syms->sym[i].addr == addr)
+		return syms->sym[i].name;
+
+	return NULL;
+}
+
+/* The closest symbol at or below addr. */
+const char *symbols_find(const symbols_t *syms, const uint16_t addr, uint16_t *base) {
+	int i = lower_bound(syms, addr);
+
+	if(i < syms->n_syms && syms->sym[i].addr == addr) {
+		*base = addr;
+		return syms->sym[i].name;
+	}
+
+	if(i == 0)
+		return NULL;
+
+	/* The first of the aliases at the closest lower address */
+	for(i--; i > 0 && syms->sym[i - 1].addr == syms->sym[i].addr; i--);
+
+	*base = syms->sym[i].addr;
+	return syms->sym[i].name;
+}
+
+/* "name", "name+$xx" or "$xxxx" into out, which holds SYMBOL_MAX_LEN. */
+void symbols_format(const symbols_t *syms, const uint16_t addr, char *out) {
+	const char *name;
+	uint16_t base;
+
+	if(syms == NULL || (name = symbols_find(syms, addr, &base)) == NULL)
+		sprintf(out, "$%04x", addr);
+	else if(base == addr)
+		strcpy(out, name);
+	else
+		sprintf(out, "%s+$%x", name, addr - base);
+}
@@ -0,0 +1,189 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Execution trace. The emulation thread drops one raw record per
+ * instruction into a single producer, single consumer ring; a writer
+ * thread encodes them (see tracefile.c) and writes the file. The head is
+ * published in batches, so the emulation thread pays for an atomic store
+ * once per TRACE_BATCH instructions. When the ring is full the emulation
+ * waits for the writer rather than losing records.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "leakcheck.h"
+
+#include "status.h"
+#include "trace.h"
+#include "tracefile.h"
+#include "vm.h"
+
+#define TRACE_RING_SIZE	65536		/* Power of two */
+#define TRACE_BATCH		256
+#define OUT_BUF_SIZE	65536
+
+struct trace_t {
+	trace_rec_t *ring;
+	SDL_atomic_t head;		/* Written by the emulation thread */
+	SDL_atomic_t tail;		/* Written by the writer thread */
+	SDL_atomic_t quit;
+
+	unsigned int local_head, cached_tail;
+
+	FILE *fp;
+	uint8_t *out;
+	int error;
+	SDL_Thread *thread;
+};
+
+static void publish(trace_t *tr) {
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&tr->head, tr->local_head);
+}
+
+void trace_put(vm_t *vm) {
+	trace_t *tr = vm->trace;
+	trace_rec_t *rec;
+	cpu_regs_t regs;
+
+	if(tr->local_head - tr->cached_tail == TRACE_RING_SIZE) {
+		publish(tr);
+		while((tr->cached_tail = SDL_AtomicGet(&tr->tail)) + TRACE_RING_SIZE == tr->local_head)
+			SDL_Delay(0);
+	}
+
+	vm->cpu_def.regs(vm->cpu_state, &regs);
+
+	rec = &tr->ring[tr->local_head % TRACE_RING_SIZE];
+	rec->step = vm->step;
+	rec->cycle = vm->cycle;
+	rec->pc = regs.pc;
+	rec->op = vm->mem[regs.pc];
+	rec->a = regs.a;
+	rec->x = regs.x;
+	rec->y = regs.y;
+	rec->sp = regs.sp;
+	rec->flags = regs.flags;
+	rec->n_writes = (uint8_t)vm->n_writes;
+	memcpy(rec->write, vm->writes, vm->n_writes * sizeof(uint32_t));
+
+	if(++tr->local_head % TRACE_BATCH == 0)
+		publish(tr);
+}
+
+static int writer_thread(void *data) {
+	trace_t *tr = data;
+	trace_rec_t prev;
+	unsigned int head, tail;
+	size_t n = 0;
+	int quit;
+
+	memset(&prev, 0, sizeof(prev));
+	tail = SDL_AtomicGet(&tr->tail);
+
+	for(;;) {
+		quit = SDL_AtomicGet(&tr->quit);
+		head = SDL_AtomicGet(&tr->head);
+		SDL_MemoryBarrierAcquire();
+
+		if(tail == head) {
+			if(quit)
+				break;
+			SDL_Delay(1);
+			continue;
+		}
+
+		while(tail != head) {
+			n += trace_encode(&prev, &tr->ring[tail % TRACE_RING_SIZE], tr->out + n);
+			tail++;
+
+			if(n > OUT_BUF_SIZE - TRACE_REC_MAX) {
+				if(fwrite(tr->out, n, 1, tr->fp) != 1)
+					tr->error = 1;
+				n = 0;
+			}
+		}
+
+		SDL_MemoryBarrierRelease();
+		SDL_AtomicSet(&tr->tail, tail);
+	}
+
+	if(n && fwrite(tr->out, n, 1, tr->fp) != 1)
+		tr->error = 1;
+
+	return 0;
+}
+
+int trace_start(vm_t *vm, const char *filename) {
+	trace_t *tr;
+	uint8_t hdr[16];
+	int ret = RET_ERR_ALLOC;
+
+	if((tr = malloc(sizeof(trace_t))) == NULL)
+		return RET_ERR_ALLOC;
+
+	tr->out = NULL;
+	tr->fp = NULL;
+	tr->error = 0;
+	tr->local_head = tr->cached_tail = 0;
+	SDL_AtomicSet(&tr->head, 0);
+	SDL_AtomicSet(&tr->tail, 0);
+	SDL_AtomicSet(&tr->quit, 0);
+
+	if((tr->ring = malloc(TRACE_RING_SIZE * sizeof(trace_rec_t))) == NULL) goto freetr;
+	if((tr->out = malloc(OUT_BUF_SIZE)) == NULL) goto freering;
+
+	ret = RET_ERR_OPEN;
+	if((tr->fp = fopen(filename, "wb")) == NULL) goto freeout;
+
+	ret = RET_ERR_IO;
+	if(fwrite(hdr, trace_file_header(hdr), 1, tr->fp) != 1) goto closefile;
+
+	ret = RET_ERR_SDL;
+	if((tr->thread = SDL_CreateThread(writer_thread, "trace", tr)) == NULL) goto closefile;
+
+	vm->trace = tr;
+	return RET_OK;
+
+closefile:
+	fclose(tr->fp);
+freeout:
+	free(tr->out);
+freering:
+	free(tr->ring);
+freetr:
+	free(tr);
+	return ret;
+}
+
+/* Flushes everything recorded so far. */
+int trace_stop(vm_t *vm) {
+	trace_t *tr = vm->trace;
+	int ret;
+
+	if(tr == NULL)
+		return RET_OK;
+
+	vm->trace = NULL;
+
+	publish(tr);
+	SDL_AtomicSet(&tr->quit, 1);
+	SDL_WaitThread(tr->thread, NULL);
+
+	ret = tr->error ? RET_ERR_IO : RET_OK;
+	if(fclose(tr->fp) != 0)
+		ret = RET_ERR_IO;
+
+	free(tr->out);
+	free(tr->ring);
+	free(tr);
+
+	return ret;
+}
@@ -0,0 +1,334 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Execution trace file codec and text format. Each record is stored as
+ * the difference to the one before: the PC as a signed offset, the cycle
+ * and step counts as increments, and only the registers that changed. A
+ * typical instruction takes four to six bytes.
+ *
+ * File:	"A1TR" u16 version
+ * Record:	u8 mask, varint zigzag pc delta, u8 op, varint cycle delta,
+ *		[varint step delta], [a] [x] [y] [sp] [flags],
+ *		[u8 n, n * (u16 addr, u8 val)]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leakcheck.h"
+
+#include "cpu_6502.h"
+#include "serial.h"
+#include "status.h"
+#include "tracefile.h"
+
+#define TR_MAGIC		"A1TR"
+#define TR_VERSION		2
+#define TR_HDR_SIZE		6
+
+#define MASK_A			0x01
+#define MASK_X			0x02
+#define MASK_Y			0x04
+#define MASK_SP			0x08
+#define MASK_FLAGS		0x10
+#define MASK_WRITE		0x20
+#define MASK_STEP		0x40		/* Step advanced by other than one */
+
+#ifdef _MSC_VER
+#define strtoull	_strtoui64
+#endif
+
+static const uint8_t flag_bits[8] = {
+	FLAG_NEGATIVE, FLAG_OVERFLOW, FLAG_RESERVED, FLAG_BREAK,
+	FLAG_DECIMAL, FLAG_INTERRUPT, FLAG_ZERO, FLAG_CARRY
+};
+
+struct trace_reader_t {
+	FILE *fp;
+	trace_rec_t prev;
+};
+
+static void put_varint(uint8_t **p, uint64_t val) {
+	while(val >= 0x80) {
+		put_u8(p, (uint8_t)(val & 0x7f) | 0x80);
+		val >>= 7;
+	}
+	put_u8(p, (uint8_t)val);
+}
+
+size_t trace_file_header(uint8_t *out) {
+	uint8_t *p = out;
+
+	put_bytes(&p, (const uint8_t*)TR_MAGIC, 4);
+	put_u16(&p, TR_VERSION);
+
+	return p - out;
+}
+
+/* Encodes rec against prev and makes it the new prev. */
+size_t trace_encode(trace_rec_t *prev, const trace_rec_t *rec, uint8_t *out) {
+	uint8_t *p = out + 1, mask = 0;
+	int32_t pc_delta = (int32_t)rec->pc - prev->pc;
+	int i;
+
+	put_varint(&p, ((uint32_t)pc_delta << 1) ^ (uint32_t)(pc_delta >> 31));
+	put_u8(&p, rec->op);
+	put_varint(&p, rec->cycle - prev->cycle);
+
+	if(rec->step != prev->step + 1) {
+		mask |= MASK_STEP;
+		put_varint(&p, rec->step - prev->step);
+	}
+
+	if(rec->a != prev->a)			{ mask |= MASK_A;		put_u8(&p, rec->a); }
+	if(rec->x != prev->x)			{ mask |= MASK_X;		put_u8(&p, rec->x); }
+	if(rec->y != prev->y)			{ mask |= MASK_Y;		put_u8(&p, rec->y); }
+	if(rec->sp != prev->sp)			{ mask |= MASK_SP;		put_u8(&p, rec->sp); }
+	if(rec->flags != prev->flags)	{ mask |= MASK_FLAGS;	put_u8(&p, rec->flags); }
+
+	if(rec->n_writes) {
+		mask |= MASK_WRITE;
+		put_u8(&p, rec->n_writes);
+		for(i = 0; i < rec->n_writes; i++) {
+			put_u16(&p, (uint16_t)(rec->write[i] >> 8));
+			put_u8(&p, rec->write[i] & 0xff);
+		}
+	}
+
+	out[0] = mask;
+	*prev = *rec;
+
+	return p - out;
+}
+
+/* Reader */
+
+static int read_u8(FILE *fp, uint8_t *val) {
+	int c;
+
+	if((c = getc(fp)) == EOF)
+		return 0;
+
+	*val = (uint8_t)c;
+	return 1;
+}
+
+static int read_varint(FILE *fp, uint64_t *val) {
+	uint8_t c;
+	int shift = 0;
+
+	*val = 0;
+	do {
+		if(shift > 63 || !read_u8(fp, &c))
+			return 0;
+		*val |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while(c & 0x80);
+
+	return 1;
+}
+
+trace_reader_t *trace_open(const char *filename, int *status) {
+	trace_reader_t *tr;
+	uint8_t hdr[TR_HDR_SIZE];
+	const uint8_t *p = hdr;
+
+	*status = RET_ERR_ALLOC;
+	if((tr = malloc(sizeof(trace_reader_t))) == NULL)
+		return NULL;
+
+	memset(&tr->prev, 0, sizeof(trace_rec_t));
+
+	*status = RET_ERR_OPEN;
+	if((tr->fp = fopen(filename, "rb")) == NULL)
+		goto freetr;
+
+	*status = RET_ERR_FORMAT;
+	if(fread(hdr, TR_HDR_SIZE, 1, tr->fp) != 1) goto closefile;
+	if(memcmp(hdr, TR_MAGIC, 4) != 0) goto closefile;
+	p += 4;
+	if(get_u16(&p) != TR_VERSION) goto closefile;
+
+	*status = RET_OK;
+	return tr;
+
+closefile:
+	fclose(tr->fp);
+freetr:
+	free(tr);
+	return NULL;
+}
+
+/* RET_EOF at a clean end of file, RET_ERR_FORMAT for a cut off record. */
+int trace_read(trace_reader_t *tr, trace_rec_t *rec) {
+	uint8_t mask, lo, hi, val;
+	uint64_t delta;
+	int i;
+
+	if(!read_u8(tr->fp, &mask))
+		return RET_EOF;
+
+	*rec = tr->prev;
+	rec->n_writes = 0;
+
+	if(!read_varint(tr->fp, &delta)) return RET_ERR_FORMAT;
+	rec->pc = (uint16_t)(tr->prev.pc + (int32_t)((delta >> 1) ^ (~(delta & 1) + 1)));
+
+	if(!read_u8(tr->fp, &rec->op)) return RET_ERR_FORMAT;
+
+	if(!read_varint(tr->fp, &delta)) return RET_ERR_FORMAT;
+	rec->cycle += delta;
+
+	delta = 1;
+	if((mask & MASK_STEP) && !read_varint(tr->fp, &delta)) return RET_ERR_FORMAT;
+	rec->step += delta;
+
+	if((mask & MASK_A) && !read_u8(tr->fp, &rec->a)) return RET_ERR_FORMAT;
+	if((mask & MASK_X) && !read_u8(tr->fp, &rec->x)) return RET_ERR_FORMAT;
+	if((mask & MASK_Y) && !read_u8(tr->fp, &rec->y)) return RET_ERR_FORMAT;
+	if((mask & MASK_SP) && !read_u8(tr->fp, &rec->sp)) return RET_ERR_FORMAT;
+	if((mask & MASK_FLAGS) && !read_u8(tr->fp, &rec->flags)) return RET_ERR_FORMAT;
+
+	if(mask & MASK_WRITE) {
+		if(!read_u8(tr->fp, &rec->n_writes) || rec->n_writes > TRACE_MAX_WRITES)
+			return RET_ERR_FORMAT;
+		for(i = 0; i < rec->n_writes; i++) {
+			if(!read_u8(tr->fp, &lo) || !read_u8(tr->fp, &hi) || !read_u8(tr->fp, &val))
+				return RET_ERR_FORMAT;
+			rec->write[i] = ((uint32_t)lo << 8) | ((uint32_t)hi << 16) | val;
+		}
+	}
+
+	tr->prev = *rec;
+	return RET_OK;
+}
+
+void trace_close_reader(trace_reader_t *tr) {
+	fclose(tr->fp);
+	free(tr);
+}
+
+/* Text */
+
+void trace_print(FILE *fp, const trace_rec_t *rec, const int show) {
+	static const char flag_syms[8] = { 'N', 'V', 'R', 'B', 'D', 'I', 'Z', 'C' };
+	char flags[9];
+	int i;
+
+	for(i = 0; i < 8; i++)
+		flags[i] = (rec->flags & flag_bits[i]) ? flag_syms[i] : '-';
+	flags[8] = '\0';
+
+	fprintf(fp, "ST: %8llu PC: %04x I: %02x A: %02x X: %02x Y: %02x SP: 01%02x [%s]",
+		(unsigned long long)rec->step, rec->pc, rec->op,
+		rec->a, rec->x, rec->y, rec->sp, flags);
+
+	if(show & TRACE_SHOW_CYCLES)
+		fprintf(fp, " CY: %llu", (unsigned long long)rec->cycle);
+
+	if((show & TRACE_SHOW_WRITES) && rec->n_writes) {
+		fprintf(fp, " W:");
+		for(i = 0; i < rec->n_writes; i++)
+			fprintf(fp, "%s%04x=%02x", i ? "," : " ", rec->write[i] >> 8, rec->write[i] & 0xff);
+	}
+
+	fprintf(fp, "\n");
+}
+
+static int parse_field(const char **p, const char *key, const int base, unsigned long *val) {
+	const char *s = *p;
+	char *end;
+	size_t len = strlen(key);
+
+	while(*s == ' ')
+		s++;
+	if(strncmp(s, key, len) != 0)
+		return 0;
+
+	*val = strtoul(s + len, &end, base);
+	if(end == s + len)
+		return 0;
+
+	*p = end;
+	return 1;
+}
+
+/* Parses one line as written by trace_print or print_state. Returns 0 for
+ * lines that aren't state lines. */
+int trace_parse_line(const char *line, trace_rec_t *rec) {
+	const char *p = line;
+	char *end;
+	unsigned long pc, op, a, x, y, sp, addr, val;
+	int i;
+
+	while(*p == ' ')
+		p++;
+	if(strncmp(p, "ST:", 3) != 0)
+		return 0;
+
+	rec->step = strtoull(p + 3, &end, 10);
+	p = end;
+
+	if(!parse_field(&p, "PC:", 16, &pc) || !parse_field(&p, "I:", 16, &op) ||
+	   !parse_field(&p, "A:", 16, &a) || !parse_field(&p, "X:", 16, &x) ||
+	   !parse_field(&p, "Y:", 16, &y) || !parse_field(&p, "SP:", 16, &sp))
+		return 0;
+
+	while(*p == ' ')
+		p++;
+	if(*p++ != '[')
+		return 0;
+
+	rec->flags = 0;
+	for(i = 0; i < 8; i++, p++) {
+		if(*p == '\0' || *p == ']')
+			return 0;
+		if(*p != '-')
+			rec->flags |= flag_bits[i];
+	}
+	if(*p++ != ']')
+		return 0;
+
+	rec->pc = (uint16_t)pc;
+	rec->op = (uint8_t)op;
+	rec->a = (uint8_t)a;
+	rec->x = (uint8_t)x;
+	rec->y = (uint8_t)y;
+	rec->sp = (uint8_t)sp;
+	rec->cycle = 0;
+	rec->n_writes = 0;
+
+	while(*p == ' ')
+		p++;
+	if(strncmp(p, "CY:", 3) == 0) {
+		rec->cycle = strtoull(p + 3, &end, 10);
+		p = end;
+	}
+
+	if(!parse_field(&p, "W:", 16, &addr))
+		return 1;
+
+	/* W: addr=val,addr=val,... */
+	for(;;) {
+		if(*p++ != '=')
+			return 0;
+		val = strtoul(p, &end, 16);
+		if(end == p || rec->n_writes == TRACE_MAX_WRITES)
+			return 0;
+		rec->write[rec->n_writes++] = ((uint32_t)(addr & 0xffff) << 8) | (val & 0xff);
+
+		p = end;
+		if(*p != ',')
+			break;
+		addr = strtoul(++p, &end, 16);
+		if(end == p)
+			return 0;
+		p = end;
+	}
+
+	return 1;
+}
@@ -5,18 +5,23 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "leakcheck.h"
 
 #include "cpu_interface.h"
 #include "mem.h"
+#include "serial.h"
 #include "status.h"
+#include "trace.h"
 #include "vm.h"
+#include "watch.h"
 
 #include "cpu_6502.h"
 #include "io_6820.h"
+#include "io_aci.h"
 
-vm_t *vm_init(cpudef_t cpudef, int *status) {
+vm_t *vm_init(cpudef_t cpudef, dispdef_t dispdef, int *status) {
 	vm_t *out = malloc(sizeof(vm_t));
 
 	*status = RET_ERR_ALLOC;
@@ -33,47 +38,206 @@ vm_t *vm_init(cpudef_t cpudef, int *status) {
 	
 	init_mem(out);
 
-	if(pia_init(out) != RET_OK) {
+	out->quit = 0;
+	out->step = 0;
+	out->cycle = 0;
+	out->deadline = SCHED_NEVER;
+	out->trace = NULL;
+	out->n_writes = 0;
+	out->cov_exec = out->cov_read = out->cov_write = NULL;
+	out->heat_read = out->heat_write = out->heat_fetch = NULL;
+	memset(out->trap, 0, sizeof(out->trap));
+	out->watch = NULL;
+	out->watch_hit = 0;
+	out->irq = 0;
+	out->nmi = 0;
+
+	if(sched_init(&out->sched) != RET_OK) {
 		free(out);
 		return NULL;
 	}
 
-	out->quit = 0;
-	out->step = 0;
+	if(pia_init(out, dispdef) != RET_OK) {
+		sched_clean(&out->sched);
+		free(out);
+		return NULL;
+	}
 
 	*status = RET_OK;
 	return out;
 }
 
 void vm_clean(vm_t *vm) {
+	trace_stop(vm);
+	watch_clear(vm);
 	vm->cpu_def.quit(vm->cpu_state);
 	pia_clean();
+	sched_clean(&vm->sched);
 	free(vm);
 }
 
+/* The lines are sampled before the instruction: one that changes them
+ * in its last cycle is followed by one more instruction. An NMI wins
+ * over an IRQ; the CPU ignores the IRQ if I was set at the poll. */
+static void vm_interrupt(vm_t *vm, const uint8_t irq, const uint8_t nmi) {
+	int cycles;
+
+	if(nmi) {
+		vm->nmi = 0;
+		vm->cpu_def.nmi(vm->cpu_state, &cycles);
+	} else if(!irq || vm->cpu_def.irq(vm->cpu_state, &cycles) != RET_JUMP) {
+		return;
+	}
+
+	vm->cycle += cycles;
+}
+
 void vm_step(vm_t *vm, int *status) {
 	cpudef_t cpu_def = vm->cpu_def;
 	uint16_t old_pc = vm->cpu_def.get_pc(vm->cpu_state);
+	uint8_t irq = vm->irq, nmi = vm->nmi;
 	int ret, cycles;
 
+	if((vm->trap[old_pc >> 8] & TRAP_EXEC) && watch_exec(vm, old_pc)) {
+		*status = RET_BREAK;
+		return;
+	}
+
+	vm->watch_hit = 0;
 	cpu_def.fetch(vm->cpu_state);
 	ret = vm->cpu_def.exec(vm->cpu_state, &cycles);
 
-	pia_step(vm);
-	
 	vm->step++;
 	vm->cycle += cycles;
 
+	if(vm->trace)
+		trace_put(vm);
+	vm->n_writes = 0;
+
+	if(irq | nmi)
+		vm_interrupt(vm, irq, nmi);
+
+	sched_dispatch(vm);
+
 	if(ret == RET_OK || ret == RET_JUMP)
 		*status = RET_OK;
 
 	if(vm->cpu_def.get_pc(vm->cpu_state) == old_pc)
 		*status = RET_LOOP;
 
+	if(vm->watch_hit)
+		*status = RET_BREAK;
+
 	if(vm->quit)
 		*status = RET_QUIT;
 }
 
+/* Runs until the clock reaches 'until'. Instructions execute back to back
+ * up to the next scheduler deadline; devices only get control through
+ * the events they posted. A watchpoint ends the slice early by pulling
+ * the deadline in. */
+void vm_run(vm_t *vm, const uint64_t until, int *status) {
+	cpudef_t cpu_def = vm->cpu_def;
+	void *cpu = vm->cpu_state;
+	uint16_t old_pc;
+	uint8_t irq, nmi;
+	int cycles;
+
+	*status = RET_OK;
+	vm->watch_hit = 0;
+
+	for(;;) {
+		sched_dispatch(vm);
+
+		if(vm->quit) {
+			*status = RET_QUIT;
+			return;
+		}
+
+		if(vm->watch_hit) {
+			*status = RET_BREAK;
+			return;
+		}
+
+		if(vm->cycle >= until)
+			return;
+
+		if(vm->deadline > until)
+			vm->deadline = until;
+
+		while(vm->cycle < vm->deadline) {
+			old_pc = cpu_def.get_pc(cpu);
+			if((vm->trap[old_pc >> 8] & TRAP_EXEC) && watch_exec(vm, old_pc)) {
+				*status = RET_BREAK;
+				return;
+			}
+
+			irq = vm->irq;
+			nmi = vm->nmi;
+
+			cpu_def.fetch(cpu);
+			cpu_def.exec(cpu, &cycles);
+
+			vm->step++;
+			vm->cycle += cycles;
+
+			if(vm->trace)
+				trace_put(vm);
+			vm->n_writes = 0;
+
+			if(irq | nmi)
+				vm_interrupt(vm, irq, nmi);
+
+			if(cpu_def.get_pc(cpu) == old_pc) {
+				sched_dispatch(vm);
+				*status = RET_LOOP;
+				return;
+			}
+		}
+	}
+}
+
 void vm_reset(vm_t *vm) {
 	vm->cpu_def.reset(vm->cpu_state);
+}
+
+/* Machine image: clocks, memory planes, CPU registers, PIA and ACI state.
+ * ROM and memory map are fixed once the images are loaded, so images
+ * that stay within the session can leave them out (with_rom = 0). */
+size_t vm_state_size(vm_t *vm, const int with_rom) {
+	return 16 + (with_rom ? 4 : 2) * 65536 + vm->cpu_def.save_state(vm->cpu_state, NULL) + pia_save_state(NULL) + aci_save_state(NULL);
+}
+
+void vm_save_state(vm_t *vm, uint8_t *buf, const int with_rom) {
+	put_u64(&buf, vm->cycle);
+	put_u64(&buf, vm->step);
+	put_bytes(&buf, vm->mem, 65536);
+	put_bytes(&buf, vm->ram, 65536);
+	if(with_rom) {
+		put_bytes(&buf, vm->rom, 65536);
+		put_bytes(&buf, vm->mem_map, 65536);
+	}
+	buf += vm->cpu_def.save_state(vm->cpu_state, buf);
+	buf += pia_save_state(buf);
+	aci_save_state(buf);
+}
+
+void vm_load_state(vm_t *vm, const uint8_t *buf, const int with_rom) {
+	uint64_t old_cycle = vm->cycle;
+
+	vm->cycle = get_u64(&buf);
+	vm->step = get_u64(&buf);
+	sched_rebase(vm, old_cycle);
+
+	get_bytes(&buf, vm->mem, 65536);
+	get_bytes(&buf, vm->ram, 65536);
+	if(with_rom) {
+		get_bytes(&buf, vm->rom, 65536);
+		get_bytes(&buf, vm->mem_map, 65536);
+	}
+	vm->cpu_def.load_state(vm->cpu_state, buf);
+	buf += vm->cpu_def.save_state(vm->cpu_state, NULL);
+	pia_load_state(buf);
+	buf += pia_save_state(NULL);
+	aci_load_state(buf);
 }
\ No newline at end of file
@@ -0,0 +1,448 @@
+/*******************************************
+ * SPDX-License-Identifier: GPL-2.0-only   *
+ * Copyright (C) 2017-2022  Martin Wolters *
+ *******************************************/
+
+/* Breakpoints and watchpoints. Each one marks the pages it covers in
+ * vm->trap, and the run loop and the memory functions only call in here
+ * for accesses to marked pages, so everything else keeps its fast path.
+ *
+ * Spec:	<from>[-<to>][:<condition>], addresses in hex
+ *
+ * The condition is compiled to bytecode for a small stack machine when
+ * the trap is set, and only runs when an access falls into its range:
+ *
+ *	A X Y S P PC		registers, as they are during the access
+ *	V OLD ADDR			value accessed, value before a write, address
+ *	[expr]				memory byte, read without side effects
+ *	$8d 141				numbers
+ *	( ) ! == != < <= > >= & ^ | && ||	as in C
+ *
+ * Read traps see every bus read, including opcode and operand fetches.
+ * A breakpoint stops the machine before the instruction, a watchpoint
+ * after the instruction that made the access.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leakcheck.h"
+
+#include "status.h"
+#include "vm.h"
+#include "watch.h"
+
+#define CODE_MAX		64
+#define STACK_MAX		16
+#define SPEC_MAX_LEN	64
+
+#define OP_END			0
+#define OP_CONST		1		/* u16 follows */
+#define OP_REG			2		/* REG_* follows */
+#define OP_PEEK			3
+#define OP_NOT			4
+#define OP_LOR			5
+#define OP_LAND			6
+#define OP_OR			7
+#define OP_XOR			8
+#define OP_AND			9
+#define OP_EQ			10
+#define OP_NE			11
+#define OP_LT			12
+#define OP_LE			13
+#define OP_GT			14
+#define OP_GE			15
+
+#define REG_A			0
+#define REG_X			1
+#define REG_Y			2
+#define REG_S			3
+#define REG_P			4
+#define REG_PC			5
+#define REG_V			6
+#define REG_OLD			7
+#define REG_ADDR		8
+
+#define LEVELS			7
+
+typedef struct watch_t {
+	int type;
+	uint16_t from, to;
+	uint8_t code[CODE_MAX];
+	char spec[SPEC_MAX_LEN];
+	uint64_t hits;
+} watch_t;
+
+struct watch_list_t {
+	watch_t *watch;
+	int n_watches, n_alloced;
+
+	/* The breakpoint the machine stopped at, skipped when it goes on */
+	int stopped;
+	uint64_t stop_step;
+	uint16_t stop_pc;
+};
+
+typedef struct compiler_t {
+	const char *p;
+	uint8_t *code;
+	int len, depth, err;
+} compiler_t;
+
+/* Longer operators first, so "||" isn't taken for "|". */
+static const struct {
+	const char *op;
+	int level;
+	uint8_t code;
+} binops[] = {
+	{ "||", 0, OP_LOR }, { "&&", 1, OP_LAND }, { "|", 2, OP_OR },
+	{ "^", 3, OP_XOR }, { "&", 4, OP_AND }, { "==", 5, OP_EQ },
+	{ "!=", 5, OP_NE }, { "<=", 6, OP_LE }, { ">=", 6, OP_GE },
+	{ "<", 6, OP_LT }, { ">", 6, OP_GT },
+	{ NULL, 0, 0 }
+};
+
+static const struct {
+	const char *name;
+	uint8_t reg;
+} regs[] = {
+	{ "A", REG_A }, { "X", REG_X }, { "Y", REG_Y }, { "S", REG_S },
+	{ "SP", REG_S }, { "P", REG_P }, { "PC", REG_PC }, { "V", REG_V },
+	{ "OLD", REG_OLD }, { "ADDR", REG_ADDR },
+	{ NULL, 0 }
+};
+
+static void emit(compiler_t *c, const uint8_t byte) {
+	if(c->len == CODE_MAX - 1)
+		c->err = 1;
+	else
+		c->code[c->len++] = byte;
+}
+
+/* Tracks the stack depth of the code emitted so far. */
+static void emit_op(compiler_t *c, const uint8_t op, const int push) {
+	emit(c, op);
+	c->depth += push;
+	if(c->depth > STACK_MAX)
+		c->err = 1;
+}
+
+static void skip_space(compiler_t *c) {
+	while(isspace((unsigned char)*c->p))
+		c->p++;
+}
+
+static int next_is(compiler_t *c, const char *s) {
+	skip_space(c);
+	if(strncmp(c->p, s, strlen(s)))
+		return 0;
+
+	c->p += strlen(s);
+	return 1;
+}
+
+static void expr(compiler_t *c, const int level);
+
+static void primary(compiler_t *c) {
+	const char *start;
+	char name[8], *end;
+	unsigned long val;
+	int i;
+
+	skip_space(c);
+
+	if(next_is(c, "(")) {
+		expr(c, 0);
+		if(!next_is(c, ")"))
+			c->err = 1;
+	} else if(next_is(c, "[")) {
+		expr(c, 0);
+		emit_op(c, OP_PEEK, 0);
+		if(!next_is(c, "]"))
+			c->err = 1;
+	} else if(*c->p == '$' || isdigit((unsigned char)*c->p)) {
+		start = (*c->p == '$') ? c->p + 1 : c->p;
+		val = strtoul(start, &end, (*c->p == '$') ? 16 : 10);
+		if(end == start || val > 0xffff)
+			c->err = 1;
+		c->p = end;
+		emit_op(c, OP_CONST, 1);
+		emit(c, val & 0xff);
+		emit(c, (val >> 8) & 0xff);
+	} else {
+		for(i = 0; isalpha((unsigned char)*c->p) && i < (int)sizeof(name) - 1; i++)
+			name[i] = (char)toupper((unsigned char)*c->p++);
+		name[i] = '\0';
+
+		for(i = 0; regs[i].name && strcmp(regs[i].name, name); i++);
+		if(regs[i].name == NULL) {
+			c->err = 1;
+			return;
+		}
+
+		emit_op(c, OP_REG, 1);
+		emit(c, regs[i].reg);
+	}
+}
+
+static void unary(compiler_t *c) {
+	if(next_is(c, "!")) {
+		unary(c);
+		emit_op(c, OP_NOT, 0);
+	} else {
+		primary(c);
+	}
+}
+
+static int find_binop(compiler_t *c) {
+	int i;
+
+	skip_space(c);
+	for(i = 0; binops[i].op; i++) {
+		if(!strncmp(c->p, binops[i].op, strlen(binops[i].op)))
+			return i;
+	}
+
+	return -1;
+}
+
+static void expr(compiler_t *c, const int level) {
+	int i;
+
+	if(level == LEVELS) {
+		unary(c);
+		return;
+	}
+
+	expr(c, level + 1);
+	while(!c->err && (i = find_binop(c)) >= 0 && binops[i].level == level) {
+		c->p += strlen(binops[i].op);
+		expr(c, level + 1);
+		emit_op(c, binops[i].code, -1);
+	}
+}
+
+static int compile(const char *cond, uint8_t *code) {
+	compiler_t c;
+
+	c.p = cond;
+	c.code = code;
+	c.len = c.depth = c.err = 0;
+
+	skip_space(&c);
+	if(*c.p) {
+		expr(&c, 0);
+		skip_space(&c);
+		if(*c.p)
+			c.err = 1;
+	}
+
+	code[c.len] = OP_END;
+
+	return c.err ? RET_ERR_INVAL : RET_OK;
+}
+
+static int eval(vm_t *vm, const uint8_t *code, const uint16_t addr, const uint8_t old, const uint8_t val) {
+	int32_t stack[STACK_MAX], a, b;
+	cpu_regs_t r;
+	int sp = 0;
+
+	if(*code == OP_END)
+		return 1;
+
+	vm->cpu_def.regs(vm->cpu_state, &r);
+
+	for(;;) {
+		switch(*code++) {
+			case OP_END:
+				return stack[0] != 0;
+
+			case OP_CONST:
+				stack[sp++] = code[0] | (code[1] << 8);
+				code += 2;
+				continue;
+
+			case OP_REG:
+				switch(*code++) {
+					case REG_A:		a = r.a;		break;
+					case REG_X:		a = r.x;		break;
+					case REG_Y:		a = r.y;		break;
+					case REG_S:		a = r.sp;		break;
+					case REG_P:		a = r.flags;	break;
+					case REG_PC:	a = r.pc;		break;
+					case REG_V:		a = val;		break;
+					case REG_OLD:	a = old;		break;
+					default:		a = addr;		break;
+				}
+				stack[sp++] = a;
+				continue;
+
+			case OP_PEEK:
+				stack[sp - 1] = vm->mem[stack[sp - 1] & 0xffff];
+				continue;
+
+			case OP_NOT:
+				stack[sp - 1] = !stack[sp - 1];
+				continue;
+		}
+
+		/* Binary operators */
+		b = stack[--sp];
+		a = stack[sp - 1];
+		switch(code[-1]) {
+			case OP_LOR:	a = a || b;		break;
+			case OP_LAND:	a = a && b;		break;
+			case OP_OR:		a = a | b;		break;
+			case OP_XOR:	a = a ^ b;		break;
+			case OP_AND:	a = a & b;		break;
+			case OP_EQ:		a = a == b;		break;
+			case OP_NE:		a = a != b;		break;
+			case OP_LT:		a = a < b;		break;
+			case OP_LE:		a = a <= b;		break;
+			case OP_GT:		a = a > b;		break;
+			default:		a = a >= b;		break;
+		}
+		stack[sp - 1] = a;
+	}
+}
+
+static int parse_spec(const char *spec, watch_t *w) {
+	const char *cond;
+	char *end;
+	unsigned long from, to;
+
+	if(strlen(spec) >= SPEC_MAX_LEN)
+		return RET_ERR_INVAL;
+
+	from = strtoul(spec, &end, 16);
+	to = from;
+	if(end != spec && *end == '-')
+		to = strtoul(spec = end + 1, &end, 16);
+
+	if(end == spec || from > to || to > 0xffff || (*end && *end != ':'))
+		return RET_ERR_INVAL;
+
+	cond = (*end == ':') ? end + 1 : end;
+	if(compile(cond, w->code) != RET_OK)
+		return RET_ERR_INVAL;
+
+	w->from = (uint16_t)from;
+	w->to = (uint16_t)to;
+
+	return RET_OK;
+}
+
+static void mark_pages(vm_t *vm, const watch_t *w) {
+	int page;
+
+	for(page = w->from >> 8; page <= w->to >> 8; page++)
+		vm->trap[page] |= (uint8_t)w->type;
+}
+
+int watch_add(vm_t *vm, const int type, const char *spec) {
+	watch_list_t *wl = vm->watch;
+	watch_t *neww, *w;
+
+	if(wl == NULL) {
+		if((wl = malloc(sizeof(watch_list_t))) == NULL)
+			return RET_ERR_ALLOC;
+		wl->watch = NULL;
+		wl->n_watches = wl->n_alloced = 0;
+		wl->stopped = 0;
+		vm->watch = wl;
+	}
+
+	if(wl->n_watches == wl->n_alloced) {
+		if((neww = malloc((wl->n_alloced + PREALLOC_LIST) * sizeof(watch_t))) == NULL)
+			return RET_ERR_ALLOC;
+
+		if(wl->watch) {
+			memcpy(neww, wl->watch, wl->n_watches * sizeof(watch_t));
+			free(wl->watch);
+		}
+		wl->watch = neww;
+		wl->n_alloced += PREALLOC_LIST;
+	}
+
+	w = &wl->watch[wl->n_watches];
+	if(parse_spec(spec, w) != RET_OK)
+		return RET_ERR_INVAL;
+
+	strcpy(w->spec, spec);
+	w->type = type;
+	w->hits = 0;
+	wl->n_watches++;
+
+	mark_pages(vm, w);
+
+	return RET_OK;
+}
+
+void watch_clear(vm_t *vm) {
+	memset(vm->trap, 0, sizeof(vm->trap));
+
+	if(vm->watch == NULL)
+		return;
+
+	if(vm->watch->watch)
+		free(vm->watch->watch);
+	free(vm->watch);
+	vm->watch = NULL;
+}
+
+/* 1 if the machine should stop before the instruction at pc. */
+int watch_exec(vm_t *vm, const uint16_t pc) {
+	watch_list_t *wl = vm->watch;
+	watch_t *w;
+	int i;
+
+	if(wl->stopped && wl->stop_step == vm->step && wl->stop_pc == pc) {
+		wl->stopped = 0;
+		return 0;
+	}
+
+	for(i = 0; i < wl->n_watches; i++) {
+		w = &wl->watch[i];
+		if(w->type != TRAP_EXEC || pc < w->from || pc > w->to)
+			continue;
+		if(!eval(vm, w->code, pc, vm->mem[pc], vm->mem[pc]))
+			continue;
+
+		w->hits++;
+		printf("BREAK: %s at $%04x, hit %llu.\n", w->spec, pc, (unsigned long long)w->hits);
+
+		wl->stopped = 1;
+		wl->stop_step = vm->step;
+		wl->stop_pc = pc;
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Ends the slice after the current instruction if a watchpoint fires. */
+void watch_access(vm_t *vm, const int type, const uint16_t addr, const uint8_t old, const uint8_t val) {
+	watch_list_t *wl = vm->watch;
+	watch_t *w;
+	int i;
+
+	for(i = 0; i < wl->n_watches; i++) {
+		w = &wl->watch[i];
+		if(w->type != type || addr < w->from || addr > w->to)
+			continue;
+		if(!eval(vm, w->code, addr, old, val))
+			continue;
+
+		w->hits++;
+		if(type == TRAP_WRITE)
+			printf("WATCH: %s, write $%02x to $%04x (was $%02x), hit %llu.\n", w->spec, val, addr, old, (unsigned long long)w->hits);
+		else
+			printf("WATCH: %s, read $%02x from $%04x, hit %llu.\n", w->spec, val, addr, (unsigned long long)w->hits);
+
+		vm->watch_hit = 1;
+		vm->deadline = vm->cycle;
+	}
+}